@@ -0,0 +1,77 @@
+#ifndef AST_H
+#define AST_H
+
+#include <string.h>
+
+#include "structs.h"
+#include "intern.h"
+#include "symtab.h"
+
+// Syntax tree built by the parser and lowered to PM/0 by codegen.h. Nodes come
+// from one arena that is dropped before the next program is parsed. Every node
+// has the same shape, the fields a kind uses are:
+//
+//   NODE_BLOCK     symbol (procedure, NO_SYMBOL for the main block), value (frame
+//                  size), level, child[0] procedures (NODE_BLOCK list), child[1] body
+//   NODE_ASSIGN    symbol, level, child[0] value
+//   NODE_CALL      symbol, level
+//   NODE_BEGIN     child[0] statements (linked by next)
+//   NODE_IF        child[0] condition, child[1] then
+//   NODE_WHILE     child[0] condition, child[1] body
+//   NODE_READ      symbol, level
+//   NODE_WRITE     child[0] value
+//   NODE_NUMBER    value (a literal, or the value of a named constant)
+//   NODE_VARIABLE  symbol, level
+//   NODE_UNARY     op (NEG, ODD), child[0]
+//   NODE_BINARY    op (ADD ... GEQ, SHL, SHR, AND), child[0], child[1]
+//
+// level is the lexical level of the block the node appears in, so the L of a
+// load or store is level minus the symbol's level. Statements parsed while spans
+// are recorded carry their span index.
+
+#define NODE_BLOCK 1
+#define NODE_ASSIGN 2
+#define NODE_CALL 3
+#define NODE_BEGIN 4
+#define NODE_IF 5
+#define NODE_WHILE 6
+#define NODE_READ 7
+#define NODE_WRITE 8
+#define NODE_NUMBER 9
+#define NODE_VARIABLE 10
+#define NODE_UNARY 11
+#define NODE_BINARY 12
+
+// PROTOTYPES
+Node* newNode(int kind);
+Node* newOperator(int kind, int op, Node* left, Node* right);
+
+// GLOBALS
+THREAD_LOCAL Arena astArena;
+
+// Allocates a blank node of a kind from the tree arena
+Node* newNode(int kind)
+{
+    Node* node = arenaAlloc(&astArena, sizeof(Node));
+
+    memset(node, 0, sizeof(Node));
+    node->kind = kind;
+    node->symbol = NO_SYMBOL;
+    node->span = -1;
+
+    return node;
+}
+
+// Allocates a unary or binary operator node
+Node* newOperator(int kind, int op, Node* left, Node* right)
+{
+    Node* node = newNode(kind);
+
+    node->op = op;
+    node->child[0] = left;
+    node->child[1] = right;
+
+    return node;
+}
+
+#endif
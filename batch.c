@@ -0,0 +1,260 @@
+// COP 3402
+// Batch Compile Driver
+//
+// Usage: batch.exe [-jN] [-O0|-O1|-O2] [-o dir] [-m] [--cache=dir [--cache-size=MB]]
+//                  source|directory|@list ...
+//
+// Compiles every source named (a directory stands for the .pl0 files in it, and
+// @list for the paths listed one per line in a file) across a work stealing
+// pool, writing each one's code as an object file (objectfile.h) named like it
+// with a .pm0 extension, beside it or in the -o directory. -m keeps the code in memory instead of writing it.
+// Inputs that would write the same output file are reported and nothing is compiled.
+// --cache reuses (and stores) compiles in a cache directory, see cache.h.
+// Ends with a summary of throughput and any failures, and exits 1 if there were
+// any.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "batch.h"
+#include "passes.h"
+
+#define BATCH_SOURCE_EXTENSION ".pl0"
+
+// PROTOTYPES
+void addInput(char* path);
+void addDirectory(char* directory);
+void addList(char* listFile);
+void addJob(char* path);
+int comparePaths(const void* a, const void* b);
+void printBatchSummary(int threads, int steals, double seconds, CompileCache* cache);
+
+// GLOBALS
+BatchJob* batchJobs = NULL;
+int batchCount = 0;
+int batchCapacity = 0;
+
+int main(int argc, char* argv[])
+{
+    int i, steals, threads = 0, level = 0, inMemory = 0, failed = 0;
+    char* directory = NULL;
+    char* cacheDirectory = NULL;
+    long long cacheCapacity = 0;
+    CompileCache cache;
+    double start;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "-j", 2) == 0)
+            threads = atoi(argv[i] + 2);
+        else if (strncmp(argv[i], "-O", 2) == 0)
+            level = atoi(argv[i] + 2);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            directory = argv[++i];
+        else if (strcmp(argv[i], "-m") == 0)
+            inMemory = 1;
+        else if (strncmp(argv[i], "--cache=", 8) == 0)
+            cacheDirectory = argv[i] + 8;
+        else if (strncmp(argv[i], "--cache-size=", 13) == 0)
+            cacheCapacity = atoll(argv[i] + 13) * 1024 * 1024;
+        else
+            addInput(argv[i]);
+    }
+
+    if (batchCount == 0)
+    {
+        printf("usage: batch.exe [-jN] [-O0|-O1|-O2] [-o dir] [-m] [--cache=dir [--cache-size=MB]] "
+               "source|directory|@list ...\n");
+        return 1;
+    }
+
+#ifdef HAVE_DIRENT
+    // The output directory need not exist yet
+    if (directory != NULL && !inMemory && mkdir(directory, 0777) != 0 && errno != EEXIST)
+    {
+        printf("Could not create output directory %s: %s\n", directory, strerror(errno));
+        return 1;
+    }
+#endif
+
+    for (i = 0; i < batchCount; i++)
+        batchJobs[i].output = (inMemory) ? NULL : batchOutputPath(batchJobs[i].path, directory);
+
+    // Parallel jobs writing one file would race, and all but one result be lost
+    if (findSharedOutputs(batchJobs, batchCount) > 0)
+    {
+        printf("Nothing compiled: rename those inputs, or compile them in separate runs\n");
+        return 1;
+    }
+
+    threads = poolThreadCount(threads, batchCount);
+
+    if (cacheDirectory != NULL)
+        openCache(&cache, cacheDirectory, cacheCapacity);
+
+    start = passClock();
+    steals = compileBatch(batchJobs, batchCount, threads, level, (cacheDirectory) ? &cache : NULL);
+    printBatchSummary(threads, steals, passClock() - start, (cacheDirectory) ? &cache : NULL);
+
+    for (i = 0; i < batchCount; i++)
+    {
+        failed |= batchJobs[i].failed;
+
+        free(batchJobs[i].path);
+        free(batchJobs[i].output);
+        free(batchJobs[i].code);
+    }
+
+    free(batchJobs);
+
+    return failed;
+}
+
+// Adds the jobs an argument names: a directory's sources, a list's, or a file
+void addInput(char* path)
+{
+#ifdef HAVE_DIRENT
+    DIR* directory;
+#endif
+
+    if (path[0] == '@')
+    {
+        addList(path + 1);
+        return;
+    }
+
+#ifdef HAVE_DIRENT
+    directory = opendir(path);
+
+    if (directory != NULL)
+    {
+        closedir(directory);
+        addDirectory(path);
+        return;
+    }
+#endif
+
+    addJob(path);
+}
+
+// Adds every .pl0 file in a directory, sorted by name so runs line up
+void addDirectory(char* path)
+{
+#ifdef HAVE_DIRENT
+    DIR* directory = opendir(path);
+    struct dirent* entry;
+    int first = batchCount, length, extension = strlen(BATCH_SOURCE_EXTENSION);
+    char* file;
+
+    while ((entry = readdir(directory)) != NULL)
+    {
+        length = strlen(entry->d_name);
+
+        if (length <= extension || strcmp(entry->d_name + length - extension, BATCH_SOURCE_EXTENSION) != 0)
+            continue;
+
+        file = malloc(strlen(path) + length + 2);
+        sprintf(file, "%s/%s", path, entry->d_name);
+        addJob(file);
+        free(file);
+    }
+
+    closedir(directory);
+
+    qsort(batchJobs + first, batchCount - first, sizeof(BatchJob), comparePaths);
+#endif
+}
+
+// Adds the file named on each line of a list file (blank lines are skipped)
+void addList(char* listFile)
+{
+    FILE* list = fopen(listFile, "r");
+    char line[4096];
+    int length;
+
+    if (list == NULL)
+    {
+        printf("Could not read %s\n", listFile);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), list) != NULL)
+    {
+        length = strlen(line);
+
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            line[--length] = '\0';
+
+        if (length > 0)
+            addJob(line);
+    }
+
+    fclose(list);
+}
+
+// Appends a job compiling one file
+void addJob(char* path)
+{
+    if (batchCount == batchCapacity)
+    {
+        batchCapacity = (batchCapacity) ? batchCapacity * 2 : 256;
+        batchJobs = realloc(batchJobs, batchCapacity * sizeof(BatchJob));
+    }
+
+    memset(&batchJobs[batchCount], 0, sizeof(BatchJob));
+    batchJobs[batchCount].path = malloc(strlen(path) + 1);
+    strcpy(batchJobs[batchCount].path, path);
+    batchCount++;
+}
+
+// Orders jobs by path
+int comparePaths(const void* a, const void* b)
+{
+    return strcmp(((const BatchJob*) a)->path, ((const BatchJob*) b)->path);
+}
+
+// Prints how many jobs compiled and how fast (and how the cache did), then each
+// failure (in job order)
+void printBatchSummary(int threads, int steals, double seconds, CompileCache* cache)
+{
+    long long bytes = 0, instructions = 0;
+    int i, failures = 0;
+
+    for (i = 0; i < batchCount; i++)
+    {
+        bytes += batchJobs[i].sourceBytes;
+        instructions += batchJobs[i].codeLength;
+        failures += batchJobs[i].failed;
+    }
+
+    if (seconds <= 0)
+        seconds = 1e-9;
+
+    printf("Compiled %d files (%d failed) in %.3f s on %d threads, %d steals\n",
+           batchCount, failures, seconds, threads, steals);
+    printf("%.0f files/s, %.2f MB/s of source, %lld instructions\n",
+           batchCount / seconds, bytes / seconds / (1024 * 1024), instructions);
+
+    if (cache != NULL)
+        printf("Cache: %d hits, %d misses, %.2f MB in %s\n", cache->hits, cache->misses,
+               cache->size / (1024.0 * 1024), cache->directory);
+
+    if (failures == 0)
+        return;
+
+    printf("Failures:\n");
+
+    for (i = 0; i < batchCount; i++)
+    {
+        if (!batchJobs[i].failed)
+            continue;
+
+        if (batchJobs[i].diagnostic.phase == DIAGNOSTIC_FILE)
+            printf("%s: %s\n", batchJobs[i].path, batchJobs[i].diagnostic.message);
+        else
+            printf("%s: line %d, column %d: %s\n", batchJobs[i].path, batchJobs[i].diagnostic.line,
+                   batchJobs[i].diagnostic.column, batchJobs[i].diagnostic.message);
+    }
+}
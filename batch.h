@@ -0,0 +1,183 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs.h"
+#include "compiler.h"
+#include "cache.h"
+#include "pool.h"
+
+// Batch compiles. Every job is one source file compiled on its own through a
+// Compiler (and the compile cache, cache.h, when there is one), the jobs spread
+// over a work stealing pool (pool.h), each thread with its own compiler state.
+// A job's code is written as a PM/0 object file (objectfile.h) to its own output
+// path, or kept in the job when it has none, and a failure is recorded in the
+// job's diagnostic -- jobs share nothing, so a batch reads the same however it
+// was scheduled.
+
+#define BATCH_EXTENSION ".pm0"
+
+// PROTOTYPES
+int compileBatch(BatchJob* jobs, int count, int threads, int optimizeLevel, CompileCache* cache);
+void compileJob(void* context, int job, int worker);
+void finishBatchThread(void* context, int worker);
+char* batchOutputPath(char* input, char* directory);
+int findSharedOutputs(BatchJob* jobs, int count);
+int compareOutputs(const void* a, const void* b);
+void failJob(BatchJob* job, const char* message);
+
+// Compiles every job, on a number of threads (0: one per core), through a cache
+// if given -- returns how many steals balancing them took
+int compileBatch(BatchJob* jobs, int count, int threads, int optimizeLevel, CompileCache* cache)
+{
+    BatchContext context;
+
+    context.jobs = jobs;
+    context.optimizeLevel = optimizeLevel;
+    context.cache = cache;
+
+    return runPool(count, threads, compileJob, finishBatchThread, &context);
+}
+
+// Reads, compiles and writes out one job (run on a pool worker)
+void compileJob(void* context, int job, int worker)
+{
+    BatchContext* batch = context;
+    BatchJob* j = &batch->jobs[job];
+    Compiler compiler;
+    Source source;
+
+    (void) worker;
+
+    j->failed = 0;
+    j->codeLength = 0;
+
+    if (!loadSource(&source, j->path))
+    {
+        failJob(j, loadFailure());
+        return;
+    }
+
+    j->sourceBytes = source.length;
+
+    initCompiler(&compiler, batch->optimizeLevel);
+
+    if (!compileCached(batch->cache, &compiler, source.text, source.length))
+    {
+        j->failed = 1;
+        j->diagnostic = compiler.diagnostics[0];
+    }
+    else
+    {
+        j->codeLength = compiler.codeLength;
+
+        // Kept in memory without an output path, handed over to the job
+        if (j->output == NULL)
+        {
+            j->code = compiler.code;
+            compiler.code = NULL;
+        }
+        else if (!writeObjectFile(j->output, compiler.code, compiler.codeLength))
+            failJob(j, "Could not write output file");
+    }
+
+    freeCompiler(&compiler);
+    closeSource(&source);
+}
+
+// Releases a worker thread's compiler memory once it runs out of jobs
+void finishBatchThread(void* context, int worker)
+{
+    (void) context;
+    (void) worker;
+
+    freeCompilerThread();
+}
+
+// Returns a new string naming the output of an input file: its name with the
+// extension replaced by BATCH_EXTENSION, in directory if given (else beside it)
+char* batchOutputPath(char* input, char* directory)
+{
+    char* slash = strrchr(input, '/');
+    char* name = (slash != NULL) ? slash + 1 : input;
+    char* dot = strrchr(name, '.');
+    char* start = (directory != NULL) ? name : input;
+    char* path;
+    int stem;
+
+    // Up to the extension (a leading dot is part of the name)
+    stem = (dot != NULL && dot != name) ? (int) (dot - start) : (int) strlen(start);
+
+    path = malloc(((directory != NULL) ? strlen(directory) + 1 : 0) + stem + strlen(BATCH_EXTENSION) + 1);
+
+    if (directory != NULL)
+        sprintf(path, "%s/%.*s%s", directory, stem, start, BATCH_EXTENSION);
+    else
+        sprintf(path, "%.*s%s", stem, start, BATCH_EXTENSION);
+
+    return path;
+}
+
+// Prints every output path that more than one job would write (two inputs named
+// alike in different directories, say, or a.pl0 & a.txt) -- returns how many jobs
+// would overwrite another's output. Paths are compared as written.
+int findSharedOutputs(BatchJob* jobs, int count)
+{
+    BatchJob** sorted = malloc((count + 1) * sizeof(BatchJob*));
+    int i, first = 0, shared = 0;
+
+    for (i = 0; i < count; i++)
+        sorted[i] = &jobs[i];
+
+    qsort(sorted, count, sizeof(BatchJob*), compareOutputs);
+
+    // Alike outputs are now next to each other, the first job to name one first
+    for (i = 1; i < count; i++)
+    {
+        if (sorted[i]->output == NULL || sorted[first]->output == NULL ||
+            strcmp(sorted[i]->output, sorted[first]->output) != 0)
+        {
+            first = i;
+            continue;
+        }
+
+        printf("%s and %s would both write %s\n", sorted[first]->path, sorted[i]->path, sorted[i]->output);
+        shared++;
+    }
+
+    free(sorted);
+
+    return shared;
+}
+
+// Orders jobs by output path (none first), then by their place in the batch
+int compareOutputs(const void* a, const void* b)
+{
+    const BatchJob* first = *(const BatchJob**) a;
+    const BatchJob* second = *(const BatchJob**) b;
+    int order;
+
+    if (first->output == NULL || second->output == NULL)
+        order = (first->output != NULL) - (second->output != NULL);
+    else
+        order = strcmp(first->output, second->output);
+
+    return (order != 0) ? order : (first > second) - (first < second);
+}
+
+// Marks a job failed for a reason outside the compiler itself (a file problem)
+void failJob(BatchJob* job, const char* message)
+{
+    job->failed = 1;
+    job->diagnostic.phase = DIAGNOSTIC_FILE;
+    job->diagnostic.code = 0;
+    job->diagnostic.offset = -1;
+    job->diagnostic.line = 0;
+    job->diagnostic.column = 0;
+    job->diagnostic.message = message;
+}
+
+#endif
@@ -0,0 +1,372 @@
+// COP 3402
+// Benchmark Driver
+//
+// Usage: bench.exe scan [file]       (scanner throughput, per skip kernel)
+//        bench.exe vm [file]         (VM dispatches & run time, superinstructions off vs on)
+//        bench.exe dispatch [file]   (VM instructions/s, fetch / execute loop vs threaded core)
+
+#include <stdio.h>
+#include <time.h>
+
+#include "scan.h"
+#include "parse.h"
+#include "vm.h"
+#include "compiler.h"
+
+#define BENCH_SOURCE_BYTES (8 * 1024 * 1024)
+#define BENCH_MIN_SECONDS 0.5
+
+// PROTOTYPES
+double benchClock();
+void benchScan(char* fileName);
+void makeCommentHeavySource(Source* source, int targetBytes);
+int scanAll(Source* source, int threads, TokenBuffer* buffer);
+double timeScan(Source* source, int threads, TokenBuffer* buffer, int* tokens);
+void benchVM(char* fileName);
+void makeLoopHeavySource(Source* source);
+double timeProgram(Source* source, int superinstructions, int* length);
+void benchDispatch(char* fileName);
+double dispatchRate(Compiler* compiler, int threaded, long long* dispatches);
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "scan") == 0)
+        benchScan((argc > 2) ? argv[2] : NULL);
+    else if (argc > 1 && strcmp(argv[1], "vm") == 0)
+        benchVM((argc > 2) ? argv[2] : NULL);
+    else if (argc > 1 && strcmp(argv[1], "dispatch") == 0)
+        benchDispatch((argc > 2) ? argv[2] : NULL);
+    else
+        printf("usage: bench.exe scan|vm|dispatch [file]\n");
+
+    return 0;
+}
+
+// Returns a monotonic wall clock reading in seconds
+double benchClock()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// Tokenizes a whole source once into buffer, returns the number of tokens read
+int scanAll(Source* source, int threads, TokenBuffer* buffer)
+{
+    int errorOffset;
+
+    buffer->count = 0;
+
+    if (threads > 1)
+        scanParallel(source, threads, buffer, &errorOffset);
+    else
+        scanRange(source, 0, source->length, buffer, &identifiers, &errorOffset);
+
+    return buffer->count;
+}
+
+// Times one scanner configuration, returns its throughput in MB/s
+double timeScan(Source* source, int threads, TokenBuffer* buffer, int* tokens)
+{
+    int runs = 0;
+    double start = benchClock();
+    double elapsed;
+
+    do
+    {
+        *tokens = scanAll(source, threads, buffer);
+        runs++;
+        elapsed = benchClock() - start;
+
+    } while (elapsed < BENCH_MIN_SECONDS);
+
+    return (double) source->length * runs / elapsed / (1024 * 1024);
+}
+
+// Times the scanner over a source with each skip kernel the CPU supports, then
+// with the best kernel split over every core
+void benchScan(char* fileName)
+{
+    int kernels[] = { SKIP_NONE, SKIP_SCALAR, SKIP_SSE2, SKIP_AVX2 };
+    int best = selectSkipKernel();
+    int i, tokens;
+    int threads = 1;
+    double speed, baseline = 0;
+    char label[32];
+    Source source;
+    TokenBuffer buffer = { 0 };
+
+#ifdef HAVE_PTHREADS
+    threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (fileName == NULL)
+        makeCommentHeavySource(&source, BENCH_SOURCE_BYTES);
+    else if (!loadSource(&source, fileName))
+    {
+        printf("Could not read %s\n", fileName);
+        return;
+    }
+
+    printf("Scanning %d bytes (%s)\n", source.length, (fileName) ? fileName : "generated, comment heavy");
+    printf("%-16s%10s%12s%10s\n", "kernel", "tokens", "MB/s", "speedup");
+
+    for (i = 0; i < 4 && kernels[i] <= best; i++)
+    {
+        skipKernel = kernels[i];
+        speed = timeScan(&source, 1, &buffer, &tokens);
+
+        if (i == 0)
+            baseline = speed;
+
+        printf("%-16s%10d%12.1f%9.2fx\n", skipKernelName(kernels[i]), tokens, speed, speed / baseline);
+    }
+
+    if (threads > 1)
+    {
+        skipKernel = best;
+        speed = timeScan(&source, threads, &buffer, &tokens);
+        sprintf(label, "%s x%d", skipKernelName(best), threads);
+
+        printf("%-16s%10d%12.1f%9.2fx\n", label, tokens, speed, speed / baseline);
+    }
+
+    freeTokenBuffer(&buffer);
+    closeSource(&source);
+}
+
+// Builds a PL/0 program that is mostly license header, comments and indentation
+void makeCommentHeavySource(Source* source, int targetBytes)
+{
+    static const char* header =
+        "/*\n"
+        " * Generated program -- licensed under the terms of the accompanying\n"
+        " * license. Redistribution and use in source and binary forms, with or\n"
+        " * without modification, are permitted provided that the conditions in\n"
+        " * the license text are met. THIS SOFTWARE IS PROVIDED AS IS, WITHOUT\n"
+        " * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED.\n"
+        " */\n"
+        "var x, y;\n"
+        "begin\n";
+    static const char* line =
+        "        /* Update the running totals for this step of the loop. */\n"
+        "        x := x + 1;                          /* count the step */\n"
+        "\n"
+        "                y := y * 2 - x;\n";
+    int headerLength = strlen(header);
+    int lineLength = strlen(line);
+    int length = 0;
+
+    source->text = malloc(targetBytes + headerLength + lineLength + 16);
+    source->mapped = 0;
+    source->position = 0;
+
+    memcpy(source->text, header, headerLength);
+    length += headerLength;
+
+    while (length < targetBytes)
+    {
+        memcpy(source->text + length, line, lineLength);
+        length += lineLength;
+    }
+
+    memcpy(source->text + length, "end.\n", 5);
+    source->length = length + 5;
+}
+
+// Compiles a source at -O2 with the superinstructions pass off and then on (every
+// other pass the same), runs each untraced, and compares dispatches and wall time.
+// A file given should not read input.
+void benchVM(char* fileName)
+{
+    int i, length;
+    long long baselineDispatches = 0;
+    double seconds, baseline = 0;
+    Source source;
+
+    if (fileName == NULL)
+        makeLoopHeavySource(&source);
+    else if (!loadSource(&source, fileName))
+    {
+        printf("Could not read %s\n", fileName);
+        return;
+    }
+
+    printf("Running %s at -O2\n", (fileName) ? fileName : "generated, loop heavy");
+    printf("%-20s%8s%14s%10s%10s%10s\n", "superinstructions", "code", "dispatches", "ms", "fewer", "speedup");
+
+    for (i = 0; i < 2; i++)
+    {
+        seconds = timeProgram(&source, i, &length);
+
+        if (i == 0)
+        {
+            baseline = seconds;
+            baselineDispatches = dispatchCount;
+        }
+
+        printf("%-20s%8d%14lld%10.1f%9.1f%%%9.2fx\n", (i) ? "on" : "off", length, dispatchCount, seconds * 1000,
+               100.0 * (baselineDispatches - dispatchCount) / baselineDispatches, baseline / seconds);
+    }
+
+    closeSource(&source);
+}
+
+// Compiles a source at -O2, with or without superinstructions, and runs it once
+// untraced, returns the run's wall time (code length in length, dispatches in
+// dispatchCount)
+double timeProgram(Source* source, int superinstructions, int* length)
+{
+    Pass* pass = findPass("superinstructions");
+    Compiler compiler;
+    double start;
+    int level = pass->level, compiled;
+
+    initCompiler(&compiler, IR_LEVEL);
+
+    if (!superinstructions)
+        pass->level = PASS_OFF;
+
+    compiled = compileSource(&compiler, source->text, source->length);
+    pass->level = level;
+
+    if (!compiled)
+    {
+        printf("Line %d, column %d: %s\n", compiler.diagnostics[0].line, compiler.diagnostics[0].column,
+               compiler.diagnostics[0].message);
+        exit(1);
+    }
+
+    *length = compiler.codeLength;
+
+    start = benchClock();
+
+    if (!runProgram(&compiler, NULL, NULL))
+        printf("Run stopped at %d: %s\n", compiler.diagnostics[0].offset, compiler.diagnostics[0].message);
+
+    freeCompiler(&compiler);
+
+    return benchClock() - start;
+}
+
+// Compiles a source at -O1 (plain PM/0) and at -O2 (superinstructions), then runs
+// each untraced on runCode()'s fetch / execute loop and on the threaded core
+// (threaded.h), comparing instructions dispatched per second. A file given should
+// not read input; what it writes is discarded.
+void benchDispatch(char* fileName)
+{
+    int levels[] = { 1, 2 };
+    int i;
+    long long dispatches;
+    double loop, threaded;
+    Compiler compiler;
+    Source source;
+
+    if (fileName == NULL)
+        makeLoopHeavySource(&source);
+    else if (!loadSource(&source, fileName))
+    {
+        printf("Could not read %s\n", fileName);
+        return;
+    }
+
+#ifdef VM_THREADED
+    printf("Running %s, threaded core on computed goto\n", (fileName) ? fileName : "generated, loop heavy");
+#else
+    printf("Running %s, threaded core on a switch\n", (fileName) ? fileName : "generated, loop heavy");
+#endif
+    printf("%-8s%14s%14s%14s%10s\n", "level", "dispatches", "loop M/s", "threaded M/s", "speedup");
+
+    for (i = 0; i < 2; i++)
+    {
+        initCompiler(&compiler, levels[i]);
+
+        if (!compileSource(&compiler, source.text, source.length))
+        {
+            printf("Line %d, column %d: %s\n", compiler.diagnostics[0].line, compiler.diagnostics[0].column,
+                   compiler.diagnostics[0].message);
+            exit(1);
+        }
+
+        loop = dispatchRate(&compiler, 0, &dispatches);
+        threaded = dispatchRate(&compiler, 1, &dispatches);
+
+        printf("-O%-6d%14lld%14.1f%14.1f%9.2fx\n", levels[i], dispatches, loop / 1e6, threaded / 1e6,
+               threaded / loop);
+
+        freeCompiler(&compiler);
+    }
+
+    closeSource(&source);
+}
+
+// Runs compiled code untraced on the threaded core or on runCode()'s loop, over
+// and over for at least BENCH_MIN_SECONDS -- returns instructions dispatched per
+// second (and the dispatches of one run in dispatches)
+double dispatchRate(Compiler* compiler, int threaded, long long* dispatches)
+{
+    int stackSize = maxStackDepth(compiler->code, compiler->codeLength, 0);
+    long long total = 0;
+    double start, seconds;
+
+    code = compiler->code;
+    linesOfCode = compiler->codeLength;
+    vmOutput = tmpfile();
+    start = benchClock();
+
+    do
+    {
+        if (threaded)
+            runThreaded(0, stackSize);
+        else
+            runCode(NULL, 0, stackSize);
+
+        total += dispatchCount;
+        seconds = benchClock() - start;
+    }
+    while (seconds < BENCH_MIN_SECONDS);
+
+    if (vmOutput != NULL)
+        fclose(vmOutput);
+
+    code = NULL;
+    vmOutput = NULL;
+    *dispatches = dispatchCount;
+
+    return total / seconds;
+}
+
+// Builds a PL/0 program that spends its time in a pair of nested while loops
+void makeLoopHeavySource(Source* source)
+{
+    static const char* text =
+        "var i, j, s, n;\n"
+        "begin\n"
+        "    n := 3000;\n"
+        "    s := 0;\n"
+        "    i := 0;\n"
+        "    while i < n do\n"
+        "    begin\n"
+        "        j := 0;\n"
+        "        while j < 3000 do\n"
+        "        begin\n"
+        "            s := s + j;\n"
+        "            if s > 30000 then s := s - 30000;\n"
+        "            j := j + 1\n"
+        "        end;\n"
+        "        i := i + 1\n"
+        "    end\n"
+        "end.\n";
+    int length = strlen(text);
+
+    source->text = malloc(length + 1);
+    source->mapped = 0;
+    source->position = 0;
+    source->length = length;
+
+    memcpy(source->text, text, length + 1);
+}
@@ -0,0 +1,355 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#define HAVE_DIRENT 1
+#endif
+
+#include "structs.h"
+#include "compiler.h"
+
+// On disk cache of compiles, content addressed: an entry's name is a 64 bit
+// FNV-1a hash of the compiler version, the optimization level and the source
+// bytes, so an unchanged source compiled the same way is found without scanning
+// or parsing it. An entry holds what compileSource() produced -- the code, or
+// the diagnostics of a failed compile (messages are looked up again from their
+// codes). Layout (host byte order):
+//
+//   CacheFileHeader          magic "PMC1", format version, compiler version,
+//                            level, key, source length, code & diagnostic counts
+//   Instruction[codeLength]  the code
+//   int[5][diagnosticCount]  phase, code, offset, line, column of each diagnostic
+//
+// Entries are written to a temporary file and renamed into place, so readers
+// (other threads or processes) see a whole entry or none. A hit touches the
+// entry's modification time, and once the directory grows past its capacity
+// the least recently used entries are deleted until it is back under
+// CACHE_TRIM_PERCENT of it. The size is measured when the cache is opened and
+// kept up to date with this process's own stores (other processes' are picked
+// up at the next trim).
+
+#define CACHE_FILE_MAGIC "PMC1"
+#define CACHE_FILE_VERSION 1
+#define CACHE_EXTENSION ".pmc"
+#define CACHE_DEFAULT_CAPACITY (256LL * 1024 * 1024)
+#define CACHE_TRIM_PERCENT 75
+
+// PROTOTYPES
+void openCache(CompileCache* cache, char* directory, long long capacity);
+int compileCached(CompileCache* cache, Compiler* compiler, const char* text, int length);
+unsigned long long cacheKey(const char* text, int length, int optimizeLevel);
+char* cachePath(CompileCache* cache, unsigned long long key);
+int readCacheEntry(char* fileName, unsigned long long key, Compiler* compiler, int length);
+void writeCacheEntry(CompileCache* cache, unsigned long long key, Compiler* compiler, int length);
+const char* diagnosticMessage(int phase, int code);
+long long trimCache(CompileCache* cache, long long target);
+int compareEntryTimes(const void* a, const void* b);
+
+// Opens (creating if need be) a cache directory holding up to capacity bytes
+// (CACHE_DEFAULT_CAPACITY if not positive)
+void openCache(CompileCache* cache, char* directory, long long capacity)
+{
+    memset(cache, 0, sizeof(CompileCache));
+    cache->directory = directory;
+    cache->capacity = (capacity > 0) ? capacity : CACHE_DEFAULT_CAPACITY;
+
+#ifdef HAVE_DIRENT
+    mkdir(directory, 0777);
+#endif
+
+    // Trimming to no limit just measures it
+    cache->size = trimCache(cache, -1);
+}
+
+// Compiles like compileSource(), reusing a cached result for the same source,
+// level and compiler version when there is one, and caching it otherwise
+int compileCached(CompileCache* cache, Compiler* compiler, const char* text, int length)
+{
+    unsigned long long key;
+    char* path;
+    int compiled;
+
+    if (cache == NULL)
+        return compileSource(compiler, text, length);
+
+    key = cacheKey(text, length, compiler->optimizeLevel);
+    path = cachePath(cache, key);
+
+    if (readCacheEntry(path, key, compiler, length))
+    {
+        __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+#ifdef HAVE_DIRENT
+        utime(path, NULL);
+#endif
+        compiled = compiler->diagnosticCount == 0;
+    }
+    else
+    {
+        __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+        compiled = compileSource(compiler, text, length);
+        writeCacheEntry(cache, key, compiler, length);
+    }
+
+    free(path);
+
+    return compiled;
+}
+
+// Returns the hash naming the entry for a source compiled at a level
+unsigned long long cacheKey(const char* text, int length, int optimizeLevel)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    unsigned int prefix[2];
+    const unsigned char* bytes = (const unsigned char*) prefix;
+    int i;
+
+    prefix[0] = COMPILER_VERSION;
+    prefix[1] = (unsigned int) optimizeLevel;
+
+    for (i = 0; i < (int) sizeof(prefix); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) text[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// Returns a new string naming the entry file for a key
+char* cachePath(CompileCache* cache, unsigned long long key)
+{
+    char* path = malloc(strlen(cache->directory) + 1 + 16 + strlen(CACHE_EXTENSION) + 1);
+
+    sprintf(path, "%s/%016llx%s", cache->directory, key, CACHE_EXTENSION);
+
+    return path;
+}
+
+// Fills compiler's code & diagnostics from a cache entry -- returns 0 (leaving the
+// compiler as it was) if the entry is missing, truncated or for something else
+int readCacheEntry(char* fileName, unsigned long long key, Compiler* compiler, int length)
+{
+    CacheFileHeader header;
+    Diagnostic diagnostic;
+    Instruction* code = NULL;
+    int* fields = NULL;
+    FILE* ifp = fopen(fileName, "rb");
+    int i, ok = 0;
+
+    if (ifp == NULL)
+        return 0;
+
+    if (fread(&header, sizeof(CacheFileHeader), 1, ifp) == 1 &&
+        memcmp(header.magic, CACHE_FILE_MAGIC, 4) == 0 && header.version == CACHE_FILE_VERSION &&
+        header.compilerVersion == COMPILER_VERSION && header.optimizeLevel == compiler->optimizeLevel &&
+        header.key == key && header.sourceLength == length &&
+        header.codeLength >= 0 && header.diagnosticCount >= 0)
+    {
+        code = malloc((header.codeLength + 1) * sizeof(Instruction));
+        fields = malloc((header.diagnosticCount * 5 + 1) * sizeof(int));
+
+        ok = fread(code, sizeof(Instruction), header.codeLength, ifp) == (size_t) header.codeLength &&
+             fread(fields, sizeof(int), header.diagnosticCount * 5, ifp) == (size_t) header.diagnosticCount * 5;
+    }
+
+    fclose(ifp);
+
+    if (ok)
+    {
+        free(compiler->code);
+        compiler->code = code;
+        compiler->codeLength = header.codeLength;
+        compiler->diagnosticCount = 0;
+        code = NULL;
+
+        for (i = 0; i < header.diagnosticCount; i++)
+        {
+            diagnostic.phase = fields[i * 5];
+            diagnostic.code = fields[i * 5 + 1];
+            diagnostic.offset = fields[i * 5 + 2];
+            diagnostic.line = fields[i * 5 + 3];
+            diagnostic.column = fields[i * 5 + 4];
+            diagnostic.message = diagnosticMessage(diagnostic.phase, diagnostic.code);
+            addDiagnostic(compiler, &diagnostic);
+        }
+    }
+
+    free(code);
+    free(fields);
+
+    return ok;
+}
+
+// Stores a compile's result under its key, trimming the cache when it grows past
+// capacity (a store that fails just leaves the entry out)
+void writeCacheEntry(CompileCache* cache, unsigned long long key, Compiler* compiler, int length)
+{
+    CacheFileHeader header;
+    char* path = cachePath(cache, key);
+    char* temporary = malloc(strlen(path) + 32);
+    FILE* ofp;
+    int i, fields[5], ok;
+    long long bytes;
+
+    // Unique to this process & store, so concurrent writers never share one
+    sprintf(temporary, "%s.%d.%u.tmp", path, (int) getpid(), __atomic_add_fetch(&cache->files, 1, __ATOMIC_RELAXED));
+
+    ofp = fopen(temporary, "wb");
+
+    if (ofp == NULL)
+    {
+        free(path);
+        free(temporary);
+        return;
+    }
+
+    memcpy(header.magic, CACHE_FILE_MAGIC, 4);
+    header.version = CACHE_FILE_VERSION;
+    header.compilerVersion = COMPILER_VERSION;
+    header.optimizeLevel = compiler->optimizeLevel;
+    header.key = key;
+    header.sourceLength = length;
+    header.codeLength = compiler->codeLength;
+    header.diagnosticCount = compiler->diagnosticCount;
+
+    fwrite(&header, sizeof(CacheFileHeader), 1, ofp);
+    fwrite(compiler->code, sizeof(Instruction), compiler->codeLength, ofp);
+
+    for (i = 0; i < compiler->diagnosticCount; i++)
+    {
+        fields[0] = compiler->diagnostics[i].phase;
+        fields[1] = compiler->diagnostics[i].code;
+        fields[2] = compiler->diagnostics[i].offset;
+        fields[3] = compiler->diagnostics[i].line;
+        fields[4] = compiler->diagnostics[i].column;
+        fwrite(fields, sizeof(int), 5, ofp);
+    }
+
+    ok = !ferror(ofp);
+    ok = (fclose(ofp) == 0) && ok && rename(temporary, path) == 0;
+
+    if (!ok)
+        remove(temporary);
+
+    free(path);
+    free(temporary);
+
+    if (!ok)
+        return;
+
+    bytes = sizeof(CacheFileHeader) + (long long) compiler->codeLength * sizeof(Instruction) +
+            (long long) compiler->diagnosticCount * 5 * sizeof(int);
+
+    // One thread trims at a time, the others carry on storing (what they store
+    // meanwhile stays counted, the trim only corrects the size by what it found)
+    if (__atomic_add_fetch(&cache->size, bytes, __ATOMIC_RELAXED) > cache->capacity &&
+        !__atomic_exchange_n(&cache->trimming, 1, __ATOMIC_ACQUIRE))
+    {
+        bytes = __atomic_load_n(&cache->size, __ATOMIC_RELAXED);
+        bytes = trimCache(cache, cache->capacity * CACHE_TRIM_PERCENT / 100) - bytes;
+        __atomic_add_fetch(&cache->size, bytes, __ATOMIC_RELAXED);
+        __atomic_store_n(&cache->trimming, 0, __ATOMIC_RELEASE);
+    }
+}
+
+// Returns the message for a diagnostic's code in the phase it came from
+const char* diagnosticMessage(int phase, int code)
+{
+    return (phase == DIAGNOSTIC_SCAN) ? scanErrorMessage(code) : errorMessage(code);
+}
+
+// Deletes the least recently used entries until the cache holds at most target
+// bytes (any amount for a negative target), returns the size left
+long long trimCache(CompileCache* cache, long long target)
+{
+    long long size = 0;
+#ifdef HAVE_DIRENT
+    DIR* directory = opendir(cache->directory);
+    struct dirent* entry;
+    struct stat info;
+    CacheEntry* entries = NULL;
+    int count = 0, capacity = 0, i, length, extension = strlen(CACHE_EXTENSION);
+    char* path;
+
+    if (directory == NULL)
+        return 0;
+
+    path = malloc(strlen(cache->directory) + 256 + 2);
+
+    // Size & last use of every entry
+    while ((entry = readdir(directory)) != NULL)
+    {
+        length = strlen(entry->d_name);
+
+        if (length <= extension || strcmp(entry->d_name + length - extension, CACHE_EXTENSION) != 0)
+            continue;
+
+        sprintf(path, "%s/%s", cache->directory, entry->d_name);
+
+        if (stat(path, &info) != 0)
+            continue;
+
+        if (count == capacity)
+        {
+            capacity = (capacity) ? capacity * 2 : 256;
+            entries = realloc(entries, capacity * sizeof(CacheEntry));
+        }
+
+        entries[count].name = malloc(length + 1);
+        strcpy(entries[count].name, entry->d_name);
+        entries[count].size = info.st_size;
+        entries[count].lastUsed = info.st_mtime;
+        size += info.st_size;
+        count++;
+    }
+
+    closedir(directory);
+
+    if (target >= 0 && size > target)
+    {
+        qsort(entries, count, sizeof(CacheEntry), compareEntryTimes);
+
+        for (i = 0; i < count && size > target; i++)
+        {
+            sprintf(path, "%s/%s", cache->directory, entries[i].name);
+
+            if (remove(path) == 0)
+                size -= entries[i].size;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+        free(entries[i].name);
+
+    free(entries);
+    free(path);
+#endif
+
+    return size;
+}
+
+// Orders entries oldest use first
+int compareEntryTimes(const void* a, const void* b)
+{
+    long long left = ((const CacheEntry*) a)->lastUsed;
+    long long right = ((const CacheEntry*) b)->lastUsed;
+
+    return (left > right) - (left < right);
+}
+
+#endif
@@ -0,0 +1,185 @@
+// COP 3402
+// Regression Driver
+//
+// Usage: check.exe   (or make check)
+//
+// Compiles each regression program through the Compiler API at -O0, -O1 & -O2,
+// runs it with runProgram(), and checks that every level ends the same way: with
+// the run error the program must stop on, or cleanly. Then checks that Compilers
+// sharing a thread keep to their own code, and that batch.exe finds inputs that
+// would write the same output file. Prints one line per check, and exits 1 if any
+// fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "batch.h"
+
+typedef struct
+{
+    const char* name;
+    const char* source;
+    int runError;
+
+} RegressionCase;
+
+// PROTOTYPES
+int checkCase(RegressionCase* test, int level);
+int checkSharedThread();
+int runToText(Compiler* compiler, char* text, int size);
+int checkSharedOutputs(const char* name, char** paths, int count, char* directory, int expected);
+
+// GLOBALS
+// A division whose result no one reads still stops the program when it divides
+// by zero -- dead code elimination at -O2 must keep it
+RegressionCase regressionCases[] =
+{
+    { "unused division by zero",
+      "const c1 = 0; var v3; begin v3 := ((100 / c1) / 16); v3 := 7; write v3 end.",
+      VM_DIVIDE_BY_ZERO },
+    { "unused division by a zero variable",
+      "var a, b; begin a := 0; b := 5 / a; b := 1; write b end.",
+      VM_DIVIDE_BY_ZERO },
+    { "unused division in a loop",
+      "var i, z, t; begin i := 0; z := 0; while i < 3 do begin t := i / z; i := i + 1 end; write i end.",
+      VM_DIVIDE_BY_ZERO },
+    { "unused division by a nonzero constant",
+      "var a, b; begin a := 9; b := a / 3; b := 2; write b end.",
+      VM_RUN_OK },
+};
+
+// Batch inputs, some named alike in different directories or with different
+// extensions
+char* batchInputs[] = { "x/a.pl0", "y/a.pl0", "x/b.pl0", "x/a.txt" };
+char* distinctInputs[] = { "x/a.pl0", "y/b.pl0", "x/c.txt" };
+
+int main()
+{
+    int i, level, failed = 0;
+
+    for (i = 0; i < (int) (sizeof(regressionCases) / sizeof(RegressionCase)); i++)
+    {
+        for (level = 0; level <= 2; level++)
+            failed |= checkCase(&regressionCases[i], level);
+    }
+
+    failed |= checkSharedThread();
+
+    failed |= checkSharedOutputs("same names into one -o directory", batchInputs, 4, "out", 2);
+    failed |= checkSharedOutputs("same names beside their inputs", batchInputs, 4, NULL, 1);
+    failed |= checkSharedOutputs("different names into one -o directory", distinctInputs, 3, "out", 0);
+    freeCompilerThread();
+
+    return failed;
+}
+
+// Compiles & runs a regression program at a level -- returns 1 if it doesn't end
+// as expected
+int checkCase(RegressionCase* test, int level)
+{
+    Compiler compiler;
+    FILE* output = tmpfile();
+    int runError = VM_RUN_OK, failed;
+
+    initCompiler(&compiler, level);
+
+    if (!compileSource(&compiler, test->source, strlen(test->source)))
+    {
+        printf("-O%d  %-40s  FAILED (line %d, column %d: %s)\n", level, test->name,
+               compiler.diagnostics[0].line, compiler.diagnostics[0].column, compiler.diagnostics[0].message);
+        freeCompiler(&compiler);
+        fclose(output);
+        return 1;
+    }
+
+    if (!runProgram(&compiler, NULL, output))
+        runError = compiler.diagnostics[0].code;
+
+    failed = (runError != test->runError);
+
+    printf("-O%d  %-40s  %s (%s)\n", level, test->name, (failed) ? "FAILED" : "ok",
+           (runError == VM_RUN_OK) ? "ran to the end" : runErrorMessage(runError));
+
+    freeCompiler(&compiler);
+    fclose(output);
+
+    return failed;
+}
+
+// Compiles two programs on this thread with a Compiler each, runs them in the
+// other order, then runs the first again after the second Compiler compiles
+// something else -- returns 1 if a run sees anything but its own code
+int checkSharedThread()
+{
+    const char* product = "var x; begin x := 6 * 7; write x end.";
+    const char* sum = "var i, s; begin i := 0; s := 0; while i < 4 do begin i := i + 1; s := s + i end; write s end.";
+    char productOutput[32], sumOutput[32], againOutput[32];
+    Compiler first, second;
+    int failed;
+
+    initCompiler(&first, 2);
+    initCompiler(&second, 0);
+
+    failed = !compileSource(&first, product, strlen(product)) || !compileSource(&second, sum, strlen(sum));
+
+    failed |= !runToText(&second, sumOutput, sizeof(sumOutput));
+    failed |= !runToText(&first, productOutput, sizeof(productOutput));
+
+    failed |= !compileSource(&second, product, strlen(product));
+    failed |= !runToText(&first, againOutput, sizeof(againOutput));
+
+    failed |= strcmp(productOutput, "42\n") != 0 || strcmp(sumOutput, "10\n") != 0 ||
+              strcmp(againOutput, "42\n") != 0;
+
+    printf("     %-40s  %s\n", "two Compilers on one thread", (failed) ? "FAILED" : "ok");
+
+    freeCompiler(&first);
+    freeCompiler(&second);
+
+    return failed;
+}
+
+// Runs a compiled program, leaving what it writes in text (cut to size) -- returns
+// 0 if it stopped on a run error
+int runToText(Compiler* compiler, char* text, int size)
+{
+    FILE* output = tmpfile();
+    int ran, length;
+
+    ran = runProgram(compiler, NULL, output);
+
+    rewind(output);
+    length = fread(text, 1, size - 1, output);
+    text[length] = '\0';
+    fclose(output);
+
+    return ran;
+}
+
+// Names the batch outputs of a list of inputs, as batch.exe does, and checks how
+// many would overwrite another's -- returns 1 if that isn't expected
+int checkSharedOutputs(const char* name, char** paths, int count, char* directory, int expected)
+{
+    BatchJob* jobs = calloc(count, sizeof(BatchJob));
+    int i, shared, failed;
+
+    for (i = 0; i < count; i++)
+    {
+        jobs[i].path = paths[i];
+        jobs[i].output = batchOutputPath(paths[i], directory);
+    }
+
+    shared = findSharedOutputs(jobs, count);
+    failed = (shared != expected);
+
+    printf("     %-40s  %s (%d shared)\n", name, (failed) ? "FAILED" : "ok", shared);
+
+    for (i = 0; i < count; i++)
+        free(jobs[i].output);
+
+    free(jobs);
+
+    return failed;
+}
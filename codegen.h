@@ -0,0 +1,152 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "structs.h"
+#include "ast.h"
+#include "symtab.h"
+#include "pm0_constants.h"
+
+// Code generator, lowers the syntax tree to PM/0 instructions in parseCode.
+// Included by parse.h below its globals; it emits through gen() and fills in the
+// code range of each recorded statement span as it goes.
+
+// PROTOTYPES
+void generateProgram(Node* program);
+void generateBlock(Node* block);
+void generateStatement(Node* statement);
+void generateExpression(Node* expression);
+int levelDifference(Node* node);
+
+// Generates the main block (which returns to end the program)
+void generateProgram(Node* program)
+{
+    codeIndex = 0;
+
+    generateBlock(program);
+}
+
+// Generates a block: a jump over the blocks of its procedures, frame allocation,
+// its statement, then the return
+void generateBlock(Node* block)
+{
+    Node* node;
+    int jump = -1;
+
+    // A procedure's code starts at the jump (or its INC, if it has none)
+    if (block->symbol != NO_SYMBOL)
+        symbols.symbols[block->symbol].stackPointer = codeIndex;
+
+    if (block->child[0] != NULL)
+    {
+        jump = codeIndex;
+        gen(JMP, 0, 0);
+    }
+
+    for (node = block->child[0]; node != NULL; node = node->next)
+        generateBlock(node);
+
+    if (jump >= 0)
+        parseCode[jump].M = codeIndex;
+
+    gen(INC, 0, block->value);
+    generateStatement(block->child[1]);
+    gen(OPR, 0, RET);
+}
+
+// Generates a statement (nothing for an empty one)
+void generateStatement(Node* statement)
+{
+    Node* node;
+    int codeIndex1, codeIndex2;
+
+    if (statement == NULL)
+        return;
+
+    if (statement->span >= 0)
+        spans[statement->span].codeStart = codeIndex;
+
+    switch (statement->kind)
+    {
+        case NODE_ASSIGN:
+            generateExpression(statement->child[0]);
+            gen(STO, levelDifference(statement), symbols.symbols[statement->symbol].stackPointer);
+            break;
+
+        case NODE_BEGIN:
+            for (node = statement->child[0]; node != NULL; node = node->next)
+                generateStatement(node);
+            break;
+
+        case NODE_IF:
+            generateExpression(statement->child[0]);
+            codeIndex1 = codeIndex;
+            gen(JPC, 0, 0);
+            generateStatement(statement->child[1]);
+            parseCode[codeIndex1].M = codeIndex;
+            break;
+
+        case NODE_WHILE:
+            codeIndex1 = codeIndex;
+            generateExpression(statement->child[0]);
+            codeIndex2 = codeIndex;
+            gen(JPC, 0, 0);
+            generateStatement(statement->child[1]);
+            gen(JMP, 0, codeIndex1);
+            parseCode[codeIndex2].M = codeIndex;
+            break;
+
+        case NODE_WRITE:
+            generateExpression(statement->child[0]);
+            gen(OUT, 0, 0);
+            break;
+
+        case NODE_READ:
+            gen(IN, 0, 0);
+            gen(STO, levelDifference(statement), symbols.symbols[statement->symbol].stackPointer);
+            break;
+
+        case NODE_CALL:
+            gen(CAL, levelDifference(statement), symbols.symbols[statement->symbol].stackPointer);
+            break;
+
+        default:
+            break;
+    }
+
+    if (statement->span >= 0)
+        spans[statement->span].codeEnd = codeIndex;
+}
+
+// Generates code leaving an expression's value on top of the stack
+void generateExpression(Node* expression)
+{
+    switch (expression->kind)
+    {
+        case NODE_NUMBER:
+            gen(LIT, 0, expression->value);
+            break;
+
+        case NODE_VARIABLE:
+            gen(LOD, levelDifference(expression), symbols.symbols[expression->symbol].stackPointer);
+            break;
+
+        case NODE_UNARY:
+            generateExpression(expression->child[0]);
+            gen(OPR, 0, expression->op);
+            break;
+
+        case NODE_BINARY:
+            generateExpression(expression->child[0]);
+            generateExpression(expression->child[1]);
+            gen(OPR, 0, expression->op);
+            break;
+    }
+}
+
+// Returns how many static links a node's load or store has to follow
+int levelDifference(Node* node)
+{
+    return node->level - symbols.symbols[node->symbol].level;
+}
+
+#endif
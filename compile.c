@@ -7,20 +7,79 @@
 
 #include "scan.h"
 #include "parse.h"
+#include "incremental.h"
+#include "pipeline.h"
 #include "vm.h"
+#include "cache.h"
+#include "stats.h"
 #include "files.h"
 #include "pl0_constants.h"
 #include "pm0_constants.h"
 
 void printFile(char *fileToPrint);
+int compileThroughCache(char* directory);
 
 int main(int argc, char* argv[])
 {
-    int i;
+    int i, pipelined = 0;
+    char* cacheDirectory = NULL;
+    char* statsFormat = NULL;
     
-    scan();
-    parse();
+    // Options that change how the compile runs (-jN: scan with N threads,
+    // -p: parse while scanning, -O0/-O1/-O2: optimization level, --cache=dir:
+    // reuse the code of an unchanged source, see cache.h, --stats=json: write
+    // phase times, counts & memory use to STATS_FILE, see stats.h)
+    for (i=1; i < argc; i++)
+    {
+        if (strncmp(argv[i],"-j",2) == 0)
+            scanThreads = atoi(argv[i] + 2);
+        else if (strcmp(argv[i],"-l") == 0)
+            dumpLexemes = 1;
+        else if (strcmp(argv[i],"-p") == 0)
+            pipelined = 1;
+        else if (strncmp(argv[i],"-O",2) == 0)
+            optimizeLevel = atoi(argv[i] + 2);
+        else if (strncmp(argv[i],"--cache=",8) == 0)
+            cacheDirectory = argv[i] + 8;
+        else if (strncmp(argv[i],"--stats=",8) == 0)
+            statsFormat = argv[i] + 8;
+    }
+    
+    if (statsFormat != NULL)
+    {
+        if (strcmp(statsFormat,"json") != 0)
+        {
+            printf("Unknown stats format %s (only json is supported)\n", statsFormat);
+            return 1;
+        }
+        
+        startStats(optimizeLevel);
+    }
+    
+    // Through the cache the scanner's outputs (token & lexeme files) are not written
+    if (cacheDirectory != NULL)
+    {
+        beginPhase("compile");
+        
+        if (!compileThroughCache(cacheDirectory))
+            return 1;
+    }
+    else if (pipelined)
+    {
+        beginPhase("scan-parse");
+        scanAndParse();
+    }
+    else
+    {
+        beginPhase("scan");
+        scan();
+        beginPhase("parse");
+        parse();
+    }
+    
+    beginPhase("vm");
     vm();
+    endPhase();
  
     for (i=1; i < argc; i++)
     {
@@ -40,11 +99,60 @@ int main(int argc, char* argv[])
             printf("Assembly Code:\n");
             printFile(CODE_FILE);
         }
+        else if (strcmp(argv[i],"-t") == 0)
+        {
+            printf("Pass Timing:\n");
+            printPassTimes();
+        }
     }
     
     return 0;
 }
 
+// Compiles INPUT_FILE into OBJECT_FILE (& CODE_FILE), or reuses a cached compile of the same
+// source -- returns 0, with the errors printed, if it doesn't compile
+int compileThroughCache(char* directory)
+{
+    CompileCache cache;
+    Compiler compiler;
+    Source source;
+    Diagnostic* d;
+    int i, compiled;
+    
+    if (!loadSource(&source, INPUT_FILE))
+    {
+        printf("%s: %s\n", INPUT_FILE, loadFailure());
+        return 0;
+    }
+    
+    openCache(&cache, directory, CACHE_DEFAULT_CAPACITY);
+    initCompiler(&compiler, optimizeLevel);
+    
+    compiled = compileCached(&cache, &compiler, source.text, source.length);
+    
+    // Printed as the scanner & parser print them
+    for (i = 0; i < compiler.diagnosticCount; i++)
+    {
+        d = &compiler.diagnostics[i];
+        
+        if (d->phase == DIAGNOSTIC_SCAN)
+            printError(d->code, d->line, d->column);
+        else
+            printf("Line %d, column %d: %s\n", d->line, d->column, d->message);
+    }
+    
+    if (compiled)
+    {
+        writeCodeFile(CODE_FILE, compiler.code, compiler.codeLength);
+        writeObjectFile(OBJECT_FILE, compiler.code, compiler.codeLength);
+    }
+    
+    freeCompiler(&compiler);
+    closeSource(&source);
+    
+    return compiled;
+}
+
 void printFile(char *fileToPrint)
 {
     int c;
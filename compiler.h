@@ -0,0 +1,237 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "structs.h"
+#include "intern.h"
+#include "tokens.h"
+#include "symtab.h"
+#include "ast.h"
+#include "scan.h"
+#include "parse.h"
+#include "vm.h"
+
+// Compiler as a library. A Compiler holds one job's options and results:
+// compileSource() turns a PL/0 source buffer into PM/0 code in memory, and a
+// problem comes back as a Diagnostic (phase, error code, offset, line, column,
+// message) rather than being printed before the process exits, as does a
+// runProgram() that overflows its stack or divides by zero. No files are read or
+// written, and nothing ends the process.
+//
+// The working state behind it (tokens, symbols, tree, IR, parseCode, the VM's
+// registers) is kept thread local on purpose, not in the Compiler: the scanner,
+// parser, passes & VM all work on it directly. What that means for callers:
+//   - Any number of threads can each compile & run with their own Compilers at
+//     once.
+//   - One thread can use any number of Compilers, in any order. Each call starts
+//     the working state afresh and leaves its results only in the Compiler it was
+//     given, so no Compiler sees another's state between calls.
+//   - Calls on one thread must not nest (say, from a signal handler), and an
+//     incremental.h edit session must not share a thread with them, since it
+//     keeps its tokens, spans & code in that same state.
+// The memory the working state holds is kept for the thread's next compile until
+// freeCompilerThread().
+
+// Changes whenever the same source may compile to different code (cached
+// compiles from another version are not reused)
+#define COMPILER_VERSION 23
+
+// Diagnostic phases
+#define DIAGNOSTIC_SCAN 0
+#define DIAGNOSTIC_PARSE 1
+#define DIAGNOSTIC_FILE 2
+#define DIAGNOSTIC_RUN 3
+
+// PROTOTYPES
+void initCompiler(Compiler* compiler, int optimizeLevel);
+int compileSource(Compiler* compiler, const char* text, int length);
+void addDiagnostic(Compiler* compiler, Diagnostic* diagnostic);
+int runProgram(Compiler* compiler, FILE* input, FILE* output);
+void freeCompiler(Compiler* compiler);
+void freeCompilerThread();
+int writeCodeFile(char* fileName, Instruction* code, int length);
+
+// Sets up an empty compiler for an optimization level (0, 1 or 2)
+void initCompiler(Compiler* compiler, int optimizeLevel)
+{
+    memset(compiler, 0, sizeof(Compiler));
+    compiler->optimizeLevel = optimizeLevel;
+}
+
+// Compiles length bytes of source text into compiler->code, replacing what the
+// compiler held before. Returns 1 on success, or 0 with the error in diagnostics
+// (and no code). The text is only read, and not after this returns.
+int compileSource(Compiler* compiler, const char* text, int length)
+{
+    jmp_buf recovery;
+    jmp_buf* outer = errorRecovery;
+    Diagnostic diagnostic = { DIAGNOSTIC_SCAN, 0, 0, 0, 0, NULL };
+    int scanned, errorOffset = 0;
+
+    compiler->codeLength = 0;
+    compiler->diagnosticCount = 0;
+
+    tokenSource.text = (char*) text;
+    tokenSource.length = length;
+    tokenSource.position = 0;
+    tokenSource.mapped = 0;
+    tokens.count = 0;
+    freeInternTable(&identifiers);
+
+    recordSpans = 0;
+    refillTokens = NULL;
+    optimizeLevel = compiler->optimizeLevel;
+
+    scanned = scanRange(&tokenSource, 0, length, &tokens, &identifiers, &errorOffset);
+
+    if (scanned != 0)
+    {
+        diagnostic.code = scanned;
+        diagnostic.offset = errorOffset;
+        diagnostic.message = scanErrorMessage(scanned);
+        sourceLocation(&tokenSource, errorOffset, &diagnostic.line, &diagnostic.column);
+        addDiagnostic(compiler, &diagnostic);
+    }
+    else
+    {
+        // A parse error comes back here, filled in, in place of exiting
+        errorRecovery = &recovery;
+
+        if (setjmp(recovery) == 0)
+        {
+            parseTokens();
+
+            compiler->code = realloc(compiler->code, (codeIndex + 1) * sizeof(Instruction));
+            memcpy(compiler->code, parseCode, codeIndex * sizeof(Instruction));
+            compiler->codeLength = codeIndex;
+        }
+        else
+        {
+            errorDiagnostic.phase = DIAGNOSTIC_PARSE;
+            addDiagnostic(compiler, &errorDiagnostic);
+        }
+
+        errorRecovery = outer;
+    }
+
+    // Nothing may point into the caller's text once it is theirs again
+    tokenSource.text = NULL;
+    tokenSource.length = 0;
+
+    return compiler->diagnosticCount == 0;
+}
+
+// Appends a copy of a diagnostic to the compiler's list
+void addDiagnostic(Compiler* compiler, Diagnostic* diagnostic)
+{
+    if (compiler->diagnosticCount == compiler->diagnosticCapacity)
+    {
+        compiler->diagnosticCapacity = (compiler->diagnosticCapacity) ? compiler->diagnosticCapacity * 2 : 4;
+        compiler->diagnostics = realloc(compiler->diagnostics, compiler->diagnosticCapacity * sizeof(Diagnostic));
+    }
+
+    compiler->diagnostics[compiler->diagnosticCount++] = *diagnostic;
+}
+
+// Runs the compiled code untraced (on the threaded core), reading IN values from
+// input and writing OUT values to output (stdin & stdout when NULL). Returns 1, or
+// 0 with a DIAGNOSTIC_RUN in diagnostics if the program overflowed its stack or
+// divided by zero -- its offset is the address of the instruction it stopped at.
+int runProgram(Compiler* compiler, FILE* input, FILE* output)
+{
+    Diagnostic diagnostic = { DIAGNOSTIC_RUN, 0, 0, 0, 0, NULL };
+
+    code = compiler->code;
+    linesOfCode = compiler->codeLength;
+    vmInput = input;
+    vmOutput = output;
+
+    diagnostic.code = runThreaded(0, maxStackDepth(code, linesOfCode, 0));
+
+    code = NULL;
+    vmInput = NULL;
+    vmOutput = NULL;
+
+    if (diagnostic.code == VM_RUN_OK)
+        return 1;
+
+    diagnostic.offset = PC;
+    diagnostic.message = runErrorMessage(diagnostic.code);
+    addDiagnostic(compiler, &diagnostic);
+
+    return 0;
+}
+
+// Releases the compiler's code & diagnostics
+void freeCompiler(Compiler* compiler)
+{
+    free(compiler->code);
+    free(compiler->diagnostics);
+    initCompiler(compiler, compiler->optimizeLevel);
+}
+
+// Writes code's disassembly (as parse() writes mcode.txt) -- returns 0 if the file
+// could not be written
+int writeCodeFile(char* fileName, Instruction* code, int length)
+{
+    FILE* file = fopen(fileName, "w");
+    int written;
+
+    if (file == NULL)
+        return 0;
+
+    writeDisassembly(file, code, length);
+
+    written = !ferror(file);
+
+    return (fclose(file) == 0) && written;
+}
+
+// Releases the working memory the calling thread's compiles have built up (call
+// before a compiling thread exits)
+void freeCompilerThread()
+{
+    freeTokenBuffer(&tokens);
+    freeInternTable(&identifiers);
+    freeSymbolTable(&symbols);
+    arenaFree(&astArena);
+
+    free(parseCode);
+    parseCode = NULL;
+    codeIndex = codeCapacity = 0;
+
+    free(spans);
+    spans = NULL;
+    spanCount = spanCapacity = 0;
+
+    // The IR's functions, arena & per symbol tables (a compile that stopped
+    // part way may have left them built)
+    freeIR();
+    free(irFunctions);
+    irFunctions = NULL;
+    irFunctionCapacity = 0;
+
+    free(inlineCallee);
+    free(inlineCalls);
+    free(inlineSizes);
+    free(inlineActive);
+    inlineCallee = NULL;
+    inlineCalls = inlineSizes = NULL;
+    inlineActive = NULL;
+
+    free(lowerInlined);
+    free(lowerUses);
+    free(lowerUseBlock);
+    free(lowerUser);
+    free(lowerEvaluated);
+    free(lowerEdges);
+    lowerInlined = NULL;
+    lowerUses = lowerUseBlock = lowerUser = lowerEvaluated = lowerEdges = NULL;
+    lowerEdgeCount = lowerEdgeCapacity = 0;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef DEADSTORE_H
+#define DEADSTORE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs.h"
+#include "ir.h"
+
+// IR pass removing stores nothing reads, then everything only they used. A store
+// to a variable in memory is dead when no path from it reaches a load of that
+// variable (or a call, whose procedure may load it) before the next store to it or
+// the end of the function -- after which only the variables of enclosing blocks
+// can still be read. The same liveness, solved backwards over the blocks, settles
+// every store of the function at once. An assignment to a promoted variable is
+// already nothing but a value, dead when no use of it is left: the values that
+// no effect (output, input, memory, a call, a branch or a division that can trap)
+// depends on go last. A division by zero the program would have stopped at still
+// stops it, as it does at -O0 & -O1.
+
+// PROTOTYPES
+int eliminateDeadStores(Node* program);
+int removeDeadStores(IRFunction* fn);
+int scanMemoryBlock(IRFunction* fn, int block, int* memory, int count, char* liveIn, char* live, int removing);
+int removeDeadValues(IRFunction* fn);
+void markValueUsed(int value, char* used, int* pending, int* count);
+
+// Removes the dead stores & values of every function, returns how many went
+int eliminateDeadStores(Node* program)
+{
+    int i, removed = 0;
+
+    (void) program;
+
+    for (i = 0; i < irFunctionCount; i++)
+    {
+        if (irFunctions[i].failed)
+            continue;
+
+        removed += removeDeadStores(&irFunctions[i]);
+        removed += removeDeadValues(&irFunctions[i]);
+    }
+
+    return removed;
+}
+
+// Removes the stores to memory no load can see, returns how many went
+int removeDeadStores(IRFunction* fn)
+{
+    int* memory = malloc((symbols.count + 1) * sizeof(int));
+    int count = 0, i, changed, removed = 0;
+    char* liveIn;
+    char* live;
+    IRValue* value;
+
+    // Number the variables the function keeps in memory
+    memset(memory, -1, (symbols.count + 1) * sizeof(int));
+
+    for (i = 0; i < fn->valueCount; i++)
+    {
+        value = &fn->values[i];
+
+        if (!value->dead && (value->kind == IR_LOAD || value->kind == IR_STORE) && memory[value->symbol] < 0)
+            memory[value->symbol] = count++;
+    }
+
+    if (count == 0)
+    {
+        free(memory);
+        return 0;
+    }
+
+    liveIn = calloc((fn->blockCount + 1) * count, 1);
+    live = malloc(count);
+
+    // Solve what is live on entry to each block, backwards to a fixed point
+    do
+    {
+        changed = 0;
+
+        for (i = fn->blockCount - 1; i >= 0; i--)
+        {
+            if (fn->blocks[i].dead)
+                continue;
+
+            scanMemoryBlock(fn, i, memory, count, liveIn, live, 0);
+
+            if (memcmp(live, &liveIn[i * count], count) != 0)
+            {
+                memcpy(&liveIn[i * count], live, count);
+                changed = 1;
+            }
+        }
+
+    } while (changed);
+
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        if (!fn->blocks[i].dead)
+            removed += scanMemoryBlock(fn, i, memory, count, liveIn, live, 1);
+    }
+
+    if (removed)
+        compactBlocks(fn);
+
+    free(liveIn);
+    free(live);
+    free(memory);
+
+    return removed;
+}
+
+// Walks a block backwards from what is live at its end, leaving what is live on
+// entry in live -- when removing, the stores found dead are marked so (and counted)
+int scanMemoryBlock(IRFunction* fn, int block, int* memory, int count, char* liveIn, char* live, int removing)
+{
+    IRBlock* target = &fn->blocks[block];
+    IRValue* value;
+    int i, j, removed = 0;
+
+    memset(live, 0, count);
+
+    // Only what an enclosing block can read outlives the function
+    if (target->exit == IR_RETURN)
+    {
+        for (i = 0; i < symbols.count; i++)
+        {
+            if (memory[i] >= 0 && symbols.symbols[i].level < fn->node->level)
+                live[memory[i]] = 1;
+        }
+    }
+
+    for (i = 0; i < target->succCount; i++)
+    {
+        for (j = 0; j < count; j++)
+            live[j] |= liveIn[target->succ[i] * count + j];
+    }
+
+    for (i = target->count - 1; i >= 0; i--)
+    {
+        value = &fn->values[target->values[i]];
+
+        if (value->kind == IR_LOAD)
+            live[memory[value->symbol]] = 1;
+        else if (value->kind == IR_CALL)
+            memset(live, 1, count);
+        else if (value->kind == IR_STORE)
+        {
+            if (removing && !live[memory[value->symbol]])
+            {
+                value->dead = 1;
+                removed++;
+            }
+
+            live[memory[value->symbol]] = 0;
+        }
+    }
+
+    return removed;
+}
+
+// Removes the values no effect depends on, returns how many went
+int removeDeadValues(IRFunction* fn)
+{
+    char* used = calloc(fn->valueCount + 1, 1);
+    int* pending = malloc((fn->valueCount + 1) * sizeof(int));
+    int count = 0, i, j, value, removed = 0;
+    IRValue* target;
+
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        if (fn->blocks[i].dead)
+            continue;
+
+        for (j = 0; j < fn->blocks[i].count; j++)
+        {
+            target = &fn->values[fn->blocks[i].values[j]];
+
+            if (hasSideEffect(target) || canTrap(fn, target))
+                markValueUsed(fn->blocks[i].values[j], used, pending, &count);
+        }
+
+        if (fn->blocks[i].exit == IR_BRANCH)
+            markValueUsed(fn->blocks[i].condition, used, pending, &count);
+    }
+
+    // Whatever a used value reads is used
+    while (count > 0)
+    {
+        target = &fn->values[pending[--count]];
+
+        for (j = 0; j < 2; j++)
+        {
+            if (target->operand[j] != NO_VALUE)
+                markValueUsed(target->operand[j], used, pending, &count);
+        }
+
+        if (target->kind == IR_PHI)
+        {
+            for (j = 0; j < fn->blocks[target->block].predCount; j++)
+                markValueUsed(target->phiOperand[j], used, pending, &count);
+        }
+    }
+
+    for (value = 0; value < fn->valueCount; value++)
+    {
+        if (!fn->values[value].dead && !used[value])
+        {
+            fn->values[value].dead = 1;
+            removed++;
+        }
+    }
+
+    if (removed)
+        compactBlocks(fn);
+
+    free(used);
+    free(pending);
+
+    return removed;
+}
+
+// Marks a value used, queueing it the first time
+void markValueUsed(int value, char* used, int* pending, int* count)
+{
+    if (used[value])
+        return;
+
+    used[value] = 1;
+    pending[(*count)++] = value;
+}
+
+#endif
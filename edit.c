@@ -0,0 +1,191 @@
+// COP 3402
+// Incremental Edit Driver
+//
+// Usage: edit.exe ["old=>new" ...]
+//
+// Compiles INPUT_FILE for editing (incremental.h), then makes each edit in turn
+// -- replacing the first occurrence of old in the current text with new -- and
+// checks the code it leaves against a full compile of the edited text, run on a
+// thread of its own so it shares none of the incremental state. An edit leaving
+// a syntax error must fail the full compile too and keep the last good code.
+// With no edits given it makes a few meant for inputGrade2.txt. Exits 1 if any check
+// fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "incremental.h"
+
+// PROTOTYPES
+int makeEdit(char* edit);
+int checkEdit(EditResult* result);
+void* compileReference(void* unused);
+void keepGoodCode();
+const char* editStatusName(int status);
+
+// GLOBALS
+char* defaultEdits[] =
+{
+    "b := 10=>b := 12",
+    "write c=>write  c",
+    "c := c + 3;=>c := c + ;",
+    "c := c + ;=>c := c * 3;",
+    "c := a + b;=>c := a - b;",
+    "write  c=>write c; write b",
+};
+
+Instruction* goodCode = NULL;
+int goodLength = 0;
+
+// The full compile an edit is checked against
+const char* referenceText;
+int referenceLength;
+int referenceCompiled;
+Compiler reference;
+
+int main(int argc, char* argv[])
+{
+    int i, status, failed = 0;
+
+#ifndef HAVE_PTHREADS
+    printf("edit.exe compiles its reference on a second thread, which this platform lacks\n");
+    return 1;
+#endif
+
+    status = startIncremental();
+    printf("%-6s%-14s%10s%10s  %s\n", "edit", "outcome", "relexed", "reparsed", "check");
+    printf("%-6d%-14s%10s%10s  %s\n", 0, editStatusName(status), "-", "-", INPUT_FILE);
+
+    if (status == EDIT_FULL)
+        keepGoodCode();
+
+    if (argc > 1)
+    {
+        for (i = 1; i < argc; i++)
+            failed |= makeEdit(argv[i]);
+    }
+    else
+    {
+        for (i = 0; i < (int) (sizeof(defaultEdits) / sizeof(char*)); i++)
+            failed |= makeEdit(defaultEdits[i]);
+    }
+
+    free(goodCode);
+
+    return failed;
+}
+
+// Makes an "old=>new" edit and checks it -- returns 1 if the check fails
+int makeEdit(char* edit)
+{
+    static int edits = 0;
+    char* arrow = strstr(edit, "=>");
+    char* found = NULL;
+    EditResult result;
+    int failed, i;
+
+    edits++;
+
+    if (arrow != NULL)
+    {
+        // Find old (the text isn't terminated, so compare at each offset)
+        for (i = 0; found == NULL && i + (arrow - edit) <= tokenSource.length; i++)
+        {
+            if (memcmp(tokenSource.text + i, edit, arrow - edit) == 0)
+                found = tokenSource.text + i;
+        }
+    }
+
+    if (found == NULL)
+    {
+        printf("%-6d%-14s%10s%10s  %s\n", edits, "skipped", "-", "-", (arrow) ? "old text not found" : "not old=>new");
+        return 1;
+    }
+
+    result = applyEdit(found - tokenSource.text, arrow - edit, arrow + 2, strlen(arrow + 2));
+    failed = checkEdit(&result);
+
+    printf("%-6d%-14s%10d%10d  %s\n", edits, editStatusName(result.status), result.relexedTokens,
+           result.reparsedTokens, (failed) ? "DIFFERS from full compile" : "matches full compile");
+
+    if (result.status == EDIT_PARSE_ERROR)
+        printf("      line %d, column %d: %s\n", errorDiagnostic.line, errorDiagnostic.column,
+               errorDiagnostic.message);
+
+    return failed;
+}
+
+// Compiles the edited text in full and compares -- returns 1 if the incremental
+// result doesn't match it
+int checkEdit(EditResult* result)
+{
+    int failed;
+#ifdef HAVE_PTHREADS
+    pthread_t thread;
+
+    referenceText = tokenSource.text;
+    referenceLength = tokenSource.length;
+
+    pthread_create(&thread, NULL, compileReference, NULL);
+    pthread_join(thread, NULL);
+#endif
+
+    if (result->status == EDIT_SCAN_ERROR || result->status == EDIT_PARSE_ERROR)
+    {
+        // Both fail, and the last good code is kept
+        failed = referenceCompiled || codeIndex != goodLength ||
+                 memcmp(parseCode, goodCode, goodLength * sizeof(Instruction)) != 0;
+    }
+    else
+    {
+        failed = !referenceCompiled || codeIndex != reference.codeLength ||
+                 memcmp(parseCode, reference.code, codeIndex * sizeof(Instruction)) != 0;
+
+        keepGoodCode();
+    }
+
+    freeCompiler(&reference);
+
+    return failed;
+}
+
+// Compiles referenceText at -O0, as the incremental front end does (runs on its
+// own thread, so its working state is separate)
+void* compileReference(void* unused)
+{
+    (void) unused;
+
+    initCompiler(&reference, 0);
+    referenceCompiled = compileSource(&reference, referenceText, referenceLength);
+    freeCompilerThread();
+
+    return NULL;
+}
+
+// Copies the incremental code, the code a failed edit must leave alone
+void keepGoodCode()
+{
+    goodCode = realloc(goodCode, (codeIndex + 1) * sizeof(Instruction));
+    memcpy(goodCode, parseCode, codeIndex * sizeof(Instruction));
+    goodLength = codeIndex;
+}
+
+// Returns the name of an edit outcome
+const char* editStatusName(int status)
+{
+    switch (status)
+    {
+        case EDIT_UNCHANGED:
+            return "unchanged";
+        case EDIT_STATEMENT:
+            return "statement";
+        case EDIT_FULL:
+            return "full";
+        case EDIT_SCAN_ERROR:
+            return "scan error";
+        default:
+            return "parse error";
+    }
+}
@@ -2,10 +2,12 @@
 #define FILES_H
 
 #define INPUT_FILE "inputGrade2.txt"
-#define CLEAN_FILE "cleaninput.txt"
 #define TABLE_FILE "lexemetable.txt"
 #define LIST_FILE  "lexemelist.txt"
+#define TOKEN_FILE "tokenstream.bin"
 #define CODE_FILE "mcode.txt"
+#define OBJECT_FILE "mcode.pm0"
 #define STACKTRACE_FILE "stacktrace.txt"
+#define STATS_FILE "stats.json"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,200 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <limits.h>
+
+#include "structs.h"
+#include "ast.h"
+#include "pm0_constants.h"
+
+// Tree pass that evaluates operators whose operands are all numbers (literals or
+// named constants) at compile time, odd & the relational operators included, the
+// way the VM would: wrapping 32 bit arithmetic, truncating division, 1 / 0 truth
+// values. A division by zero is left for the VM to hit at run time. Conditions that
+// fold to a number settle their statement: an if runs its then part or nothing,
+// and a while that never runs its body is dropped.
+
+// PROTOTYPES
+int foldConstants(Node* program);
+int foldBlock(Node* block);
+Node* foldStatement(Node* statement, int* folded);
+Node* foldExpression(Node* expression, int* folded);
+int evaluateOperator(int op, int left, int right, int* value);
+
+// Folds every block in the program, returns how many nodes were folded away
+int foldConstants(Node* program)
+{
+    return foldBlock(program);
+}
+
+// Folds a block and the blocks of its procedures
+int foldBlock(Node* block)
+{
+    int folded = 0;
+    Node* procedure;
+
+    for (procedure = block->child[0]; procedure != NULL; procedure = procedure->next)
+        folded += foldBlock(procedure);
+
+    block->child[1] = foldStatement(block->child[1], &folded);
+
+    return folded;
+}
+
+// Folds the expressions in a statement, returns what should take its place (NULL
+// when a constant condition means it never does anything)
+Node* foldStatement(Node* statement, int* folded)
+{
+    Node** next;
+    Node* replacement;
+
+    if (statement == NULL)
+        return NULL;
+
+    switch (statement->kind)
+    {
+        case NODE_ASSIGN:
+        case NODE_WRITE:
+            statement->child[0] = foldExpression(statement->child[0], folded);
+            break;
+
+        case NODE_BEGIN:
+            for (next = &statement->child[0]; *next != NULL; )
+            {
+                replacement = foldStatement(*next, folded);
+
+                // Splice the replacement (or nothing) in where the statement was
+                if (replacement == NULL)
+                    *next = (*next)->next;
+                else
+                {
+                    replacement->next = (*next)->next;
+                    *next = replacement;
+                    next = &replacement->next;
+                }
+            }
+            break;
+
+        case NODE_IF:
+            statement->child[0] = foldExpression(statement->child[0], folded);
+            statement->child[1] = foldStatement(statement->child[1], folded);
+
+            if (statement->child[0]->kind == NODE_NUMBER)
+            {
+                (*folded)++;
+                return (statement->child[0]->value) ? statement->child[1] : NULL;
+            }
+            break;
+
+        case NODE_WHILE:
+            statement->child[0] = foldExpression(statement->child[0], folded);
+            statement->child[1] = foldStatement(statement->child[1], folded);
+
+            if (statement->child[0]->kind == NODE_NUMBER && statement->child[0]->value == 0)
+            {
+                (*folded)++;
+                return NULL;
+            }
+            break;
+    }
+
+    return statement;
+}
+
+// Folds an expression bottom up, returns the node that replaces it
+Node* foldExpression(Node* expression, int* folded)
+{
+    Node* left;
+    Node* right;
+    int value;
+
+    if (expression->kind != NODE_UNARY && expression->kind != NODE_BINARY)
+        return expression;
+
+    left = expression->child[0] = foldExpression(expression->child[0], folded);
+    right = NULL;
+
+    if (expression->kind == NODE_BINARY)
+        right = expression->child[1] = foldExpression(expression->child[1], folded);
+
+    if (left->kind != NODE_NUMBER || (right != NULL && right->kind != NODE_NUMBER))
+        return expression;
+
+    if (!evaluateOperator(expression->op, left->value, (right) ? right->value : 0, &value))
+        return expression;
+
+    // Reuse the left operand as the result
+    left->value = value;
+    (*folded)++;
+
+    return left;
+}
+
+// Applies an OPR operator to constant operands as executeOPR() would, returns 0
+// if it can't be evaluated at compile time
+int evaluateOperator(int op, int left, int right, int* value)
+{
+    switch (op)
+    {
+        case NEG:
+            *value = (int) (0u - (unsigned int) left);
+            return 1;
+        case ODD:
+            *value = (left % 2 == 0) ? 0 : 1;
+            return 1;
+        case ADD:
+            *value = (int) ((unsigned int) left + (unsigned int) right);
+            return 1;
+        case SUB:
+            *value = (int) ((unsigned int) left - (unsigned int) right);
+            return 1;
+        case MUL:
+            *value = (int) ((unsigned int) left * (unsigned int) right);
+            return 1;
+        case DIV:
+            if (right == 0 || (left == INT_MIN && right == -1))
+                return 0;
+            *value = left / right;
+            return 1;
+        case MOD:
+            if (right == 0 || (left == INT_MIN && right == -1))
+                return 0;
+            *value = left % right;
+            return 1;
+        case EQL:
+            *value = left == right;
+            return 1;
+        case NEQ:
+            *value = left != right;
+            return 1;
+        case LSS:
+            *value = left < right;
+            return 1;
+        case LEQ:
+            *value = left <= right;
+            return 1;
+        case GTR:
+            *value = left > right;
+            return 1;
+        case GEQ:
+            *value = left >= right;
+            return 1;
+        case SHL:
+            if (right < 0 || right > 31)
+                return 0;
+            *value = (int) ((unsigned int) left << right);
+            return 1;
+        case SHR:
+            if (right < 0 || right > 31)
+                return 0;
+            *value = (left + ((left >> 31) & (int) ((1u << right) - 1))) >> right;
+            return 1;
+        case AND:
+            *value = left & right;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+#endif
@@ -0,0 +1,475 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "structs.h"
+#include "scan.h"
+#include "parse.h"
+
+// Incremental front end for editors. After startIncremental() compiles INPUT_FILE
+// with statement spans recorded, each applyEdit() call patches the source text,
+// re-lexes only from the last token before the edit until the new tokens line up
+// with the old ones again, and re-parses only the innermost statement around the
+// changed tokens. Code after that statement is moved rather than regenerated,
+// with jump targets past it shifted by the change in length. An edit that leaves
+// a syntax error (say, a statement half typed) doesn't end the process: the
+// error is left in errorDiagnostic, the code & spans stay those of the last
+// good compile, and the next edit parses everything again.
+
+// Edit outcomes (EditResult.status)
+#define EDIT_UNCHANGED 0
+#define EDIT_STATEMENT 1
+#define EDIT_FULL 2
+#define EDIT_SCAN_ERROR 3
+#define EDIT_PARSE_ERROR 4
+
+// PROTOTYPES
+int startIncremental();
+EditResult applyEdit(int offset, int removed, const char* inserted, int insertedLength);
+int guardedReparseEdit(EditResult* result, int first, int resync, int tokenDelta, int* chain);
+void reparseEdit(EditResult* result, int first, int resync, int tokenDelta, int* chain);
+int relex(Source* source, int first, int* resync, int delta, int damageEnd, TokenBuffer* fresh);
+void spliceTokens(int first, int resync, int delta, TokenBuffer* fresh);
+int reparseSpan(int span, int tokenDelta);
+void relocateJumps(int begin, int end, int oldEnd, int codeDelta);
+void relocateProcedures(int oldEnd, int codeDelta);
+void replaceSpans(int span, int firstNew, int tokenDelta, int codeDelta);
+int firstTokenEndingAt(TokenBuffer* buffer, int position);
+int firstTokenStartingAt(TokenBuffer* buffer, int position);
+
+// GLOBALS
+THREAD_LOCAL int incrementalReady = 0;
+
+// Compiles INPUT_FILE (scan & parse) keeping what later edits need -- returns
+// EDIT_FULL, or EDIT_SCAN_ERROR / EDIT_PARSE_ERROR (then the first edit
+// without errors compiles it all)
+int startIncremental()
+{
+    jmp_buf recovery;
+    jmp_buf* outer = errorRecovery;
+    int status = EDIT_SCAN_ERROR;
+
+    recordSpans = 1;
+    incrementalReady = 0;
+
+    scan();
+
+    if (!scanError)
+    {
+        errorRecovery = &recovery;
+
+        if (setjmp(recovery) == 0)
+        {
+            parseTokens();
+            incrementalReady = 1;
+            status = EDIT_FULL;
+        }
+        else
+        {
+            spanCount = 0;
+            status = EDIT_PARSE_ERROR;
+        }
+
+        errorRecovery = outer;
+    }
+
+    return status;
+}
+
+// Replaces removed bytes at offset with inserted text, then brings the token
+// buffer and parseCode up to date with as little re-lexing and re-parsing as it can
+EditResult applyEdit(int offset, int removed, const char* inserted, int insertedLength)
+{
+    EditResult result = { EDIT_FULL, 0, 0 };
+    TokenBuffer fresh = { 0 };
+    Source edited = { 0 };
+    StatementSpan* savedSpans;
+    int first, resync, tokenDelta, delta;
+    int savedCount = spanCount;
+    int* chain;
+
+    // Keep the edit inside the text
+    if (offset > tokenSource.length)
+        offset = tokenSource.length;
+
+    if (removed > tokenSource.length - offset)
+        removed = tokenSource.length - offset;
+
+    delta = insertedLength - removed;
+
+    // Build the edited text
+    edited.length = tokenSource.length + delta;
+    edited.text = malloc(edited.length + 1);
+    memcpy(edited.text, tokenSource.text, offset);
+    memcpy(edited.text + offset, inserted, insertedLength);
+    memcpy(edited.text + offset + insertedLength, tokenSource.text + offset + removed,
+           tokenSource.length - offset - removed);
+
+    // Re-lex from the end of the last token that ends before the edit
+    first = firstTokenEndingAt(&tokens, offset);
+    result.relexedTokens = relex(&edited, first, &resync, delta, offset + removed, &fresh);
+
+    spliceTokens(first, resync, delta, &fresh);
+    tokenDelta = fresh.count - (resync - first);
+    freeTokenBuffer(&fresh);
+
+    closeSource(&tokenSource);
+    tokenSource = edited;
+
+    if (scanError)
+    {
+        incrementalReady = 0;
+        result.status = EDIT_SCAN_ERROR;
+        return result;
+    }
+
+    // Only whitespace or comments changed
+    if (incrementalReady && result.relexedTokens == 0 && resync == first)
+    {
+        result.status = EDIT_UNCHANGED;
+        return result;
+    }
+
+    // A syntax error in the whole program comes back here in place of exiting.
+    // Parsing fails before any code is generated, so only the spans it was
+    // recording need putting back.
+    chain = malloc((spanCount + 1) * sizeof(int));
+    savedSpans = malloc((spanCount + 1) * sizeof(StatementSpan));
+    memcpy(savedSpans, spans, spanCount * sizeof(StatementSpan));
+
+    if (!guardedReparseEdit(&result, first, resync, tokenDelta, chain))
+    {
+        memcpy(spans, savedSpans, savedCount * sizeof(StatementSpan));
+        spanCount = savedCount;
+
+        // The spans no longer match the edited tokens
+        incrementalReady = 0;
+        result.status = EDIT_PARSE_ERROR;
+        result.reparsedTokens = 0;
+    }
+
+    free(savedSpans);
+    free(chain);
+
+    return result;
+}
+
+// Runs reparseEdit() with errorRecovery installed -- returns 0 if the edited
+// program has a syntax error. It sits apart from applyEdit() so that no local
+// changed between the setjmp and a longjmp back to it is read afterwards.
+int guardedReparseEdit(EditResult* result, int first, int resync, int tokenDelta, int* chain)
+{
+    jmp_buf recovery;
+    jmp_buf* outer = errorRecovery;
+
+    errorRecovery = &recovery;
+
+    if (setjmp(recovery) != 0)
+    {
+        errorRecovery = outer;
+        return 0;
+    }
+
+    reparseEdit(result, first, resync, tokenDelta, chain);
+    errorRecovery = outer;
+
+    return 1;
+}
+
+// Re-parses what an edit changed: the innermost statement holding the old damaged
+// tokens [first, resync) that still parses to the same end, or else everything.
+// chain has room for an index per span.
+void reparseEdit(EditResult* result, int first, int resync, int tokenDelta, int* chain)
+{
+    int candidates = 0, i;
+
+    // Statements holding the damaged tokens, outermost first
+    if (incrementalReady)
+    {
+        for (i = 0; i < spanCount; i++)
+        {
+            if (spans[i].tokenStart <= first && resync <= spans[i].tokenEnd &&
+                spans[i].codeStart < spans[i].codeEnd)
+                chain[candidates++] = i;
+        }
+
+        // Innermost first -- a statement that no longer ends where it should
+        // hands the job to the one around it
+        for (i = candidates - 1; i >= 0; i--)
+        {
+            result->reparsedTokens = reparseSpan(chain[i], tokenDelta);
+
+            if (result->reparsedTokens >= 0)
+            {
+                result->status = EDIT_STATEMENT;
+                return;
+            }
+        }
+    }
+
+    // Nothing smaller would do, parse everything again
+    parseTokens();
+    incrementalReady = 1;
+    result->status = EDIT_FULL;
+    result->reparsedTokens = tokens.count;
+}
+
+// Lexes the edited source from the end of token first-1 until a new token starts
+// where an old token past the edit (damageEnd) starts once shifted by delta -- from
+// there on, same text & same starting state mean the old tokens still hold. Sets
+// resync to that old token (or past the last token) and returns how many new
+// tokens went into fresh.
+int relex(Source* source, int first, int* resync, int delta, int damageEnd, TokenBuffer* fresh)
+{
+    Source range = *source;
+    Token token;
+    int old = firstTokenStartingAt(&tokens, damageEnd);
+    int position, line, column;
+
+    range.position = (first > 0) ? tokens.offset[first - 1] + tokens.length[first - 1] : 0;
+
+    while (1)
+    {
+        getNextToken(&range, &token);
+
+        if (token.endOfFile == EOF || token.error)
+            break;
+
+        position = token.value - source->text;
+
+        while (old < tokens.count && (int) tokens.offset[old] + delta < position)
+            old++;
+
+        // Back in step with the old tokens
+        if (old < tokens.count && (int) tokens.offset[old] + delta == position)
+        {
+            *resync = old;
+
+            if (scanError)
+                scanErrorOffset += delta;
+
+            return fresh->count;
+        }
+
+        appendToken(fresh, token.id, position, token.length,
+                    (token.id == IDENT_SYM) ? intern(&identifiers, token.value, token.length) : token.number);
+    }
+
+    // Ran to the end (or an error) without meeting the old tokens again
+    *resync = tokens.count;
+    scanError = token.error;
+    scanErrorOffset = (token.error) ? (int) (token.value - source->text) : 0;
+
+    if (scanError)
+    {
+        sourceLocation(source, scanErrorOffset, &line, &column);
+        printError(scanError, line, column);
+    }
+
+    return fresh->count;
+}
+
+// Replaces old tokens [first, resync) with the fresh ones, shifting later offsets by delta
+void spliceTokens(int first, int resync, int delta, TokenBuffer* fresh)
+{
+    int tail = tokens.count - resync;
+    int count = first + fresh->count + tail;
+    int i;
+
+    if (count > tokens.capacity)
+        growTokenBuffer(&tokens, count);
+
+    memmove(tokens.kind + first + fresh->count, tokens.kind + resync, tail * sizeof(unsigned char));
+    memmove(tokens.offset + first + fresh->count, tokens.offset + resync, tail * sizeof(unsigned int));
+    memmove(tokens.length + first + fresh->count, tokens.length + resync, tail * sizeof(unsigned int));
+    memmove(tokens.value + first + fresh->count, tokens.value + resync, tail * sizeof(int));
+
+    memcpy(tokens.kind + first, fresh->kind, fresh->count * sizeof(unsigned char));
+    memcpy(tokens.offset + first, fresh->offset, fresh->count * sizeof(unsigned int));
+    memcpy(tokens.length + first, fresh->length, fresh->count * sizeof(unsigned int));
+    memcpy(tokens.value + first, fresh->value, fresh->count * sizeof(int));
+
+    for (i = first + fresh->count; i < count; i++)
+        tokens.offset[i] += delta;
+
+    tokens.count = count;
+}
+
+// Re-parses the statement of a span and regenerates its code in place. Returns the
+// number of tokens parsed, or -1 (leaving code & spans untouched) if the statement
+// no longer parses or no longer ends on the token that used to follow it.
+int reparseSpan(int span, int tokenDelta)
+{
+    StatementSpan old = spans[span];
+    int oldCount = codeIndex;
+    int firstNew = spanCount;
+    int tailLength = oldCount - old.codeEnd;
+    int codeDelta, symbolCount, parsed;
+    jmp_buf recovery;
+    jmp_buf* outer = errorRecovery;
+    Instruction* saved;
+    Node* node = NULL;
+
+    tokenIndex = old.tokenStart;
+    getToken();
+    
+    // Parse it with the names it saw the first time (later declarations are
+    // set aside, so its spans record the same symbol count as before)
+    restoreScope(&symbols, old.scope, old.symbolEnd);
+    symbolCount = symbols.count;
+    symbols.count = old.symbolEnd;
+
+    // A syntax error here may only mean the edit changed where statements
+    // end, which a statement around this one can still make sense of
+    errorRecovery = &recovery;
+
+    if (setjmp(recovery) == 0)
+    {
+        node = statement();
+        parsed = 1;
+    }
+    else
+        parsed = 0;
+
+    errorRecovery = outer;
+    symbols.count = symbolCount;
+
+    if (!parsed || currentToken != old.tokenEnd + tokenDelta)
+    {
+        spanCount = firstNew;
+        return -1;
+    }
+
+    // Generate it in place, then move the code that followed it up behind
+    saved = malloc((tailLength + 1) * sizeof(Instruction));
+    memcpy(saved, parseCode + old.codeEnd, tailLength * sizeof(Instruction));
+
+    codeIndex = old.codeStart;
+    generateStatement(node);
+    codeDelta = codeIndex - old.codeEnd;
+
+    reserveCode(codeIndex + tailLength);
+
+    memcpy(parseCode + codeIndex, saved, tailLength * sizeof(Instruction));
+    free(saved);
+
+    relocateJumps(0, old.codeStart, old.codeEnd, codeDelta);
+    relocateJumps(codeIndex, codeIndex + tailLength, old.codeEnd, codeDelta);
+    relocateProcedures(old.codeEnd, codeDelta);
+
+    replaceSpans(span, firstNew, tokenDelta, codeDelta);
+    codeIndex += tailLength;
+
+    return currentToken - old.tokenStart;
+}
+
+// Shifts jump targets in parseCode[begin, end) at or past oldEnd by codeDelta
+void relocateJumps(int begin, int end, int oldEnd, int codeDelta)
+{
+    int i;
+
+    for (i = begin; i < end; i++)
+    {
+        if ((parseCode[i].OP == JMP || parseCode[i].OP == JPC || parseCode[i].OP == CAL) &&
+            parseCode[i].M >= oldEnd)
+            parseCode[i].M += codeDelta;
+    }
+}
+
+// Shifts the code address of procedures starting at or past oldEnd by codeDelta
+void relocateProcedures(int oldEnd, int codeDelta)
+{
+    int i;
+
+    for (i = 0; i < symbols.count; i++)
+    {
+        if (symbols.symbols[i].id == PROC_SYM && symbols.symbols[i].stackPointer >= oldEnd)
+            symbols.symbols[i].stackPointer += codeDelta;
+    }
+}
+
+// Swaps a re-parsed span and the spans inside it for the ones recorded from
+// firstNew on, stretching the spans around it and shifting the spans after it
+void replaceSpans(int span, int firstNew, int tokenDelta, int codeDelta)
+{
+    StatementSpan old = spans[span];
+    int newSpans = spanCount - firstNew;
+    int after = span + 1;
+    int count, i;
+    StatementSpan* rebuilt;
+
+    while (after < firstNew && spans[after].tokenStart < old.tokenEnd)
+        after++;
+
+    count = span + newSpans + (firstNew - after);
+    rebuilt = malloc((count + 1) * sizeof(StatementSpan));
+
+    // Spans before it either enclose it or end before it
+    for (i = 0; i < span; i++)
+    {
+        rebuilt[i] = spans[i];
+
+        if (spans[i].tokenEnd >= old.tokenEnd)
+        {
+            rebuilt[i].tokenEnd += tokenDelta;
+            rebuilt[i].codeEnd += codeDelta;
+        }
+    }
+
+    memcpy(rebuilt + span, spans + firstNew, newSpans * sizeof(StatementSpan));
+
+    for (i = after; i < firstNew; i++)
+    {
+        rebuilt[span + newSpans + i - after] = spans[i];
+        rebuilt[span + newSpans + i - after].tokenStart += tokenDelta;
+        rebuilt[span + newSpans + i - after].tokenEnd += tokenDelta;
+        rebuilt[span + newSpans + i - after].codeStart += codeDelta;
+        rebuilt[span + newSpans + i - after].codeEnd += codeDelta;
+    }
+
+    free(spans);
+    spans = rebuilt;
+    spanCount = count;
+    spanCapacity = count + 1;
+}
+
+// Returns the first token ending (offset + length) at or after position
+int firstTokenEndingAt(TokenBuffer* buffer, int position)
+{
+    int low = 0, high = buffer->count, middle;
+
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+
+        if ((int) (buffer->offset[middle] + buffer->length[middle]) < position)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+// Returns the first token starting at or after position
+int firstTokenStartingAt(TokenBuffer* buffer, int position)
+{
+    int low = 0, high = buffer->count, middle;
+
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+
+        if ((int) buffer->offset[middle] < position)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+#endif
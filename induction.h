@@ -0,0 +1,221 @@
+#ifndef INDUCTION_H
+#define INDUCTION_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs.h"
+#include "ir.h"
+#include "fold.h"
+#include "licm.h"
+#include "pm0_constants.h"
+
+// IR pass strength-reducing the multiplications of a while loop's induction
+// variables. A variable is one when its phi in the loop header is, on the back
+// edge, itself plus or minus a constant step. Then i * f, for f a constant or
+// something computed before the loop (or i shifted left by a constant), keeps
+// in step with a phi of its own: it starts as the value i enters the loop with
+// times f, and has step * f added wherever i has its step added. The multiply
+// in the loop becomes an add, and the starting product is computed once, in the
+// block that enters the loop.
+
+// PROTOTYPES
+int reduceInductions(Node* program);
+int reduceLoop(IRFunction* fn, IRLoop* loop);
+int inductionStep(IRFunction* fn, int phi, int latch, int* step);
+int reduceMultiply(IRFunction* fn, IRLoop* loop, int multiply, int entry, int latch);
+int foldedValue(IRFunction* fn, int block, int op, int left, int right);
+int constantValue(IRFunction* fn, int block, int constant);
+void placeAfter(IRFunction* fn, int value, int after);
+
+// Reduces in every loop of every function, returns how many multiplications went
+int reduceInductions(Node* program)
+{
+    int i, j, reduced = 0;
+
+    (void) program;
+
+    for (i = 0; i < irFunctionCount; i++)
+    {
+        if (irFunctions[i].failed)
+            continue;
+
+        for (j = irFunctions[i].loopCount - 1; j >= 0; j--)
+            reduced += reduceLoop(&irFunctions[i], &irFunctions[i].loops[j]);
+    }
+
+    return reduced;
+}
+
+// Replaces the multiplications of a loop's induction variables with phis of
+// their own, returns how many were replaced
+int reduceLoop(IRFunction* fn, IRLoop* loop)
+{
+    IRBlock* header = &fn->blocks[loop->header];
+    int* candidates;
+    int i, j, entry, count = 0, reduced = 0;
+
+    if (header->dead || fn->blocks[loop->preheader].dead || header->predCount != 2)
+        return 0;
+
+    // One edge in from the preheader, one back from the loop
+    entry = (header->preds[0] == loop->preheader) ? 0 : 1;
+
+    if (header->preds[entry] != loop->preheader || !inLoop(loop, header->preds[1 - entry]))
+        return 0;
+
+    // Gathered first, since reducing adds values to the loop's blocks
+    candidates = malloc((fn->valueCount + 1) * sizeof(int));
+
+    for (i = loop->header; i <= loop->last; i++)
+    {
+        for (j = 0; j < fn->blocks[i].count; j++)
+        {
+            if (fn->values[fn->blocks[i].values[j]].kind == IR_BINARY &&
+                (fn->values[fn->blocks[i].values[j]].op == MUL || fn->values[fn->blocks[i].values[j]].op == SHL))
+                candidates[count++] = fn->blocks[i].values[j];
+        }
+    }
+
+    for (i = 0; i < count; i++)
+        reduced += reduceMultiply(fn, loop, candidates[i], entry, 1 - entry);
+
+    if (reduced)
+    {
+        forwardValues(fn);
+        compactBlocks(fn);
+    }
+
+    free(candidates);
+
+    return reduced;
+}
+
+// Returns whether a header phi is an induction variable, leaving what the back
+// edge adds to it in step
+int inductionStep(IRFunction* fn, int phi, int latch, int* step)
+{
+    IRValue* update;
+
+    if (fn->values[phi].kind != IR_PHI)
+        return 0;
+
+    update = &fn->values[resolveValue(fn, fn->values[phi].phiOperand[latch])];
+
+    if (update->kind != IR_BINARY || (update->op != ADD && update->op != SUB))
+        return 0;
+
+    if (update->operand[0] == phi && fn->values[update->operand[1]].kind == IR_CONST)
+        *step = fn->values[update->operand[1]].value;
+    else if (update->op == ADD && update->operand[1] == phi && fn->values[update->operand[0]].kind == IR_CONST)
+        *step = fn->values[update->operand[0]].value;
+    else
+        return 0;
+
+    if (update->op == SUB)
+        *step = (int) (0u - (unsigned int) *step);
+
+    return 1;
+}
+
+// Replaces a multiplication of an induction variable (by a factor fixed in the
+// loop) with a phi of its own, returns 1 if it could
+int reduceMultiply(IRFunction* fn, IRLoop* loop, int multiply, int entry, int latch)
+{
+    IRValue* target = &fn->values[multiply];
+    int op = target->op, phi, factor, step, start, increment, product, next, update;
+
+    // The induction variable on the left, what it is multiplied by on the right
+    phi = target->operand[0];
+    factor = target->operand[1];
+
+    if (op == MUL && !inductionStep(fn, phi, latch, &step))
+    {
+        phi = target->operand[1];
+        factor = target->operand[0];
+    }
+
+    if (fn->values[phi].block != loop->header || !inductionStep(fn, phi, latch, &step))
+        return 0;
+
+    if (fn->values[factor].kind != IR_CONST && (op == SHL || inLoop(loop, fn->values[factor].block)))
+        return 0;
+
+    // What the product starts as, and adds each time round, computed before the
+    // loop (adding values moves fn->values, so target is stale from here on)
+    start = foldedValue(fn, loop->preheader, op, fn->values[phi].phiOperand[entry], factor);
+    if (step == 1 && op == MUL)
+        increment = factor;
+    else
+        increment = foldedValue(fn, loop->preheader, op, constantValue(fn, loop->preheader, step), factor);
+
+    // The product's phi, first in the header
+    product = newValue(fn, IR_PHI, loop->header);
+    fn->values[product].phiOperand = arenaAlloc(&irArena, 3 * sizeof(int));
+    placeAfter(fn, product, NO_VALUE);
+
+    // Stepped right after the variable is
+    update = resolveValue(fn, fn->values[phi].phiOperand[latch]);
+    next = newValue(fn, IR_BINARY, fn->values[update].block);
+    fn->values[next].op = ADD;
+    fn->values[next].operand[0] = product;
+    fn->values[next].operand[1] = increment;
+    placeAfter(fn, next, update);
+
+    fn->values[product].phiOperand[entry] = start;
+    fn->values[product].phiOperand[latch] = next;
+
+    fn->values[multiply].replacement = product;
+    fn->values[multiply].dead = 1;
+
+    return 1;
+}
+
+// Adds a binary operator applied to two values to the end of a block (just the
+// result when both are constants), returns it
+int foldedValue(IRFunction* fn, int block, int op, int left, int right)
+{
+    int value, result;
+
+    if (fn->values[left].kind == IR_CONST && fn->values[right].kind == IR_CONST &&
+        evaluateOperator(op, fn->values[left].value, fn->values[right].value, &result))
+        return constantValue(fn, block, result);
+
+    value = newValue(fn, IR_BINARY, block);
+    fn->values[value].op = op;
+    fn->values[value].operand[0] = left;
+    fn->values[value].operand[1] = right;
+
+    return value;
+}
+
+// Adds a constant to the end of a block, returns it
+int constantValue(IRFunction* fn, int block, int constant)
+{
+    int value = newValue(fn, IR_CONST, block);
+
+    fn->values[value].value = constant;
+
+    return value;
+}
+
+// Moves the value just added to the end of its block to right after another
+// (to the front for NO_VALUE)
+void placeAfter(IRFunction* fn, int value, int after)
+{
+    IRBlock* block = &fn->blocks[fn->values[value].block];
+    int at = 0;
+
+    if (after != NO_VALUE)
+    {
+        while (block->values[at] != after)
+            at++;
+
+        at++;
+    }
+
+    memmove(&block->values[at + 1], &block->values[at], (block->count - 1 - at) * sizeof(int));
+    block->values[at] = value;
+}
+
+#endif
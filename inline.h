@@ -0,0 +1,321 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs.h"
+#include "ast.h"
+#include "symtab.h"
+#include "pl0_constants.h"
+
+// Tree pass that replaces calls with a copy of the called procedure's statement,
+// saving the CAL, the frame setup, the static link walks to the caller's
+// variables and the RET. A procedure is inlined at every call when it is small,
+// and at its one call when it is only called once, as long as the program stays
+// within a growth budget. Only procedures without procedures of their own are
+// inlined (nothing else then needs their frame). Their variables get fresh slots
+// in the caller's frame at each inlined call, and the copy's loads & stores are
+// re-leveled to the caller. A procedure is never inlined into itself, directly
+// or through the copies of other procedures, so recursion still calls. Callees
+// are inlined into first, so what is copied is already inlined, and procedures
+// left with no calls are dropped as soon as their block is done -- which can
+// leave the block itself with no procedures, and so inlinable.
+
+#define INLINE_SMALL 24
+#define INLINE_SINGLE 2000
+#define INLINE_GROWTH 8000
+
+// PROTOTYPES
+int inlineProcedures(Node* program);
+void indexProcedures(Node* block);
+void countCalls(Node* node, int* calls);
+int inlineBlock(Node* block);
+Node* inlineStatement(Node* statement, Node* caller, int* inlined);
+int shouldInline(Node* call);
+Node* copyStatement(Node* node, Node* callee, Node* caller, int* locals);
+int treeSize(Node* node);
+int dropUncalled(Node* block);
+int callsTo(Node* node, int symbol);
+
+// GLOBALS
+THREAD_LOCAL Node** inlineCallee = NULL;
+THREAD_LOCAL int* inlineCalls = NULL;
+THREAD_LOCAL int* inlineSizes = NULL;
+THREAD_LOCAL char* inlineActive = NULL;
+THREAD_LOCAL int inlineGrowth = 0;
+
+// Inlines throughout the program, returns how many calls were replaced
+int inlineProcedures(Node* program)
+{
+    int count = symbols.count + 1, inlined;
+
+    inlineCallee = calloc(count, sizeof(Node*));
+    inlineCalls = calloc(count, sizeof(int));
+    inlineSizes = calloc(count, sizeof(int));
+    inlineActive = calloc(count, 1);
+    inlineGrowth = 0;
+
+    indexProcedures(program);
+    countCalls(program, inlineCalls);
+
+    inlined = inlineBlock(program);
+
+    free(inlineCallee);
+    free(inlineCalls);
+    free(inlineSizes);
+    free(inlineActive);
+    inlineCallee = NULL;
+    inlineCalls = inlineSizes = NULL;
+    inlineActive = NULL;
+
+    return inlined;
+}
+
+// Records every procedure's block and size under its symbol
+void indexProcedures(Node* block)
+{
+    Node* procedure;
+
+    for (procedure = block->child[0]; procedure != NULL; procedure = procedure->next)
+    {
+        inlineCallee[procedure->symbol] = procedure;
+        inlineSizes[procedure->symbol] = treeSize(procedure->child[1]);
+        indexProcedures(procedure);
+    }
+}
+
+// Counts the calls to each procedure in a tree (procedures' blocks included)
+void countCalls(Node* node, int* calls)
+{
+    int i;
+
+    for (; node != NULL; node = node->next)
+    {
+        if (node->kind == NODE_CALL)
+            calls[node->symbol]++;
+
+        for (i = 0; i < 3; i++)
+            countCalls(node->child[i], calls);
+    }
+}
+
+// Inlines into a block's procedures, then into its statement, then drops the
+// procedures that leaves uncalled -- returns how many calls were replaced
+int inlineBlock(Node* block)
+{
+    Node* procedure;
+    int inlined = 0;
+
+    for (procedure = block->child[0]; procedure != NULL; procedure = procedure->next)
+        inlined += inlineBlock(procedure);
+
+    if (block->symbol != NO_SYMBOL)
+        inlineActive[block->symbol] = 1;
+
+    block->child[1] = inlineStatement(block->child[1], block, &inlined);
+
+    if (block->symbol != NO_SYMBOL)
+    {
+        inlineActive[block->symbol] = 0;
+        inlineSizes[block->symbol] = treeSize(block->child[1]);
+    }
+
+    // Only the block's own statement & procedures can call them
+    dropUncalled(block);
+
+    return inlined;
+}
+
+// Inlines the calls in a statement, returns what should take its place (NULL
+// when it was a call to a procedure that does nothing)
+Node* inlineStatement(Node* statement, Node* caller, int* inlined)
+{
+    Node** next;
+    Node* replacement;
+    Node* callee;
+    int* locals;
+    int symbol;
+
+    if (statement == NULL)
+        return NULL;
+
+    switch (statement->kind)
+    {
+        case NODE_BEGIN:
+            for (next = &statement->child[0]; *next != NULL; )
+            {
+                replacement = inlineStatement(*next, caller, inlined);
+
+                // Splice the replacement (or nothing) in where the statement was
+                if (replacement == NULL)
+                    *next = (*next)->next;
+                else
+                {
+                    replacement->next = (*next)->next;
+                    *next = replacement;
+                    next = &replacement->next;
+                }
+            }
+            return statement;
+
+        case NODE_IF:
+        case NODE_WHILE:
+            statement->child[1] = inlineStatement(statement->child[1], caller, inlined);
+            return statement;
+
+        case NODE_CALL:
+            if (!shouldInline(statement))
+                return statement;
+
+            symbol = statement->symbol;
+            callee = inlineCallee[symbol];
+
+            locals = malloc((symbols.count + 1) * sizeof(int));
+            memset(locals, -1, (symbols.count + 1) * sizeof(int));
+
+            replacement = copyStatement(callee->child[1], callee, caller, locals);
+            free(locals);
+
+            inlineGrowth += inlineSizes[symbol];
+            inlineCalls[symbol]--;
+            (*inlined)++;
+
+            // The calls the copy makes, with the callee off limits
+            inlineActive[symbol] = 1;
+            replacement = inlineStatement(replacement, caller, inlined);
+            inlineActive[symbol] = 0;
+
+            return replacement;
+
+        default:
+            return statement;
+    }
+}
+
+// Returns whether a call should be replaced with its procedure's statement
+int shouldInline(Node* call)
+{
+    Node* callee = inlineCallee[call->symbol];
+    int size = inlineSizes[call->symbol];
+
+    if (callee == NULL || callee->child[0] != NULL || inlineActive[call->symbol])
+        return 0;
+
+    if (inlineGrowth + size > INLINE_GROWTH)
+        return 0;
+
+    return size <= INLINE_SMALL || (inlineCalls[call->symbol] == 1 && size <= INLINE_SINGLE);
+}
+
+// Copies a list of the callee's nodes for the caller, moving the callee's
+// variables into new slots of the caller's frame (locals maps them as it goes)
+Node* copyStatement(Node* node, Node* callee, Node* caller, int* locals)
+{
+    Node* first = NULL;
+    Node** link = &first;
+    Node* copy;
+    int i, symbol;
+
+    for (; node != NULL; node = node->next)
+    {
+        copy = newNode(node->kind);
+        *copy = *node;
+        copy->span = -1;
+
+        for (i = 0; i < 3; i++)
+            copy->child[i] = copyStatement(node->child[i], callee, caller, locals);
+
+        if (node->kind == NODE_CALL)
+            inlineCalls[node->symbol]++;
+
+        if (node->symbol != NO_SYMBOL)
+        {
+            copy->level = caller->level;
+            symbol = node->symbol;
+
+            if (symbols.symbols[symbol].id == VAR_SYM && symbols.symbols[symbol].level == callee->level)
+            {
+                if (locals[symbol] == NO_SYMBOL)
+                    locals[symbol] = copySymbol(&symbols, symbol, caller->level, caller->value++);
+
+                copy->symbol = locals[symbol];
+            }
+        }
+
+        *link = copy;
+        link = &copy->next;
+    }
+
+    *link = NULL;
+
+    return first;
+}
+
+// Returns how many nodes make up a tree
+int treeSize(Node* node)
+{
+    int size = 0, i;
+
+    for (; node != NULL; node = node->next)
+    {
+        size++;
+
+        for (i = 0; i < 3; i++)
+            size += treeSize(node->child[i]);
+    }
+
+    return size;
+}
+
+// Removes the procedures of a block that no call reaches (but their own),
+// returns how many went
+int dropUncalled(Node* block)
+{
+    Node** procedure;
+    int symbol, dropped = 0, changed;
+
+    // Dropping one can leave another with no calls
+    do
+    {
+        changed = 0;
+
+        for (procedure = &block->child[0]; *procedure != NULL; )
+        {
+            symbol = (*procedure)->symbol;
+
+            if (callsTo(block->child[0], symbol) + callsTo(block->child[1], symbol) >
+                callsTo((*procedure)->child[0], symbol) + callsTo((*procedure)->child[1], symbol))
+            {
+                procedure = &(*procedure)->next;
+                continue;
+            }
+
+            *procedure = (*procedure)->next;
+            changed = 1;
+            dropped++;
+        }
+
+    } while (changed);
+
+    return dropped;
+}
+
+// Returns how many calls to a procedure a tree makes
+int callsTo(Node* node, int symbol)
+{
+    int calls = 0, i;
+
+    for (; node != NULL; node = node->next)
+    {
+        if (node->kind == NODE_CALL && node->symbol == symbol)
+            calls++;
+
+        for (i = 0; i < 3; i++)
+            calls += callsTo(node->child[i], symbol);
+    }
+
+    return calls;
+}
+
+#endif
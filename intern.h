@@ -0,0 +1,160 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs.h"
+
+// Identifier pool shared by the scanner, parser and symbol table. Each
+// distinct identifier is copied once into an arena and handed a small integer
+// ID (0, 1, 2, ...), so later phases compare IDs instead of strings.
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define INTERN_INITIAL_SLOTS 256
+
+// PROTOTYPES
+void* arenaAlloc(Arena* arena, int size);
+void arenaFree(Arena* arena);
+unsigned int hashName(const char* text, int length);
+int intern(InternTable* table, const char* text, int length);
+char* internName(InternTable* table, int name);
+void growInternTable(InternTable* table);
+void freeInternTable(InternTable* table);
+
+// GLOBALS
+THREAD_LOCAL InternTable identifiers;
+
+// Bump allocates size bytes from the arena, starting a new block when full
+void* arenaAlloc(Arena* arena, int size)
+{
+    ArenaBlock* block = arena->head;
+    int blockSize;
+    void* memory;
+
+    // Keep every allocation pointer aligned
+    size = (size + 7) & ~7;
+
+    if (block == NULL || block->used + size > block->size)
+    {
+        blockSize = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + blockSize);
+        block->next = arena->head;
+        block->used = 0;
+        block->size = blockSize;
+        arena->head = block;
+    }
+
+    memory = block->data + block->used;
+    block->used += size;
+
+    return memory;
+}
+
+// Releases every block held by the arena
+void arenaFree(Arena* arena)
+{
+    ArenaBlock* next;
+
+    while (arena->head != NULL)
+    {
+        next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
+
+// FNV-1a hash of an identifier
+unsigned int hashName(const char* text, int length)
+{
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) text[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// Returns the ID for an identifier, adding it to the pool the first time it is seen
+int intern(InternTable* table, const char* text, int length)
+{
+    unsigned int hash = hashName(text, length);
+    unsigned int mask;
+    int slot, name;
+
+    // Keep the open addressed slots at most half full
+    if (table->count * 2 >= table->slotCount)
+        growInternTable(table);
+
+    mask = table->slotCount - 1;
+
+    // Linear probe until the name or an empty slot (-1) turns up
+    for (slot = hash & mask; table->slots[slot] >= 0; slot = (slot + 1) & mask)
+    {
+        name = table->slots[slot];
+
+        if (table->hashes[name] == hash && table->lengths[name] == length &&
+            memcmp(table->names[name], text, length) == 0)
+            return name;
+    }
+
+    // New identifier, copy it into the arena
+    name = table->count++;
+    table->names[name] = arenaAlloc(&table->arena, length + 1);
+    memcpy(table->names[name], text, length);
+    table->names[name][length] = '\0';
+    table->lengths[name] = length;
+    table->hashes[name] = hash;
+    table->slots[slot] = name;
+
+    return name;
+}
+
+// Returns the text of an interned identifier
+char* internName(InternTable* table, int name)
+{
+    return table->names[name];
+}
+
+// Doubles the slot array (and the per name arrays), rehashing from stored hashes
+void growInternTable(InternTable* table)
+{
+    int slotCount = (table->slotCount) ? table->slotCount * 2 : INTERN_INITIAL_SLOTS;
+    unsigned int mask = slotCount - 1;
+    int i, slot;
+
+    free(table->slots);
+    table->slots = malloc(slotCount * sizeof(int));
+    memset(table->slots, -1, slotCount * sizeof(int));
+    table->slotCount = slotCount;
+
+    // At most half the slots are used, so names need half as many entries
+    table->names = realloc(table->names, (slotCount / 2) * sizeof(char*));
+    table->lengths = realloc(table->lengths, (slotCount / 2) * sizeof(int));
+    table->hashes = realloc(table->hashes, (slotCount / 2) * sizeof(unsigned int));
+
+    for (i = 0; i < table->count; i++)
+    {
+        for (slot = table->hashes[i] & mask; table->slots[slot] >= 0; slot = (slot + 1) & mask)
+            ;
+
+        table->slots[slot] = i;
+    }
+}
+
+// Releases the pool (IDs handed out before are no longer valid)
+void freeInternTable(InternTable* table)
+{
+    arenaFree(&table->arena);
+    free(table->names);
+    free(table->lengths);
+    free(table->hashes);
+    free(table->slots);
+    memset(table, 0, sizeof(InternTable));
+}
+
+#endif
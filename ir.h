@@ -0,0 +1,757 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs.h"
+#include "intern.h"
+#include "ast.h"
+#include "symtab.h"
+#include "pl0_constants.h"
+#include "pm0_constants.h"
+
+// Mid-level IR: each block of the program (the main block & every procedure) is
+// built into a function of basic blocks in SSA form, straight from the syntax tree
+// (Braun et al., "Simple and Efficient Construction of Static Single Assignment
+// Form"). Local variables no nested procedure touches are promoted: an assignment
+// just names the value, a read finds the reaching value, and phis join them where
+// control flow meets. Every other variable stays in memory with explicit loads and
+// stores. The IR passes (propagate.h, licm.h, deadstore.h) rewrite the functions
+// and lower.h turns them back into PM/0.
+//
+// An if becomes then & else blocks joined after it, and a while a header holding
+// the condition, the body and an exit block. No block with more than one successor
+// leads to a block with more than one predecessor, so the copies for a phi always
+// go at the end of its predecessors. The blocks of a while (header to the end of
+// its body) are numbered consecutively, the block before the header is where
+// licm.h puts what it hoists.
+//
+// Functions too large for the lowering's liveness sets are left unbuilt (failed)
+// and generated straight from the tree.
+
+// Values
+#define IR_CONST 1
+#define IR_ENTRY 2
+#define IR_PHI 3
+#define IR_UNARY 4
+#define IR_BINARY 5
+#define IR_LOAD 6
+#define IR_STORE 7
+#define IR_READ 8
+#define IR_WRITE 9
+#define IR_CALL 10
+
+// Block exits
+#define IR_JUMP 1
+#define IR_BRANCH 2
+#define IR_RETURN 3
+
+#define NO_VALUE -1
+#define NO_BLOCK -1
+
+#define IR_MAX_NODES 20000
+#define IR_MAX_DEFS (4 * 1024 * 1024)
+
+// PROTOTYPES
+void buildIR(Node* program);
+void buildBlockIR(Node* block);
+void buildFunction(IRFunction* fn, Node* block);
+void buildStatement(IRFunction* fn, Node* statement);
+int buildExpression(IRFunction* fn, Node* expression);
+void markEscapes(Node* node);
+int measureFunction(IRFunction* fn, Node* node, int* blocks);
+int isPromoted(Node* node);
+int newValue(IRFunction* fn, int kind, int block);
+int newBlock(IRFunction* fn);
+void appendValue(IRFunction* fn, int block, int value);
+void addPredecessor(IRFunction* fn, int block, int pred);
+void removePredecessor(IRFunction* fn, int block, int pred);
+void jumpTo(IRFunction* fn, int from, int to);
+void sealBlock(IRFunction* fn, int block);
+void writeVariable(IRFunction* fn, int variable, int block, int value);
+int readVariable(IRFunction* fn, int variable, int block);
+void addPhiOperands(IRFunction* fn, int phi);
+int entryValue(IRFunction* fn, int variable);
+int removeTrivialPhis(IRFunction* fn);
+int resolveValue(IRFunction* fn, int value);
+void forwardValues(IRFunction* fn);
+void compactBlocks(IRFunction* fn);
+int hasSideEffect(IRValue* value);
+int canTrap(IRFunction* fn, IRValue* value);
+void freeIR();
+
+// GLOBALS
+THREAD_LOCAL IRFunction* irFunctions = NULL;
+THREAD_LOCAL int irFunctionCount = 0;
+THREAD_LOCAL int irFunctionCapacity = 0;
+THREAD_LOCAL Arena irArena;
+
+// Per symbol: its promoted variable number in its function (-1 if in memory),
+// and whether a nested procedure reaches it through a static link
+THREAD_LOCAL int* irVariable = NULL;
+THREAD_LOCAL char* irEscaped = NULL;
+
+// Builds a function for every block of the program, in the order lowerProgram()
+// visits them (a block, then its procedures)
+void buildIR(Node* program)
+{
+    freeIR();
+
+    irVariable = malloc((symbols.count + 1) * sizeof(int));
+    irEscaped = calloc(symbols.count + 1, 1);
+    memset(irVariable, -1, (symbols.count + 1) * sizeof(int));
+
+    markEscapes(program);
+    buildBlockIR(program);
+}
+
+// Builds a block's function, then its procedures'
+void buildBlockIR(Node* block)
+{
+    Node* procedure;
+    int index;
+
+    if (irFunctionCount == irFunctionCapacity)
+    {
+        irFunctionCapacity = (irFunctionCapacity) ? irFunctionCapacity * 2 : 8;
+        irFunctions = realloc(irFunctions, irFunctionCapacity * sizeof(IRFunction));
+    }
+
+    index = irFunctionCount++;
+    memset(&irFunctions[index], 0, sizeof(IRFunction));
+    buildFunction(&irFunctions[index], block);
+
+    for (procedure = block->child[0]; procedure != NULL; procedure = procedure->next)
+        buildBlockIR(procedure);
+}
+
+// Builds the SSA form of a block's statement
+void buildFunction(IRFunction* fn, Node* block)
+{
+    int blocks = 1, i, entry;
+
+    fn->node = block;
+
+    // Number the promoted variables, giving up on functions too big to lower
+    if (measureFunction(fn, block->child[1], &blocks) > IR_MAX_NODES ||
+        (long long) blocks * (fn->variableCount + 1) > IR_MAX_DEFS)
+    {
+        fn->failed = 1;
+        return;
+    }
+
+    fn->entryValue = malloc((fn->variableCount + 1) * sizeof(int));
+
+    for (i = 0; i < fn->variableCount; i++)
+        fn->entryValue[i] = NO_VALUE;
+
+    entry = newBlock(fn);
+    sealBlock(fn, entry);
+    fn->current = entry;
+
+    buildStatement(fn, block->child[1]);
+
+    fn->blocks[fn->current].exit = IR_RETURN;
+
+    free(fn->currentDef);
+    fn->currentDef = NULL;
+
+    removeTrivialPhis(fn);
+}
+
+// Adds a statement's values & blocks to the function, leaving fn->current at
+// the block control reaches afterwards
+void buildStatement(IRFunction* fn, Node* statement)
+{
+    Node* node;
+    int value, from, then, otherwise, join, header, body, exit, loop;
+
+    if (statement == NULL)
+        return;
+
+    switch (statement->kind)
+    {
+        case NODE_ASSIGN:
+        case NODE_READ:
+            if (statement->kind == NODE_ASSIGN)
+                value = buildExpression(fn, statement->child[0]);
+            else
+                value = newValue(fn, IR_READ, fn->current);
+
+            if (isPromoted(statement))
+            {
+                writeVariable(fn, irVariable[statement->symbol], fn->current, value);
+
+                // The variable's own slot is where lower.h first tries to keep the value
+                if (fn->values[value].variable == NO_SYMBOL)
+                    fn->values[value].variable = statement->symbol;
+            }
+            else
+            {
+                from = newValue(fn, IR_STORE, fn->current);
+                fn->values[from].symbol = statement->symbol;
+                fn->values[from].level = levelDifference(statement);
+                fn->values[from].operand[0] = value;
+            }
+            break;
+
+        case NODE_WRITE:
+            value = buildExpression(fn, statement->child[0]);
+            from = newValue(fn, IR_WRITE, fn->current);
+            fn->values[from].operand[0] = value;
+            break;
+
+        case NODE_CALL:
+            value = newValue(fn, IR_CALL, fn->current);
+            fn->values[value].symbol = statement->symbol;
+            fn->values[value].level = levelDifference(statement);
+            break;
+
+        case NODE_BEGIN:
+            for (node = statement->child[0]; node != NULL; node = node->next)
+                buildStatement(fn, node);
+            break;
+
+        case NODE_IF:
+            value = buildExpression(fn, statement->child[0]);
+            from = fn->current;
+
+            then = newBlock(fn);
+            addPredecessor(fn, then, from);
+            sealBlock(fn, then);
+
+            fn->current = then;
+            buildStatement(fn, statement->child[1]);
+
+            otherwise = newBlock(fn);
+            addPredecessor(fn, otherwise, from);
+            sealBlock(fn, otherwise);
+
+            fn->blocks[from].exit = IR_BRANCH;
+            fn->blocks[from].condition = value;
+            fn->blocks[from].succ[0] = then;
+            fn->blocks[from].succ[1] = otherwise;
+            fn->blocks[from].succCount = 2;
+
+            join = newBlock(fn);
+            jumpTo(fn, fn->current, join);
+            jumpTo(fn, otherwise, join);
+            sealBlock(fn, join);
+
+            fn->current = join;
+            break;
+
+        case NODE_WHILE:
+            from = fn->current;
+            header = newBlock(fn);
+            jumpTo(fn, from, header);
+
+            if (fn->loopCount == fn->loopCapacity)
+            {
+                fn->loopCapacity = (fn->loopCapacity) ? fn->loopCapacity * 2 : 8;
+                fn->loops = realloc(fn->loops, fn->loopCapacity * sizeof(IRLoop));
+            }
+
+            loop = fn->loopCount++;
+            fn->loops[loop].preheader = from;
+            fn->loops[loop].header = header;
+
+            fn->current = header;
+            value = buildExpression(fn, statement->child[0]);
+
+            body = newBlock(fn);
+            addPredecessor(fn, body, header);
+            sealBlock(fn, body);
+
+            fn->current = body;
+            buildStatement(fn, statement->child[1]);
+            jumpTo(fn, fn->current, header);
+            sealBlock(fn, header);
+            fn->loops[loop].last = fn->blockCount - 1;
+
+            exit = newBlock(fn);
+            addPredecessor(fn, exit, header);
+            sealBlock(fn, exit);
+
+            fn->blocks[header].exit = IR_BRANCH;
+            fn->blocks[header].condition = value;
+            fn->blocks[header].succ[0] = body;
+            fn->blocks[header].succ[1] = exit;
+            fn->blocks[header].succCount = 2;
+
+            fn->current = exit;
+            break;
+    }
+}
+
+// Adds an expression's values to the current block, returns the value of the whole
+int buildExpression(IRFunction* fn, Node* expression)
+{
+    int value, left, right;
+
+    switch (expression->kind)
+    {
+        case NODE_NUMBER:
+            value = newValue(fn, IR_CONST, fn->current);
+            fn->values[value].value = expression->value;
+            return value;
+
+        case NODE_VARIABLE:
+            if (isPromoted(expression))
+                return readVariable(fn, irVariable[expression->symbol], fn->current);
+
+            value = newValue(fn, IR_LOAD, fn->current);
+            fn->values[value].symbol = expression->symbol;
+            fn->values[value].level = levelDifference(expression);
+            return value;
+
+        case NODE_UNARY:
+            left = buildExpression(fn, expression->child[0]);
+            value = newValue(fn, IR_UNARY, fn->current);
+            fn->values[value].op = expression->op;
+            fn->values[value].operand[0] = left;
+            return value;
+
+        default:
+            left = buildExpression(fn, expression->child[0]);
+            right = buildExpression(fn, expression->child[1]);
+            value = newValue(fn, IR_BINARY, fn->current);
+            fn->values[value].op = expression->op;
+            fn->values[value].operand[0] = left;
+            fn->values[value].operand[1] = right;
+            return value;
+    }
+}
+
+// Marks the variables some block reaches in an enclosing block's frame
+void markEscapes(Node* node)
+{
+    int i;
+
+    for (; node != NULL; node = node->next)
+    {
+        if ((node->kind == NODE_ASSIGN || node->kind == NODE_READ || node->kind == NODE_VARIABLE) &&
+            levelDifference(node) > 0)
+            irEscaped[node->symbol] = 1;
+
+        for (i = 0; i < 3; i++)
+            markEscapes(node->child[i]);
+    }
+}
+
+// Numbers the promoted variables a statement uses, returns how many nodes it has
+// (and adds the blocks it needs to blocks)
+int measureFunction(IRFunction* fn, Node* node, int* blocks)
+{
+    int count = 0, i;
+
+    for (; node != NULL; node = node->next)
+    {
+        count++;
+
+        if (node->kind == NODE_IF || node->kind == NODE_WHILE)
+            *blocks += 3;
+
+        if (isPromoted(node) && irVariable[node->symbol] < 0)
+        {
+            // Grown at each power of two
+            if ((fn->variableCount & (fn->variableCount - 1)) == 0)
+                fn->variableSymbol = realloc(fn->variableSymbol, (fn->variableCount * 2 + 1) * sizeof(int));
+
+            fn->variableSymbol[fn->variableCount] = node->symbol;
+            irVariable[node->symbol] = fn->variableCount++;
+        }
+
+        for (i = 0; i < 3; i++)
+            count += measureFunction(fn, node->child[i], blocks);
+    }
+
+    return count;
+}
+
+// Returns whether a node names a variable of its own block that no nested
+// procedure reaches
+int isPromoted(Node* node)
+{
+    if (node->kind != NODE_ASSIGN && node->kind != NODE_READ && node->kind != NODE_VARIABLE)
+        return 0;
+
+    return symbols.symbols[node->symbol].id == VAR_SYM && levelDifference(node) == 0 && !irEscaped[node->symbol];
+}
+
+// Adds a blank value of a kind to the end of a block, returns its index
+int newValue(IRFunction* fn, int kind, int block)
+{
+    IRValue* value;
+
+    if (fn->valueCount == fn->valueCapacity)
+    {
+        fn->valueCapacity = (fn->valueCapacity) ? fn->valueCapacity * 2 : 64;
+        fn->values = realloc(fn->values, fn->valueCapacity * sizeof(IRValue));
+    }
+
+    value = &fn->values[fn->valueCount];
+    memset(value, 0, sizeof(IRValue));
+    value->kind = kind;
+    value->symbol = NO_SYMBOL;
+    value->block = block;
+    value->operand[0] = value->operand[1] = NO_VALUE;
+    value->variable = NO_SYMBOL;
+    value->replacement = NO_VALUE;
+    value->slot = -1;
+
+    appendValue(fn, block, fn->valueCount);
+
+    return fn->valueCount++;
+}
+
+// Adds an empty, unsealed block that returns, returns its index
+int newBlock(IRFunction* fn)
+{
+    int i;
+
+    if (fn->blockCount == fn->blockCapacity)
+    {
+        fn->blockCapacity = (fn->blockCapacity) ? fn->blockCapacity * 2 : 16;
+        fn->blocks = realloc(fn->blocks, fn->blockCapacity * sizeof(IRBlock));
+        fn->currentDef = realloc(fn->currentDef, (fn->blockCapacity * fn->variableCount + 1) * sizeof(int));
+    }
+
+    memset(&fn->blocks[fn->blockCount], 0, sizeof(IRBlock));
+    fn->blocks[fn->blockCount].exit = IR_RETURN;
+    fn->blocks[fn->blockCount].condition = NO_VALUE;
+
+    for (i = 0; i < fn->variableCount; i++)
+        fn->currentDef[fn->blockCount * fn->variableCount + i] = NO_VALUE;
+
+    return fn->blockCount++;
+}
+
+// Appends a value to a block's list
+void appendValue(IRFunction* fn, int block, int value)
+{
+    IRBlock* target = &fn->blocks[block];
+
+    if (target->count == target->capacity)
+    {
+        target->capacity = (target->capacity) ? target->capacity * 2 : 8;
+        target->values = realloc(target->values, target->capacity * sizeof(int));
+    }
+
+    target->values[target->count++] = value;
+}
+
+// Adds a control flow edge into a block
+void addPredecessor(IRFunction* fn, int block, int pred)
+{
+    IRBlock* target = &fn->blocks[block];
+
+    if (target->predCount == target->predCapacity)
+    {
+        target->predCapacity = (target->predCapacity) ? target->predCapacity * 2 : 2;
+        target->preds = realloc(target->preds, target->predCapacity * sizeof(int));
+    }
+
+    target->preds[target->predCount++] = pred;
+}
+
+// Drops the edge from pred into a block, with the matching operand of its phis
+void removePredecessor(IRFunction* fn, int block, int pred)
+{
+    IRBlock* target = &fn->blocks[block];
+    IRValue* value;
+    int i, j, k;
+
+    for (i = 0; i < target->predCount && target->preds[i] != pred; i++)
+        ;
+
+    if (i == target->predCount)
+        return;
+
+    for (j = 0; j < target->count; j++)
+    {
+        value = &fn->values[target->values[j]];
+
+        if (value->kind == IR_PHI && value->phiOperand != NULL)
+        {
+            for (k = i; k + 1 < target->predCount; k++)
+                value->phiOperand[k] = value->phiOperand[k + 1];
+        }
+    }
+
+    for (k = i; k + 1 < target->predCount; k++)
+        target->preds[k] = target->preds[k + 1];
+
+    target->predCount--;
+}
+
+// Ends a block with a jump to another
+void jumpTo(IRFunction* fn, int from, int to)
+{
+    fn->blocks[from].exit = IR_JUMP;
+    fn->blocks[from].succ[0] = to;
+    fn->blocks[from].succCount = 1;
+
+    addPredecessor(fn, to, from);
+}
+
+// Marks a block's predecessors as complete, filling in the phis made before they were
+void sealBlock(IRFunction* fn, int block)
+{
+    int i, value;
+
+    for (i = 0; i < fn->blocks[block].count; i++)
+    {
+        value = fn->blocks[block].values[i];
+
+        if (fn->values[value].kind == IR_PHI && fn->values[value].phiOperand == NULL)
+            addPhiOperands(fn, value);
+    }
+
+    fn->blocks[block].sealed = 1;
+}
+
+// Records the value a variable has at the end of a block (so far)
+void writeVariable(IRFunction* fn, int variable, int block, int value)
+{
+    fn->currentDef[block * fn->variableCount + variable] = value;
+}
+
+// Returns the value a variable has at the end of a block (so far), looking
+// through its predecessors and placing phis where they meet
+int readVariable(IRFunction* fn, int variable, int block)
+{
+    int value = fn->currentDef[block * fn->variableCount + variable];
+
+    if (value != NO_VALUE)
+        return value;
+
+    if (!fn->blocks[block].sealed || fn->blocks[block].predCount > 1)
+    {
+        // Written before the operands are read, which breaks cycles through loops
+        value = newValue(fn, IR_PHI, block);
+        fn->values[value].symbol = fn->variableSymbol[variable];
+        fn->values[value].variable = fn->variableSymbol[variable];
+        fn->values[value].value = variable;
+        writeVariable(fn, variable, block, value);
+
+        if (fn->blocks[block].sealed)
+            addPhiOperands(fn, value);
+    }
+    else if (fn->blocks[block].predCount == 1)
+        value = readVariable(fn, variable, fn->blocks[block].preds[0]);
+    else
+        value = entryValue(fn, variable);
+
+    writeVariable(fn, variable, block, value);
+
+    return value;
+}
+
+// Gives a phi the variable's value from each predecessor of its block
+void addPhiOperands(IRFunction* fn, int phi)
+{
+    int block = fn->values[phi].block;
+    int count = fn->blocks[block].predCount;
+    int i, operand;
+
+    fn->values[phi].phiOperand = arenaAlloc(&irArena, (count + 1) * sizeof(int));
+
+    for (i = 0; i < count; i++)
+        fn->values[phi].phiOperand[i] = NO_VALUE;
+
+    for (i = 0; i < count; i++)
+    {
+        operand = readVariable(fn, fn->values[phi].value, fn->blocks[block].preds[i]);
+        fn->values[phi].phiOperand[i] = operand;
+    }
+}
+
+// Returns the value a variable has on entry (whatever its slot held), made on first use
+int entryValue(IRFunction* fn, int variable)
+{
+    int value = fn->entryValue[variable];
+
+    if (value == NO_VALUE)
+    {
+        value = newValue(fn, IR_ENTRY, 0);
+        fn->values[value].symbol = fn->variableSymbol[variable];
+        fn->values[value].variable = fn->variableSymbol[variable];
+        fn->values[value].value = variable;
+        fn->entryValue[variable] = value;
+    }
+
+    return value;
+}
+
+// Replaces phis whose operands are all one value (or the phi itself) with that
+// value until none are left, returns how many went
+int removeTrivialPhis(IRFunction* fn)
+{
+    int i, j, same, operand, changed, removed = 0;
+    IRValue* phi;
+
+    do
+    {
+        changed = 0;
+
+        for (i = 0; i < fn->valueCount; i++)
+        {
+            phi = &fn->values[i];
+
+            if (phi->kind != IR_PHI || phi->dead)
+                continue;
+
+            same = NO_VALUE;
+
+            for (j = 0; j < fn->blocks[phi->block].predCount; j++)
+            {
+                operand = resolveValue(fn, phi->phiOperand[j]);
+
+                if (operand == i || operand == same)
+                    continue;
+
+                if (same != NO_VALUE)
+                    break;
+
+                same = operand;
+            }
+
+            if (j < fn->blocks[phi->block].predCount)
+                continue;
+
+            // Only ever reaches itself: the variable was never assigned
+            if (same == NO_VALUE)
+                same = entryValue(fn, fn->values[i].value);
+
+            fn->values[i].replacement = same;
+            fn->values[i].dead = 1;
+            changed = 1;
+            removed++;
+        }
+
+    } while (changed);
+
+    if (removed)
+    {
+        forwardValues(fn);
+        compactBlocks(fn);
+    }
+
+    return removed;
+}
+
+// Follows the replacements of a value to the one that stands for it
+int resolveValue(IRFunction* fn, int value)
+{
+    while (value != NO_VALUE && fn->values[value].replacement != NO_VALUE)
+        value = fn->values[value].replacement;
+
+    return value;
+}
+
+// Points every operand & branch condition at the value that replaced it
+void forwardValues(IRFunction* fn)
+{
+    IRValue* value;
+    int i, j;
+
+    for (i = 0; i < fn->valueCount; i++)
+    {
+        value = &fn->values[i];
+
+        if (value->dead)
+            continue;
+
+        for (j = 0; j < 2; j++)
+            value->operand[j] = resolveValue(fn, value->operand[j]);
+
+        if (value->kind == IR_PHI)
+        {
+            for (j = 0; j < fn->blocks[value->block].predCount; j++)
+                value->phiOperand[j] = resolveValue(fn, value->phiOperand[j]);
+        }
+    }
+
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        if (fn->blocks[i].exit == IR_BRANCH)
+            fn->blocks[i].condition = resolveValue(fn, fn->blocks[i].condition);
+    }
+}
+
+// Drops dead values from the block lists
+void compactBlocks(IRFunction* fn)
+{
+    IRBlock* block;
+    int i, j, kept;
+
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        block = &fn->blocks[i];
+
+        for (j = kept = 0; j < block->count; j++)
+        {
+            if (!fn->values[block->values[j]].dead)
+                block->values[kept++] = block->values[j];
+        }
+
+        block->count = kept;
+    }
+}
+
+// Returns whether a value does more than compute (so must stay where it is)
+int hasSideEffect(IRValue* value)
+{
+    return value->kind == IR_STORE || value->kind == IR_READ || value->kind == IR_WRITE || value->kind == IR_CALL;
+}
+
+// Returns whether a value can stop the VM: a division by something other than a
+// known nonzero, non -1 constant (INT_MIN / -1 overflows)
+int canTrap(IRFunction* fn, IRValue* value)
+{
+    IRValue* divisor;
+
+    if (value->kind != IR_BINARY || (value->op != DIV && value->op != MOD))
+        return 0;
+
+    divisor = &fn->values[value->operand[1]];
+
+    return divisor->kind != IR_CONST || divisor->value == 0 || divisor->value == -1;
+}
+
+// Frees every function built by buildIR()
+void freeIR()
+{
+    IRFunction* fn;
+    int i, j;
+
+    for (i = 0; i < irFunctionCount; i++)
+    {
+        fn = &irFunctions[i];
+
+        for (j = 0; j < fn->blockCount; j++)
+        {
+            free(fn->blocks[j].values);
+            free(fn->blocks[j].preds);
+        }
+
+        free(fn->values);
+        free(fn->blocks);
+        free(fn->loops);
+        free(fn->variableSymbol);
+        free(fn->entryValue);
+        free(fn->currentDef);
+    }
+
+    irFunctionCount = 0;
+    arenaFree(&irArena);
+
+    free(irVariable);
+    free(irEscaped);
+    irVariable = NULL;
+    irEscaped = NULL;
+}
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef LICM_H
+#define LICM_H
+
+#include <stdlib.h>
+
+#include "structs.h"
+#include "ir.h"
+#include "pm0_constants.h"
+
+// IR pass moving loop-invariant computations out of while loops, innermost loop
+// first so what leaves an inner loop can go on out of the ones around it. A value
+// is invariant when all its operands come from outside the loop; it moves to the
+// end of the block that enters the loop (which runs once, just before the first
+// test). Loads move too when nothing in the loop stores to the variable or calls a
+// procedure. Operators that can trap in the VM (a division by something other than
+// a known nonzero, non -1 constant) stay put, since the loop may never run them.
+// Computing a value once costs a slot in the frame, which is cheaper than
+// recomputing it on every iteration for anything but a constant.
+
+// PROTOTYPES
+int hoistInvariants(Node* program);
+int hoistLoop(IRFunction* fn, IRLoop* loop);
+int isInvariant(IRFunction* fn, IRLoop* loop, int value, char* stored, int calls);
+int inLoop(IRLoop* loop, int block);
+
+// Hoists out of every loop of every function, returns how many values moved
+int hoistInvariants(Node* program)
+{
+    int i, j, hoisted = 0;
+
+    (void) program;
+
+    for (i = 0; i < irFunctionCount; i++)
+    {
+        if (irFunctions[i].failed)
+            continue;
+
+        // Loops are numbered outermost first
+        for (j = irFunctions[i].loopCount - 1; j >= 0; j--)
+            hoisted += hoistLoop(&irFunctions[i], &irFunctions[i].loops[j]);
+    }
+
+    return hoisted;
+}
+
+// Moves a loop's invariant values to its preheader until none are left
+int hoistLoop(IRFunction* fn, IRLoop* loop)
+{
+    char* stored = calloc(symbols.count + 1, 1);
+    IRBlock* block;
+    IRValue* value;
+    int i, j, kept, moved, calls = 0, hoisted = 0;
+
+    if (fn->blocks[loop->header].dead || fn->blocks[loop->preheader].dead)
+    {
+        free(stored);
+        return 0;
+    }
+
+    // What the loop's loads depend on
+    for (i = loop->header; i <= loop->last; i++)
+    {
+        for (j = 0; j < fn->blocks[i].count; j++)
+        {
+            value = &fn->values[fn->blocks[i].values[j]];
+
+            if (value->kind == IR_STORE)
+                stored[value->symbol] = 1;
+            else if (value->kind == IR_CALL)
+                calls = 1;
+        }
+    }
+
+    do
+    {
+        moved = 0;
+
+        for (i = loop->header; i <= loop->last; i++)
+        {
+            block = &fn->blocks[i];
+
+            for (j = kept = 0; j < block->count; j++)
+            {
+                if (!isInvariant(fn, loop, block->values[j], stored, calls))
+                {
+                    block->values[kept++] = block->values[j];
+                    continue;
+                }
+
+                fn->values[block->values[j]].block = loop->preheader;
+                appendValue(fn, loop->preheader, block->values[j]);
+                moved++;
+            }
+
+            block->count = kept;
+        }
+
+        hoisted += moved;
+
+    } while (moved);
+
+    free(stored);
+
+    return hoisted;
+}
+
+// Returns whether a value in a loop computes the same thing on every iteration
+// (and is worth computing once)
+int isInvariant(IRFunction* fn, IRLoop* loop, int value, char* stored, int calls)
+{
+    IRValue* target = &fn->values[value];
+    int i, constants = 0;
+
+    switch (target->kind)
+    {
+        case IR_LOAD:
+            return !calls && !stored[target->symbol];
+
+        case IR_UNARY:
+        case IR_BINARY:
+            // Constants are immediates, wherever they were made
+            for (i = 0; i < 2 && target->operand[i] != NO_VALUE; i++)
+            {
+                if (fn->values[target->operand[i]].kind == IR_CONST)
+                    constants++;
+                else if (inLoop(loop, fn->values[target->operand[i]].block))
+                    return 0;
+            }
+
+            if (canTrap(fn, target))
+                return 0;
+
+            // All constant operands: nothing to save (and folded when propagating)
+            return constants < i;
+
+        default:
+            return 0;
+    }
+}
+
+// Returns whether a block is one of a loop's
+int inLoop(IRLoop* loop, int block)
+{
+    return block >= loop->header && block <= loop->last;
+}
+
+#endif
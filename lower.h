@@ -0,0 +1,711 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs.h"
+#include "ir.h"
+#include "symtab.h"
+#include "pm0_constants.h"
+
+// Lowers the IR functions back to PM/0, in the layout generateProgram() uses. A
+// value used once, later in its own block, is computed on the stack right where
+// it is used (unless that would move a load past a store to its variable or a
+// call, or a division past an effect); constants are LITs. Every other value
+// lives in a slot of the frame: one of the promoted variables' (its own first)
+// or a temporary after them, shared by values that are never live at the same
+// time. Liveness is solved over the blocks, and two values interfere when one is
+// live where the other is defined. Leaving SSA, a phi is copied to at the end of
+// each predecessor: all the operands are loaded first and then stored in reverse,
+// so copies between slots never see each other's results.
+
+#define LOWER_AT_END -2
+#define LOWER_MANY_BLOCKS -2
+#define NO_SLOT -1
+#define SLOT_NEEDED -2
+
+// PROTOTYPES
+void lowerProgram(Node* program);
+void lowerBlock(Node* block);
+void chooseInlined(IRFunction* fn);
+int blocksMove(IRFunction* fn, int value, int from, int to);
+void allocateSlots(IRFunction* fn);
+void solveLiveness(IRFunction* fn, unsigned int* liveIn, int words);
+void liveAtEnd(IRFunction* fn, int block, unsigned int* liveIn, unsigned int* live, int words);
+void walkBlock(IRFunction* fn, int block, unsigned int* live, int interfere);
+void addLeaves(IRFunction* fn, int value, unsigned int* live);
+void addInterference(int value, unsigned int* live, int words);
+int isMaterialized(IRFunction* fn, int value);
+void emitFunction(IRFunction* fn);
+void emitOperand(IRFunction* fn, int value);
+void emitComputation(IRFunction* fn, int value);
+void emitPhiCopies(IRFunction* fn, int from, int to);
+int nextLiveBlock(IRFunction* fn, int block);
+
+// GLOBALS
+THREAD_LOCAL int lowerNext = 0;
+THREAD_LOCAL char* lowerInlined = NULL;
+THREAD_LOCAL int* lowerUses = NULL;
+THREAD_LOCAL int* lowerUseBlock = NULL;
+THREAD_LOCAL int* lowerUser = NULL;
+THREAD_LOCAL int* lowerEvaluated = NULL;
+THREAD_LOCAL int* lowerEdges = NULL;
+THREAD_LOCAL int lowerEdgeCount = 0;
+THREAD_LOCAL int lowerEdgeCapacity = 0;
+
+// Generates the main block (which returns to end the program), then frees the IR
+void lowerProgram(Node* program)
+{
+    codeIndex = 0;
+    lowerNext = 0;
+
+    lowerBlock(program);
+
+    freeIR();
+}
+
+// Generates a block from its function (or its tree, if it was too big to build):
+// a jump over the blocks of its procedures, frame allocation, its statement, then
+// the return
+void lowerBlock(Node* block)
+{
+    IRFunction* fn = &irFunctions[lowerNext++];
+    Node* node;
+    int jump = -1;
+
+    if (block->symbol != NO_SYMBOL)
+        symbols.symbols[block->symbol].stackPointer = codeIndex;
+
+    if (!fn->failed)
+        allocateSlots(fn);
+
+    if (block->child[0] != NULL)
+    {
+        jump = codeIndex;
+        gen(JMP, 0, 0);
+    }
+
+    for (node = block->child[0]; node != NULL; node = node->next)
+        lowerBlock(node);
+
+    if (jump >= 0)
+        parseCode[jump].M = codeIndex;
+
+    gen(INC, 0, (fn->failed) ? block->value : fn->frameSize);
+
+    if (fn->failed)
+        generateStatement(block->child[1]);
+    else
+        emitFunction(fn);
+
+    gen(OPR, 0, RET);
+}
+
+// Decides which values get slots and gives them one, sizing the frame
+void allocateSlots(IRFunction* fn)
+{
+    int words = (fn->valueCount + 32) / 32;
+    unsigned int* liveIn = calloc((size_t) fn->blockCount * words, sizeof(unsigned int));
+    unsigned int* live = malloc(words * sizeof(unsigned int));
+    int* start = calloc(fn->valueCount + 2, sizeof(int));
+    int* adjacent;
+    int* order = malloc((fn->valueCount + 1) * sizeof(int));
+    int* blocked = calloc(fn->node->value + fn->valueCount + 1, sizeof(int));
+    int* prefer = malloc((fn->valueCount + 1) * sizeof(int));
+    int i, j, v, slot, count = 0, pass, home;
+
+    chooseInlined(fn);
+
+    for (i = 0; i < fn->valueCount; i++)
+        fn->values[i].slot = (isMaterialized(fn, i)) ? SLOT_NEEDED : NO_SLOT;
+
+    solveLiveness(fn, liveIn, words);
+
+    // Interference, gathered block by block into lowerEdges (pairs)
+    lowerEdgeCount = 0;
+
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        if (fn->blocks[i].dead)
+            continue;
+
+        liveAtEnd(fn, i, liveIn, live, words);
+        walkBlock(fn, i, live, 1);
+    }
+
+    // ... as adjacency lists
+    for (i = 0; i < lowerEdgeCount; i++)
+    {
+        start[lowerEdges[i * 2] + 1]++;
+        start[lowerEdges[i * 2 + 1] + 1]++;
+    }
+
+    for (i = 0; i < fn->valueCount; i++)
+        start[i + 1] += start[i];
+
+    adjacent = malloc((lowerEdgeCount * 2 + 1) * sizeof(int));
+
+    for (i = 0; i < lowerEdgeCount; i++)
+    {
+        adjacent[start[lowerEdges[i * 2]]++] = lowerEdges[i * 2 + 1];
+        adjacent[start[lowerEdges[i * 2 + 1]]++] = lowerEdges[i * 2];
+    }
+
+    for (i = fn->valueCount; i > 0; i--)
+        start[i] = start[i - 1];
+
+    start[0] = 0;
+
+    // Entry values first (their variable's slot is where they already are),
+    // then phis, then the rest
+    for (pass = 0; pass < 3; pass++)
+    {
+        for (i = 0; i < fn->valueCount; i++)
+        {
+            if (fn->values[i].slot == SLOT_NEEDED &&
+                (pass == 0) == (fn->values[i].kind == IR_ENTRY) &&
+                (pass != 1 || fn->values[i].kind == IR_PHI) &&
+                (pass != 2 || fn->values[i].kind != IR_PHI))
+                order[count++] = i;
+        }
+    }
+
+    // A phi's operands would rather share its slot, which spares the copy
+    for (i = 0; i < fn->valueCount; i++)
+        prefer[i] = NO_VALUE;
+
+    for (i = 0; i < fn->valueCount; i++)
+    {
+        if (fn->values[i].kind != IR_PHI || fn->values[i].dead)
+            continue;
+
+        for (j = 0; j < fn->blocks[fn->values[i].block].predCount; j++)
+        {
+            if (prefer[fn->values[i].phiOperand[j]] == NO_VALUE)
+                prefer[fn->values[i].phiOperand[j]] = i;
+        }
+    }
+
+    fn->frameSize = fn->node->value;
+
+    for (i = 0; i < count; i++)
+    {
+        v = order[i];
+
+        for (j = start[v]; j < start[v + 1]; j++)
+        {
+            if (fn->values[adjacent[j]].slot >= 0)
+                blocked[fn->values[adjacent[j]].slot] = v + 1;
+        }
+
+        // Its own variable's slot, its phi's, another promoted variable's, else
+        // a temporary
+        slot = NO_SLOT;
+
+        if (fn->values[v].variable != NO_SYMBOL)
+        {
+            home = symbols.symbols[fn->values[v].variable].stackPointer;
+
+            if (blocked[home] != v + 1)
+                slot = home;
+        }
+
+        if (slot == NO_SLOT && prefer[v] != NO_VALUE && fn->values[prefer[v]].slot >= 0 &&
+            blocked[fn->values[prefer[v]].slot] != v + 1)
+            slot = fn->values[prefer[v]].slot;
+
+        for (j = 0; slot == NO_SLOT && j < fn->variableCount; j++)
+        {
+            home = symbols.symbols[fn->variableSymbol[j]].stackPointer;
+
+            if (blocked[home] != v + 1)
+                slot = home;
+        }
+
+        for (j = fn->node->value; slot == NO_SLOT; j++)
+        {
+            if (blocked[j] != v + 1)
+                slot = j;
+        }
+
+        fn->values[v].slot = slot;
+
+        if (slot + 1 > fn->frameSize)
+            fn->frameSize = slot + 1;
+    }
+
+    free(liveIn);
+    free(live);
+    free(start);
+    free(adjacent);
+    free(order);
+    free(blocked);
+    free(prefer);
+    free(lowerInlined);
+    free(lowerUses);
+    free(lowerUseBlock);
+    free(lowerUser);
+    free(lowerEvaluated);
+    lowerInlined = NULL;
+    lowerUses = lowerUseBlock = lowerUser = lowerEvaluated = NULL;
+}
+
+// Counts the uses of every value, then picks the ones computed where they are used
+// (lowerInlined), latest first so each knows where its user will be computed
+void chooseInlined(IRFunction* fn)
+{
+    IRBlock* block;
+    IRValue* value;
+    int i, j, k, at, use, user, operand;
+
+    lowerInlined = calloc(fn->valueCount + 1, 1);
+    lowerUses = calloc(fn->valueCount + 1, sizeof(int));
+    lowerUseBlock = malloc((fn->valueCount + 1) * sizeof(int));
+    lowerUser = malloc((fn->valueCount + 1) * sizeof(int));
+    lowerEvaluated = malloc((fn->valueCount + 1) * sizeof(int));
+
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        block = &fn->blocks[i];
+
+        if (block->dead)
+            continue;
+
+        for (j = 0; j <= block->count; j++)
+        {
+            // Each operand is used by its value; a phi's at the end of the
+            // predecessor it comes from, the condition at the end of the block
+            for (k = 0; k < 2 + ((j < block->count) ? block->predCount : 0); k++)
+            {
+                if (j == block->count)
+                {
+                    operand = (k == 0 && block->exit == IR_BRANCH) ? block->condition : NO_VALUE;
+                    use = i;
+                    user = LOWER_AT_END;
+                }
+                else
+                {
+                    value = &fn->values[block->values[j]];
+
+                    if (k < 2)
+                    {
+                        operand = value->operand[k];
+                        use = i;
+                        user = block->values[j];
+                    }
+                    else
+                    {
+                        operand = (value->kind == IR_PHI) ? value->phiOperand[k - 2] : NO_VALUE;
+                        use = block->preds[k - 2];
+                        user = LOWER_AT_END;
+                    }
+                }
+
+                if (operand == NO_VALUE)
+                    continue;
+
+                if (lowerUses[operand]++ == 0)
+                {
+                    lowerUseBlock[operand] = use;
+                    lowerUser[operand] = user;
+                }
+                else if (lowerUseBlock[operand] != use || lowerUser[operand] != user)
+                    lowerUseBlock[operand] = LOWER_MANY_BLOCKS;
+            }
+        }
+    }
+
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        block = &fn->blocks[i];
+
+        if (block->dead)
+            continue;
+
+        for (j = block->count - 1; j >= 0; j--)
+        {
+            value = &fn->values[block->values[j]];
+
+            if ((value->kind != IR_UNARY && value->kind != IR_BINARY && value->kind != IR_LOAD) ||
+                lowerUses[block->values[j]] != 1 || lowerUseBlock[block->values[j]] != i)
+                continue;
+
+            // Where the use is computed: the block's end, its user, or wherever
+            // the user is itself computed
+            user = lowerUser[block->values[j]];
+
+            if (user == LOWER_AT_END)
+                at = block->count;
+            else if (lowerInlined[user])
+                at = lowerEvaluated[user];
+            else
+            {
+                for (at = j + 1; at < block->count && block->values[at] != user; at++)
+                    ;
+            }
+
+            if (blocksMove(fn, block->values[j], j + 1, at))
+                continue;
+
+            lowerInlined[block->values[j]] = 1;
+            lowerEvaluated[block->values[j]] = at;
+        }
+    }
+}
+
+// Returns whether something between two places in a value's block keeps the
+// value from being computed at the later one
+int blocksMove(IRFunction* fn, int value, int from, int to)
+{
+    IRValue* target = &fn->values[value];
+    IRValue* between;
+    int i;
+
+    for (i = from; i < to; i++)
+    {
+        between = &fn->values[fn->blocks[target->block].values[i]];
+
+        if (target->kind == IR_LOAD && (between->kind == IR_CALL ||
+                                        (between->kind == IR_STORE && between->symbol == target->symbol)))
+            return 1;
+
+        if ((target->op == DIV || target->op == MOD) && target->kind == IR_BINARY && hasSideEffect(between))
+            return 1;
+    }
+
+    return 0;
+}
+
+// Solves the values live on entry to each block, backwards to a fixed point
+void solveLiveness(IRFunction* fn, unsigned int* liveIn, int words)
+{
+    unsigned int* live = malloc(words * sizeof(unsigned int));
+    int i, changed;
+
+    do
+    {
+        changed = 0;
+
+        for (i = fn->blockCount - 1; i >= 0; i--)
+        {
+            if (fn->blocks[i].dead)
+                continue;
+
+            liveAtEnd(fn, i, liveIn, live, words);
+            walkBlock(fn, i, live, 0);
+
+            if (memcmp(live, &liveIn[(size_t) i * words], words * sizeof(unsigned int)) != 0)
+            {
+                memcpy(&liveIn[(size_t) i * words], live, words * sizeof(unsigned int));
+                changed = 1;
+            }
+        }
+
+    } while (changed);
+
+    free(live);
+}
+
+// Sets live to what is live at the end of a block: what its successors need, the
+// operands of their phis from this block & its branch condition
+void liveAtEnd(IRFunction* fn, int block, unsigned int* liveIn, unsigned int* live, int words)
+{
+    IRBlock* target = &fn->blocks[block];
+    IRBlock* succ;
+    int i, j, k, pred;
+
+    memset(live, 0, words * sizeof(unsigned int));
+
+    for (i = 0; i < target->succCount; i++)
+    {
+        succ = &fn->blocks[target->succ[i]];
+
+        for (k = 0; k < words; k++)
+            live[k] |= liveIn[(size_t) target->succ[i] * words + k];
+
+        for (pred = 0; pred < succ->predCount && succ->preds[pred] != block; pred++)
+            ;
+
+        for (j = 0; j < succ->count && pred < succ->predCount; j++)
+        {
+            if (fn->values[succ->values[j]].kind == IR_PHI)
+                addLeaves(fn, fn->values[succ->values[j]].phiOperand[pred], live);
+        }
+    }
+
+    if (target->exit == IR_BRANCH)
+        addLeaves(fn, target->condition, live);
+}
+
+// Walks a block backwards from what is live at its end to what is live on entry,
+// recording interference when asked
+void walkBlock(IRFunction* fn, int block, unsigned int* live, int interfere)
+{
+    IRBlock* target = &fn->blocks[block];
+    IRValue* value;
+    int i, j, words = (fn->valueCount + 32) / 32;
+
+    for (i = target->count - 1; i >= 0; i--)
+    {
+        value = &fn->values[target->values[i]];
+
+        if (value->kind == IR_PHI || value->kind == IR_ENTRY || value->kind == IR_CONST || lowerInlined[target->values[i]])
+            continue;
+
+        if (value->slot != NO_SLOT)
+        {
+            if (interfere)
+                addInterference(target->values[i], live, words);
+
+            live[target->values[i] / 32] &= ~(1u << (target->values[i] % 32));
+        }
+
+        for (j = 0; j < 2; j++)
+        {
+            if (value->operand[j] != NO_VALUE)
+                addLeaves(fn, value->operand[j], live);
+        }
+    }
+
+    // Phis (and entry values) are all defined together on entry
+    for (i = 0; interfere && i < target->count; i++)
+    {
+        value = &fn->values[target->values[i]];
+
+        if ((value->kind == IR_PHI || value->kind == IR_ENTRY) && value->slot != NO_SLOT)
+            addInterference(target->values[i], live, words);
+    }
+
+    for (i = 0; i < target->count; i++)
+    {
+        value = &fn->values[target->values[i]];
+
+        if (value->kind == IR_PHI || value->kind == IR_ENTRY)
+            live[target->values[i] / 32] &= ~(1u << (target->values[i] % 32));
+    }
+}
+
+// Adds the values an operand's computation reads from slots to live
+void addLeaves(IRFunction* fn, int value, unsigned int* live)
+{
+    IRValue* target = &fn->values[value];
+    int i;
+
+    if (target->slot != NO_SLOT)
+    {
+        live[value / 32] |= 1u << (value % 32);
+        return;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        if (target->operand[i] != NO_VALUE)
+            addLeaves(fn, target->operand[i], live);
+    }
+}
+
+// Records that a value interferes with everything else live where it is defined
+void addInterference(int value, unsigned int* live, int words)
+{
+    int i, bit, other;
+
+    for (i = 0; i < words; i++)
+    {
+        for (bit = 0; bit < 32 && (live[i] >> bit) != 0; bit++)
+        {
+            other = i * 32 + bit;
+
+            if (!(live[i] & (1u << bit)) || other == value)
+                continue;
+
+            if (lowerEdgeCount == lowerEdgeCapacity)
+            {
+                lowerEdgeCapacity = (lowerEdgeCapacity) ? lowerEdgeCapacity * 2 : 256;
+                lowerEdges = realloc(lowerEdges, lowerEdgeCapacity * 2 * sizeof(int));
+            }
+
+            lowerEdges[lowerEdgeCount * 2] = value;
+            lowerEdges[lowerEdgeCount * 2 + 1] = other;
+            lowerEdgeCount++;
+        }
+    }
+}
+
+// Returns whether a value is kept in a slot (before allocation: will need one)
+int isMaterialized(IRFunction* fn, int value)
+{
+    IRValue* target = &fn->values[value];
+
+    if (target->dead || target->kind == IR_CONST || lowerInlined[value])
+        return 0;
+
+    return target->kind != IR_STORE && target->kind != IR_WRITE && target->kind != IR_CALL;
+}
+
+// Generates the blocks in order, each jump & branch resolved once all are placed
+void emitFunction(IRFunction* fn)
+{
+    int* address = malloc((fn->blockCount + 1) * sizeof(int));
+    int* patches = malloc((fn->blockCount * 2 + 1) * sizeof(int));
+    int i, j, next, patchCount = 0;
+    IRBlock* block;
+    IRValue* value;
+
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        block = &fn->blocks[i];
+
+        if (block->dead)
+            continue;
+
+        address[i] = codeIndex;
+
+        for (j = 0; j < block->count; j++)
+        {
+            value = &fn->values[block->values[j]];
+
+            switch (value->kind)
+            {
+                case IR_READ:
+                    gen(IN, 0, 0);
+                    gen(STO, 0, value->slot);
+                    break;
+
+                case IR_WRITE:
+                    emitOperand(fn, value->operand[0]);
+                    gen(OUT, 0, 0);
+                    break;
+
+                case IR_STORE:
+                    emitOperand(fn, value->operand[0]);
+                    gen(STO, value->level, symbols.symbols[value->symbol].stackPointer);
+                    break;
+
+                case IR_CALL:
+                    gen(CAL, value->level, symbols.symbols[value->symbol].stackPointer);
+                    break;
+
+                case IR_UNARY:
+                case IR_BINARY:
+                case IR_LOAD:
+                    if (value->slot != NO_SLOT)
+                    {
+                        emitComputation(fn, block->values[j]);
+                        gen(STO, 0, value->slot);
+                    }
+                    break;
+            }
+        }
+
+        // Jumps hold their target block until the addresses are known
+        next = nextLiveBlock(fn, i);
+
+        if (block->exit == IR_JUMP)
+            emitPhiCopies(fn, i, block->succ[0]);
+        else if (block->exit == IR_BRANCH)
+        {
+            emitOperand(fn, block->condition);
+            patches[patchCount++] = codeIndex;
+            gen(JPC, 0, block->succ[1]);
+        }
+
+        if (block->exit != IR_RETURN && block->succ[0] != next)
+        {
+            patches[patchCount++] = codeIndex;
+            gen(JMP, 0, block->succ[0]);
+        }
+    }
+
+    for (i = 0; i < patchCount; i++)
+        parseCode[patches[i]].M = address[parseCode[patches[i]].M];
+
+    free(address);
+    free(patches);
+}
+
+// Generates code leaving a value on top of the stack
+void emitOperand(IRFunction* fn, int value)
+{
+    IRValue* target = &fn->values[value];
+
+    if (target->kind == IR_CONST)
+        gen(LIT, 0, target->value);
+    else if (target->slot != NO_SLOT)
+        gen(LOD, 0, target->slot);
+    else
+        emitComputation(fn, value);
+}
+
+// Generates a value's own computation
+void emitComputation(IRFunction* fn, int value)
+{
+    IRValue* target = &fn->values[value];
+
+    switch (target->kind)
+    {
+        case IR_LOAD:
+            gen(LOD, target->level, symbols.symbols[target->symbol].stackPointer);
+            break;
+
+        case IR_UNARY:
+            emitOperand(fn, target->operand[0]);
+            gen(OPR, 0, target->op);
+            break;
+
+        case IR_BINARY:
+            emitOperand(fn, target->operand[0]);
+            emitOperand(fn, target->operand[1]);
+            gen(OPR, 0, target->op);
+            break;
+    }
+}
+
+// Copies the operands from one block into the phis of the next, as one
+// parallel copy: every operand is loaded before any phi is stored
+void emitPhiCopies(IRFunction* fn, int from, int to)
+{
+    IRBlock* target = &fn->blocks[to];
+    IRValue* phi;
+    int* stores = malloc((target->count + 1) * sizeof(int));
+    int i, pred, operand, count = 0;
+
+    for (pred = 0; pred < target->predCount && target->preds[pred] != from; pred++)
+        ;
+
+    for (i = 0; i < target->count && pred < target->predCount; i++)
+    {
+        phi = &fn->values[target->values[i]];
+
+        if (phi->kind != IR_PHI)
+            continue;
+
+        operand = phi->phiOperand[pred];
+
+        // Already in place
+        if (fn->values[operand].slot == phi->slot)
+            continue;
+
+        emitOperand(fn, operand);
+        stores[count++] = phi->slot;
+    }
+
+    while (count > 0)
+        gen(STO, 0, stores[--count]);
+
+    free(stores);
+}
+
+// Returns the next block that is generated after one (NO_BLOCK after the last)
+int nextLiveBlock(IRFunction* fn, int block)
+{
+    for (block++; block < fn->blockCount; block++)
+    {
+        if (!fn->blocks[block].dead)
+            return block;
+    }
+
+    return NO_BLOCK;
+}
+
+#endif
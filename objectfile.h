@@ -0,0 +1,451 @@
+#ifndef OBJECTFILE_H
+#define OBJECTFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define HAVE_MMAP 1
+#endif
+
+#include "structs.h"
+#include "pm0_constants.h"
+
+// Binary PM/0 program, the compiler's hand-off to the VM. Layout (host byte
+// order):
+//
+//   ObjectFileHeader          magic "PM0B", version, instruction count, entry
+//                             point, stack cells the program needs
+//   Instruction[count]        fixed width records: OP, L, M
+//
+// The records are exactly the VM's Instructions, so the VM maps the file read
+// only and runs straight out of the mapping -- nothing is parsed or copied, and
+// every VM running the same program shares its pages. mcode.txt is written beside
+// it as the program's disassembly (writeDisassembly()): an instruction a line, with
+// its address, mnemonic, L & M, and the operator an OPR applies. The stack size is worked out from the code
+// (maxStackDepth()); a recursive program has none, and says so with
+// OBJECT_UNBOUNDED_STACK.
+
+#define OBJECT_FILE_MAGIC "PM0B"
+#define OBJECT_FILE_VERSION 1
+#define OBJECT_UNBOUNDED_STACK 0
+
+// How many cells a frame can grow before the walk gives up on following it
+#define STACK_WALK_LIMIT (1 << 20)
+
+// procedureDepth() memo states (a depth is >= 0)
+#define DEPTH_UNKNOWN -3
+#define DEPTH_WALKING -2
+#define DEPTH_UNBOUNDED -1
+
+// PROTOTYPES
+int writeObjectFile(char* fileName, Instruction* code, int length);
+int mapObjectFile(char* fileName, ObjectFile* object);
+void closeObjectFile(ObjectFile* object);
+void writeDisassembly(FILE* file, Instruction* code, int length);
+char* opToString(int OP);
+char* operatorToString(int M);
+unsigned int maxStackDepth(Instruction* code, int length, int entry);
+int procedureDepth(StackWalk* walk, int entry);
+int walkTo(StackWalk* walk, int entry, int address, int height);
+
+// Writes code as an object file starting at address 0 -- returns 0 if the file
+// can't be written
+int writeObjectFile(char* fileName, Instruction* code, int length)
+{
+    ObjectFileHeader header;
+    FILE* ofp = fopen(fileName, "wb");
+    int written;
+
+    if (ofp == NULL)
+        return 0;
+
+    memcpy(header.magic, OBJECT_FILE_MAGIC, 4);
+    header.version = OBJECT_FILE_VERSION;
+    header.instructionCount = length;
+    header.entryPoint = 0;
+    header.maxStack = maxStackDepth(code, length, 0);
+
+    fwrite(&header, sizeof(ObjectFileHeader), 1, ofp);
+    fwrite(code, sizeof(Instruction), length, ofp);
+
+    written = !ferror(ofp);
+
+    return (fclose(ofp) == 0) && written;
+}
+
+// Maps an object file read only (reads it in where there is no mmap)
+// Returns 0 (leaving object empty) if the file is missing, truncated or not an object file
+int mapObjectFile(char* fileName, ObjectFile* object)
+{
+    FILE* ifp;
+    ObjectFileHeader* header;
+    long size;
+
+    memset(object, 0, sizeof(ObjectFile));
+
+#ifdef HAVE_MMAP
+    {
+        struct stat info;
+        int fd = open(fileName, O_RDONLY);
+
+        if (fd < 0)
+            return 0;
+
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size >= (off_t) sizeof(ObjectFileHeader))
+        {
+            void* map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (map != MAP_FAILED)
+            {
+                object->data = map;
+                object->size = info.st_size;
+                object->mapped = 1;
+            }
+        }
+
+        close(fd);
+    }
+#endif
+
+    if (!object->mapped)
+    {
+        ifp = fopen(fileName, "rb");
+        if (ifp == NULL)
+            return 0;
+
+        fseek(ifp, 0, SEEK_END);
+        size = ftell(ifp);
+        fseek(ifp, 0, SEEK_SET);
+
+        if (size > 0)
+        {
+            object->data = malloc(size);
+            object->size = (long) fread(object->data, 1, size, ifp);
+        }
+
+        fclose(ifp);
+    }
+
+    header = (ObjectFileHeader*) object->data;
+
+    if (object->size < (long) sizeof(ObjectFileHeader) ||
+        memcmp(header->magic, OBJECT_FILE_MAGIC, 4) != 0 || header->version != OBJECT_FILE_VERSION ||
+        (object->size - (long) sizeof(ObjectFileHeader)) / (long) sizeof(Instruction) < (long) header->instructionCount ||
+        header->entryPoint >= header->instructionCount)
+    {
+        closeObjectFile(object);
+        return 0;
+    }
+
+    object->header = header;
+    object->code = (Instruction*) (object->data + sizeof(ObjectFileHeader));
+
+    return 1;
+}
+
+// Releases a mapped (or read) object file
+void closeObjectFile(ObjectFile* object)
+{
+#ifdef HAVE_MMAP
+    if (object->mapped)
+        munmap(object->data, object->size);
+    else
+#endif
+        free(object->data);
+
+    memset(object, 0, sizeof(ObjectFile));
+}
+
+// Returns how many stack cells running code from entry takes at most: the
+// deepest its frames get, following calls, or OBJECT_UNBOUNDED_STACK when
+// recursion (or code the walk can't follow) leaves it without a bound
+unsigned int maxStackDepth(Instruction* code, int length, int entry)
+{
+    StackWalk walk;
+    int i, depth;
+
+    walk.code = code;
+    walk.length = length;
+    walk.height = malloc((length + 1) * sizeof(int));
+    walk.owner = malloc((length + 1) * sizeof(int));
+    walk.depth = malloc((length + 1) * sizeof(int));
+    walk.work = NULL;
+    walk.top = walk.capacity = 0;
+
+    for (i = 0; i < length; i++)
+    {
+        walk.owner[i] = -1;
+        walk.depth[i] = DEPTH_UNKNOWN;
+    }
+
+    depth = procedureDepth(&walk, entry);
+
+    free(walk.height);
+    free(walk.owner);
+    free(walk.depth);
+    free(walk.work);
+
+    // The program's frame is entered like a call's, with its three link cells
+    if (depth < 0)
+        return OBJECT_UNBOUNDED_STACK;
+
+    return (depth < 3) ? 3 : depth;
+}
+
+// Returns the most cells a frame entered at entry holds (its own, plus those of
+// the frames it calls), or DEPTH_UNBOUNDED. Heights are counted from the frame's
+// base, every address is walked once per rise in height, and the addresses a
+// procedure reaches are its own -- procedures don't share code.
+int procedureDepth(StackWalk* walk, int entry)
+{
+    Instruction* ir;
+    int base = walk->top, deepest = 0, address, height, callee, ok = 1;
+
+    if (entry < 0 || entry >= walk->length || walk->depth[entry] == DEPTH_WALKING)
+        return DEPTH_UNBOUNDED;
+
+    if (walk->depth[entry] != DEPTH_UNKNOWN)
+        return walk->depth[entry];
+
+    walk->depth[entry] = DEPTH_WALKING;
+    ok = walkTo(walk, entry, entry, 0);
+
+    while (ok && walk->top > base)
+    {
+        address = walk->work[--walk->top];
+        height = walk->height[address];
+        ir = &walk->code[address];
+
+        if (height > deepest)
+            deepest = height;
+
+        switch (ir->OP)
+        {
+            case (LIT):
+            case (LOD):
+            case (IN):
+                ok = walkTo(walk, entry, address + 1, height + 1);
+                break;
+
+            case (STO):
+            case (OUT):
+                ok = walkTo(walk, entry, address + 1, height - 1);
+                break;
+
+            case (OPR):
+                if (ir->M == RET)
+                    break;
+
+                if (ir->M == NEG || ir->M == ODD)
+                    ok = walkTo(walk, entry, address + 1, height);
+                else if (ir->M >= ADD && ir->M <= AND)
+                    ok = walkTo(walk, entry, address + 1, height - 1);
+                else
+                    ok = walkTo(walk, entry, address + 1, height);
+                break;
+
+            // The callee's frame starts where the stack top is (its links at least)
+            case (CAL):
+                callee = procedureDepth(walk, ir->M);
+                ok = callee >= 0 && walkTo(walk, entry, address + 1, height);
+
+                if (height + ((callee < 3) ? 3 : callee) > deepest)
+                    deepest = height + ((callee < 3) ? 3 : callee);
+                break;
+
+            // The callee's frame replaces this one (a procedure restarting itself
+            // grows nothing)
+            case (TCA):
+                callee = (ir->M == entry) ? 0 : procedureDepth(walk, ir->M);
+                ok = callee >= 0;
+
+                if (callee > deepest)
+                    deepest = callee;
+                break;
+
+            case (INC):
+                ok = walkTo(walk, entry, address + 1, height + ir->M);
+                break;
+
+            case (JMP):
+                ok = walkTo(walk, entry, ir->M, height);
+                break;
+
+            case (JPC):
+                ok = walkTo(walk, entry, ir->M, height - 1) && walkTo(walk, entry, address + 1, height - 1);
+                break;
+
+            // Superinstructions step over their operands (see vm.h)
+            case (LLO):
+            case (LCO):
+                ok = walkTo(walk, entry, address + 3, height + 1);
+                break;
+
+            case (LLB):
+            case (LCB):
+                ok = address + 3 < walk->length && walkTo(walk, entry, walk->code[address + 3].M, height) &&
+                     walkTo(walk, entry, address + 4, height);
+                break;
+
+            case (ADI):
+                ok = walkTo(walk, entry, address + 4, height);
+                break;
+
+            case (LST):
+                ok = walkTo(walk, entry, address + 2, height);
+                break;
+
+            // Invalid instructions do nothing
+            default:
+                ok = walkTo(walk, entry, address + 1, height);
+                break;
+        }
+    }
+
+    walk->top = base;
+    walk->depth[entry] = (ok) ? deepest : DEPTH_UNBOUNDED;
+
+    return walk->depth[entry];
+}
+
+// Queues an address of entry's procedure to be walked at a height (unless it was
+// already walked at least that high) -- returns 0 if the walk can't follow it
+int walkTo(StackWalk* walk, int entry, int address, int height)
+{
+    if (address < 0 || address >= walk->length || height < 0 || height > STACK_WALK_LIMIT)
+        return 0;
+
+    if (walk->owner[address] == entry && walk->height[address] >= height)
+        return 1;
+
+    if (walk->owner[address] != -1 && walk->owner[address] != entry)
+        return 0;
+
+    if (walk->top == walk->capacity)
+    {
+        walk->capacity = (walk->capacity) ? walk->capacity * 2 : 256;
+        walk->work = realloc(walk->work, walk->capacity * sizeof(int));
+    }
+
+    walk->owner[address] = entry;
+    walk->height[address] = height;
+    walk->work[walk->top++] = address;
+
+    return 1;
+}
+
+
+// Writes code as its disassembly, laid out like the code listing that starts the
+// VM's stack trace
+void writeDisassembly(FILE* file, Instruction* code, int length)
+{
+    int i;
+
+    fprintf(file, "Line   OP    L    M\n");
+
+    for (i = 0; i < length; i++)
+    {
+        fprintf(file, "%3d%7s%4d%6d", i, opToString(code[i].OP), code[i].L, code[i].M);
+
+        if (code[i].OP == OPR)
+            fprintf(file, "   %s", operatorToString(code[i].M));
+
+        fprintf(file, "\n");
+    }
+}
+
+// Returns string based on OP's int value
+char* opToString(int OP)
+{
+    switch(OP)
+    {
+        case 1:
+            return "lit";
+        case 2:
+            return "opr";
+        case 3:
+            return "lod";
+        case 4:
+            return "sto";
+        case 5:
+            return "cal";
+        case 6:
+            return "inc";
+        case 7:
+            return "jmp";
+        case 8:
+            return "jpc";
+        case 9:
+            return "out";
+        case 10:
+            return " in";
+        case 11:
+            return "llo";
+        case 12:
+            return "lco";
+        case 13:
+            return "llb";
+        case 14:
+            return "lcb";
+        case 15:
+            return "adi";
+        case 16:
+            return "lst";
+        case 17:
+            return "tca";
+        default:
+            return "   ";
+    }
+}
+
+// Returns the name of the operator an OPR's M selects
+char* operatorToString(int M)
+{
+    switch (M)
+    {
+        case RET:
+            return "ret";
+        case NEG:
+            return "neg";
+        case ADD:
+            return "add";
+        case SUB:
+            return "sub";
+        case MUL:
+            return "mul";
+        case DIV:
+            return "div";
+        case ODD:
+            return "odd";
+        case MOD:
+            return "mod";
+        case EQL:
+            return "eql";
+        case NEQ:
+            return "neq";
+        case LSS:
+            return "lss";
+        case LEQ:
+            return "leq";
+        case GTR:
+            return "gtr";
+        case GEQ:
+            return "geq";
+        case SHL:
+            return "shl";
+        case SHR:
+            return "shr";
+        case AND:
+            return "and";
+        default:
+            return "???";
+    }
+}
+
+#endif
@@ -4,12 +4,19 @@
 // Parser
 
 #include "parse.h"
+#include "tokenfile.h"
 
-int main(int argc, char *argv[])
+int main()
 {
     // Coded this way for external use
+    if (!readTokenFile(TOKEN_FILE, &tokens))
+    {
+        printf("Could not read token file %s\n", TOKEN_FILE);
+        return 1;
+    }
+
     parse();
     
-    return 1;
+    return 0;
 }
 
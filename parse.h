@@ -4,98 +4,176 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <setjmp.h>
 
 #include "files.h"
 #include "structs.h"
+#include "intern.h"
+#include "tokens.h"
+#include "symtab.h"
+#include "ast.h"
+#include "objectfile.h"
 #include "pl0_constants.h"
 #include "pm0_constants.h"
 
 // Constants defined
 #define MAX_STACK_HEIGHT 2000
-#define MAX_CODE_LENGTH 500
+#define MAX_CODE_LENGTH (1 << 30)
+#define CODE_INITIAL_CAPACITY 1024
 #define MAX_IDENTIFIERS_CHAR_LENGTH 12
 
 // GLOBALS 
-int token;
-FILE *ifp;
-FILE *ofp;
-int codeIndex = 0;
-int nextSymbolIndex = 0;
-
-// defined variable of type instruction struct that holds are input code
-Instruction parseCode[MAX_CODE_LENGTH];
-Symbol symbolTable[MAX_STACK_HEIGHT];
+THREAD_LOCAL int token;
+THREAD_LOCAL int tokenIndex = 0;
+THREAD_LOCAL int currentToken = -1;
+THREAD_LOCAL FILE *ofp;
+THREAD_LOCAL int codeIndex = 0;
+THREAD_LOCAL int codeCapacity = 0;
+
+// Statement spans (token & code ranges), recorded for incremental re-parsing
+THREAD_LOCAL int recordSpans = 0;
+THREAD_LOCAL StatementSpan* spans = NULL;
+THREAD_LOCAL int spanCount = 0;
+THREAD_LOCAL int spanCapacity = 0;
+
+// Generated code, grown geometrically by reserveCode() -- addresses are 32 bit indexes into it
+THREAD_LOCAL Instruction* parseCode = NULL;
+
+// Set while compiling through compiler.h: error() fills in errorDiagnostic and
+// jumps back to the recovery point instead of exiting
+THREAD_LOCAL jmp_buf* errorRecovery = NULL;
+THREAD_LOCAL Diagnostic errorDiagnostic;
 
 // Recursive Parsing
 void parse();
-void program();
-void block();
-void statement();
-void condition();
-void expression();
-void term();
-void factor();
+void parseTokens();
+Node* program();
+Node* block(int procedure);
+Node* statement();
+Node* condition();
+Node* expression();
+Node* term();
+Node* factor();
 
 // Tokens
 void getToken();
 // Error catching
 void error(int err_id);
+const char* errorMessage(int err_id);
 // Emits
-void enter(char* name, int id, int level, int updatedStackPointer);
+int enter(int name, int id, int level, int updatedStackPointer);
 void gen(int OP, int L, int M);
-Symbol find(char* symbolName);
+void reserveCode(int count);
+int find(int name);
+Node* variable(int symbol);
 void symbolType();
 void symbolLevel();
 
-void ifBlock();
-void whileBlock();
+Node* ifBlock();
+Node* whileBlock();
+
+// Spans
+int openSpan();
+void closeSpan(int span);
 
 // Helpers
 int isValidRelationalOperator();
 void writeMCode();
 int getNumber();
-char* getIdenName();
+int getIdenName();
 int getLexLevel();
 int mapOPRCode();
 
-// Parse the lexem list file
+// Lowering & optimization, these rely on the globals above
+#include "codegen.h"
+#include "passes.h"
+
+// Parse the token buffer (filled by scan() or readTokenFile()), writing the
+// program for the VM and its disassembly
 void parse()
 {
-    ifp = fopen(LIST_FILE, "r");
     ofp = fopen(CODE_FILE, "w");
     
-    program();
+    parseTokens();
 
     writeMCode();
     
-    fclose(ifp);
     fclose(ofp);
+
+    writeObjectFile(OBJECT_FILE, parseCode, codeIndex);
 }
 
-void writeMCode()
+// Parses the whole token buffer from the start into a tree, optimizes it and
+// generates its code into parseCode
+void parseTokens()
 {
-    int i;
+    Node* tree;
+    double start = passClock();
+
+    tokenIndex = 0;
+    currentToken = -1;
+    spanCount = 0;
+    resetSymbolTable(&symbols);
+    arenaFree(&astArena);
+    
+    tree = program();
+    parseSeconds = passClock() - start;
+
+    runPasses(PASS_TREE, tree);
+
+    // Through the SSA IR when optimizing that far (never for incremental builds)
+    if (optimizeLevel >= IR_LEVEL && !recordSpans)
+    {
+        start = passClock();
+        buildIR(tree);
+        buildSeconds = passClock() - start;
+
+        runPasses(PASS_IR, tree);
+
+        start = passClock();
+        lowerProgram(tree);
+        generateSeconds = passClock() - start;
+    }
+    else
+    {
+        start = passClock();
+        generateProgram(tree);
+        generateSeconds = passClock() - start;
+    }
 
-    for (i = 0; i < codeIndex; i++)
-        fprintf(ofp, "%d %d %d\n", parseCode[i].OP, parseCode[i].L, parseCode[i].M);
+    runPasses(PASS_CODE, tree);
+}
+
+// Writes the generated code's disassembly to CODE_FILE (the VM runs OBJECT_FILE)
+void writeMCode()
+{
+    writeDisassembly(ofp, parseCode, codeIndex);
 }
 
-void program()
+Node* program()
 {
+    Node* main;
+
     getToken();
-    block();
+    main = block(NO_SYMBOL);
     if (token != PERIOD_SYM)
         error(9);
 
-    gen(OPR, 0, 0);
+    return main;
 }
 
-void block()
+Node* block(int procedure)
 {
-    int varCounter = 0, stackPointer = 3, tempStackPointer, codeIndex1 = codeIndex;
-    char symbolName[MAX_IDENTIFIERS_CHAR_LENGTH];
+    int stackPointer = 3;
+    int symbol;
+    Node* node = newNode(NODE_BLOCK);
+    Node** procedures = &node->child[0];
+
+    // Names declared here are only visible inside this block (and blocks nested in it)
+    openScope(&symbols);
 
-    gen(INC, 0, 0);
+    node->symbol = procedure;
+    node->level = getLexLevel();
 
     // Check for constants
     if (token == CONST_SYM)
@@ -107,9 +185,7 @@ void block()
             if (token != IDENT_SYM)
                 error(4);
 
-            tempStackPointer = stackPointer;
-
-            enter(getIdenName(), CONST_SYM, getLexLevel(), stackPointer++);
+            symbol = enter(getIdenName(), CONST_SYM, getLexLevel(), 0);
             
             // Check next token is equal sign
             getToken();
@@ -121,10 +197,8 @@ void block()
             if (token != NUM_SYM)
                 error(2);
 
-            varCounter++;
-
-            gen(LIT, 0, getNumber());
-            gen(STO, 0, tempStackPointer);
+            // Constants take no stack slot, their value is used wherever they are named
+            symbols.symbols[symbol].value = getNumber();
             
             // Get next token and repeat loop if token is a comma
             getToken();
@@ -149,8 +223,6 @@ void block()
                 error(4);
 
             enter(getIdenName(), VAR_SYM, getLexLevel(), stackPointer++);
-
-            varCounter++;
             
             // Get next token and repeat loop if token is a comma
             getToken();
@@ -170,6 +242,9 @@ void block()
         if (token != IDENT_SYM)
             error(6);
         
+        // Its code address is filled in when the block is generated
+        procedure = enter(getIdenName(), PROC_SYM, getLexLevel(), 0);
+        
         getToken();
         if (token != SEMICOLON_SYM)
             error(5);
@@ -177,7 +252,8 @@ void block()
         getToken();
         
         // Recursively call block to read subprocedure's block
-        block();
+        *procedures = block(procedure);
+        procedures = &(*procedures)->next;
         
         if (token != SEMICOLON_SYM)
             error(5);
@@ -185,20 +261,27 @@ void block()
         getToken();
     }
     
-    statement();
+    node->child[1] = statement();
+    node->value = stackPointer;
+
+    closeScope(&symbols);
 
-    parseCode[codeIndex1].M = stackPointer;
+    return node;
 }
 
-void statement()
+// Parses a statement, returns NULL for an empty one
+Node* statement()
 {
-    Symbol foundSymbol;
+    Node* node = NULL;
+    Node** next;
+    int symbol;
+    int span = openSpan();
 
     if (token == IDENT_SYM)
     {
-        foundSymbol = find(getIdenName());
+        symbol = find(getIdenName());
 
-        if (foundSymbol.id == CONST_SYM)
+        if (symbols.symbols[symbol].id != VAR_SYM)
             error(12);
 
         getToken();
@@ -207,9 +290,11 @@ void statement()
             error(13);
         
         getToken();
-        expression();
 
-        gen(STO, 0, foundSymbol.stackPointer);
+        node = newNode(NODE_ASSIGN);
+        node->symbol = symbol;
+        node->level = getLexLevel();
+        node->child[0] = expression();
     }
     
     else if (token == CALL_SYM)
@@ -218,20 +303,35 @@ void statement()
         if (token != IDENT_SYM)
             error(14);
         
+        symbol = find(getIdenName());
+        
+        if (symbols.symbols[symbol].id != PROC_SYM)
+            error(15);
+        
+        node = newNode(NODE_CALL);
+        node->symbol = symbol;
+        node->level = getLexLevel();
+        
         getToken();
     }
     
     else if (token == BEGIN_SYM)
     {
+        node = newNode(NODE_BEGIN);
+        next = &node->child[0];
+
         getToken();
 
-        statement();
+        // Empty statements leave nothing in the list
+        if ((*next = statement()) != NULL)
+            next = &(*next)->next;
 
         while (token == SEMICOLON_SYM)
         {
             getToken();
 
-            statement();
+            if ((*next = statement()) != NULL)
+                next = &(*next)->next;
         }
         
         if (token != END_SYM)
@@ -242,12 +342,12 @@ void statement()
     
     else if (token == IF_SYM)
     {
-        ifBlock();
+        node = ifBlock();
     }
     
     else if (token == WHILE_SYM)
     {
-        whileBlock();
+        node = whileBlock();
     }
 
     else if (token == WRITE_SYM)
@@ -257,11 +357,13 @@ void statement()
         if (token != IDENT_SYM)
             error(14);
 
-        foundSymbol = find(getIdenName());
+        symbol = find(getIdenName());
 
-        gen(LOD, 0, foundSymbol.stackPointer);
+        if (symbols.symbols[symbol].id == PROC_SYM)
+            error(21);
 
-        gen(OUT, 0, 0);
+        node = newNode(NODE_WRITE);
+        node->child[0] = variable(symbol);
 
         getToken();
     }
@@ -272,30 +374,40 @@ void statement()
         if (token != IDENT_SYM)
             error(14);
 
-        foundSymbol = find(getIdenName());
+        symbol = find(getIdenName());
 
-        gen(IN, 0, 0);
+        if (symbols.symbols[symbol].id != VAR_SYM)
+            error(12);
 
-        gen(STO, 0 , foundSymbol.stackPointer);
+        node = newNode(NODE_READ);
+        node->symbol = symbol;
+        node->level = getLexLevel();
 
         getToken();
     } 
+
+    closeSpan(span);
+
+    if (node != NULL)
+        node->span = span;
+
+    return node;
 }
 
-void condition()
+Node* condition()
 {
     int relOperator;
+    Node* left;
 
     if (token == ODD_SYM)
     {
         getToken();
-        expression();
-        gen(OPR, 0, ODD);
+        return newOperator(NODE_UNARY, ODD, expression(), NULL);
     }
 
     else
     {
-        expression();
+        left = expression();
 
         if (!isValidRelationalOperator())
             error(20);
@@ -303,14 +415,14 @@ void condition()
         relOperator = token;
 
         getToken();
-        expression();
-        gen(OPR, 0, mapOPRCode(relOperator));
+        return newOperator(NODE_BINARY, mapOPRCode(relOperator), left, expression());
     }
 }
 
-void expression()
+Node* expression()
 {
     int add_op;
+    Node* node;
 
     if (token == PLUS_SYM || token == MINUS_SYM)
     {
@@ -318,14 +430,14 @@ void expression()
 
         getToken();
 
-        term();
+        node = term();
 
         if (add_op == MINUS_SYM)
-            gen(OPR, 0, NEG);
+            node = newOperator(NODE_UNARY, NEG, node, NULL);
     }
 
     else
-        term();
+        node = term();
     
     while (token == PLUS_SYM || token == MINUS_SYM)
     {
@@ -333,20 +445,21 @@ void expression()
 
         getToken();
 
-        term();
-
         if (add_op == PLUS_SYM)
-            gen(OPR, 0, ADD);
+            node = newOperator(NODE_BINARY, ADD, node, term());
         else
-            gen(OPR, 0, SUB);
+            node = newOperator(NODE_BINARY, SUB, node, term());
     }
+
+    return node;
 }
 
-void term()
+Node* term()
 {
     int mul_op;
+    Node* node;
 
-    factor();
+    node = factor();
 
     while (token == MULT_SYM || token == SLASH_SYM)
     {
@@ -354,32 +467,37 @@ void term()
 
         getToken();
 
-        factor();
-
         if (mul_op == MULT_SYM)
-            gen(OPR, 0, MUL);
+            node = newOperator(NODE_BINARY, MUL, node, factor());
 
         else
-            gen(OPR, 0, DIV);
+            node = newOperator(NODE_BINARY, DIV, node, factor());
     }
+
+    return node;
 }
 
-void factor()
+Node* factor()
 {
-    Symbol foundSymbol;
+    Node* node = NULL;
+    int symbol;
 
     if (token == IDENT_SYM)
     {   
-        foundSymbol = find(getIdenName());
+        symbol = find(getIdenName());
+
+        if (symbols.symbols[symbol].id == PROC_SYM)
+            error(21);
 
-        gen(LOD, 0, foundSymbol.stackPointer);
+        node = variable(symbol);
 
         getToken();
     }
 
     else if (token == NUM_SYM)
     {
-        gen(LIT, 0, getNumber());
+        node = newNode(NODE_NUMBER);
+        node->value = getNumber();
 
         getToken();
     }
@@ -388,7 +506,7 @@ void factor()
     {
         getToken();
 
-        expression();
+        node = expression();
 
         if (token != RPAREN_SYM)
             error(22);
@@ -398,27 +516,68 @@ void factor()
 
     else
         error(24);
+
+    return node;
 }
 
+// Advances to the next token in the buffer (NULL_SYM once past the end)
 void getToken()
 {    
-    char *symbolName;
+    // Still being scanned, wait for more
+    if (tokenIndex >= tokens.count && refillTokens != NULL)
+        refillTokens(&tokens);
+    
+    if (tokenIndex < tokens.count)
+    {
+        currentToken = tokenIndex++;
+        token = tokens.kind[currentToken];
+    }
+    else
+    {
+        currentToken = tokens.count;
+        token = NULL_SYM;
+    }
+}
 
-    fscanf(ifp, "%d", &token);
+// Returns the interned name of the current identifier token
+int getIdenName()
+{
+    return tokens.value[currentToken];
 }
 
-char* getIdenName()
+// Starts recording a span for the statement at the current token (-1 if not recording)
+int openSpan()
 {
-    char buffer[MAX_IDENTIFIERS_CHAR_LENGTH];
-    char *str;
+    if (!recordSpans)
+        return -1;
+
+    if (spanCount == spanCapacity)
+    {
+        spanCapacity = (spanCapacity) ? spanCapacity * 2 : 256;
+        spans = realloc(spans, spanCapacity * sizeof(StatementSpan));
+    }
+
+    spans[spanCount].tokenStart = currentToken;
+    spans[spanCount].scope = symbols.current;
+    spans[spanCount].symbolEnd = symbols.count;
 
-    fscanf(ifp, "%s", buffer);
+    return spanCount++;
+}
 
-    str = malloc ((strlen(buffer) + 1) * sizeof (char));
+// Finishes a statement's span (empty statements are dropped), its code range is
+// filled in when the statement is generated
+void closeSpan(int span)
+{
+    if (span < 0)
+        return;
 
-    strcpy(str, buffer);
+    if (currentToken == spans[span].tokenStart)
+    {
+        spanCount = span;
+        return;
+    }
 
-    return str;
+    spans[span].tokenEnd = currentToken;
 }
 
 int isValidRelationalOperator()
@@ -432,46 +591,72 @@ int isValidRelationalOperator()
     return relationalOperatorCheck;
 }
 
-void enter(char* name, int id, int level, int updatedStackPointer) {
+// Declares a name in the current block's scope, returns its symbol
+int enter(int name, int id, int level, int updatedStackPointer) {
 
-    if (updatedStackPointer > MAX_STACK_HEIGHT)
+    if (id == VAR_SYM && updatedStackPointer > MAX_STACK_HEIGHT)
         error(28);
 
-    symbolTable[nextSymbolIndex].name = name;
-    symbolTable[nextSymbolIndex].id = id;
-    symbolTable[nextSymbolIndex].level = level;
-    symbolTable[nextSymbolIndex].stackPointer = updatedStackPointer;
-
-    nextSymbolIndex++;
+    return enterSymbol(&symbols, name, id, level, updatedStackPointer);
 }
 
 void gen(int OP, int L, int M) {
-    if (codeIndex > MAX_CODE_LENGTH)
+    if (codeIndex == codeCapacity)
+        reserveCode(codeIndex + 1);
+
+    parseCode[codeIndex].OP = OP;
+    parseCode[codeIndex].L = L;
+    parseCode[codeIndex].M = M;
+
+    codeIndex++;
+}
+
+// Makes room for at least count instructions, doubling the code array as needed
+void reserveCode(int count)
+{
+    int capacity = (codeCapacity) ? codeCapacity : CODE_INITIAL_CAPACITY;
+
+    if (count > MAX_CODE_LENGTH)
         error(27);
 
-    else
-    {
-        parseCode[codeIndex].OP = OP;
-        parseCode[codeIndex].L = L;
-        parseCode[codeIndex].M = M;
+    if (count <= codeCapacity)
+        return;
 
-        codeIndex++;
-    }
+    while (capacity < count)
+        capacity = (capacity > MAX_CODE_LENGTH / 2) ? MAX_CODE_LENGTH : capacity * 2;
+
+    parseCode = realloc(parseCode, capacity * sizeof(Instruction));
+    codeCapacity = capacity;
 }
 
-Symbol find(char* symbolName) {
+// Returns the innermost declaration of a name visible from the current block
+int find(int name) {
+
+    int i = findSymbol(&symbols, name);
+
+    if (i == NO_SYMBOL)
+        error(11);
+
+    return i;
+}
 
-    int i;
+// Returns a node reading a variable from the current block, or the value of a constant
+Node* variable(int symbol)
+{
+    Node* node;
 
-    for (i = 0; i < nextSymbolIndex; i++) 
+    if (symbols.symbols[symbol].id == CONST_SYM)
     {
-        if (strcmp(symbolName, symbolTable[i].name) == 0)
-        {
-            return symbolTable[i];
-        }
+        node = newNode(NODE_NUMBER);
+        node->value = symbols.symbols[symbol].value;
+        return node;
     }
 
-    error(11);
+    node = newNode(NODE_VARIABLE);
+    node->symbol = symbol;
+    node->level = getLexLevel();
+
+    return node;
 }
 
 void symboltype() {
@@ -482,65 +667,52 @@ void symbollevel() {
 
 }
 
+// Returns the value of the current number token
 int getNumber()
 {    
-    int num;
-
-    if (token == NUM_SYM)
-        fscanf(ifp, "%d", &num);
-
-    return num;
+    return tokens.value[currentToken];
 }
 
+// Returns the lexical level of the block being parsed (0 for the main block)
 int getLexLevel()
 {
-    return 0;
+    return scopeLevel(&symbols);
 }
 
-void whileBlock()
+Node* whileBlock()
 {
-    int codeIndex1 = codeIndex, codeIndex2;
+    Node* node = newNode(NODE_WHILE);
 
     getToken();
 
-    condition();
-
-    codeIndex2 = codeIndex;
-
-    gen(JPC, 0, 0);
+    node->child[0] = condition();
     
     if (token != DO_SYM)
         error(18);
     
     getToken();
 
-    statement();
+    node->child[1] = statement();
 
-    gen(JMP, 0, codeIndex1);
-
-    parseCode[codeIndex2].M = codeIndex;
+    return node;
 }
 
-void ifBlock()
+Node* ifBlock()
 {
-    int codeIndex1;
+    Node* node = newNode(NODE_IF);
 
     getToken();
 
-    condition();
+    node->child[0] = condition();
     
     if (token != THEN_SYM)
         error(16);
     
     getToken();
 
-    codeIndex1 = codeIndex;
-
-    gen(JPC, 0, 0);
-
-    statement();
+    node->child[1] = statement();
 
-    parseCode[codeIndex1].M = codeIndex;
+    return node;
 }
 
 // Maps PL0 Language Symbols to PM0 Machine Codes (Required due to inconsistencies in given tables)
@@ -567,97 +739,100 @@ int mapOPRCode(int token)
     }
 }
 
+// Reports a parse error at the current token. Compiling through compiler.h it is
+// recorded in errorDiagnostic and unwinds to errorRecovery, otherwise it is
+// printed and ends the process with status 1.
 void error(int err_id)
+{
+    int line = 0, column = 0, offset = -1;
+
+    // Point at the offending token when the source text is loaded
+    if (tokenSource.text != NULL && currentToken >= 0)
+    {
+        offset = (currentToken < tokens.count) ? (int) tokens.offset[currentToken] : tokenSource.length;
+        sourceLocation(&tokenSource, offset, &line, &column);
+    }
+
+    if (errorRecovery != NULL)
+    {
+        errorDiagnostic.code = err_id;
+        errorDiagnostic.offset = offset;
+        errorDiagnostic.line = line;
+        errorDiagnostic.column = column;
+        errorDiagnostic.message = errorMessage(err_id);
+        longjmp(*errorRecovery, 1);
+    }
+
+    if (offset >= 0)
+        printf("Line %d, column %d: ", line, column);
+
+    printf("%s\n", errorMessage(err_id));
+    exit(1);
+}
+
+// Returns the message for a parse error number
+const char* errorMessage(int err_id)
 {
     switch(err_id)
     {
         case 1:
-            printf("Use = instead of :=\n");
-            exit(0);
+            return "Use = instead of :=";
         case 2:
-            printf("= must be followed by a number.\n");
-            exit(0);
+            return "= must be followed by a number.";
         case 3:
-            printf("Identifier must be followed by =.\n");
-            exit(0);
+            return "Identifier must be followed by =.";
         case 4:
-            printf("const, var, procedure must be followed by identifier.\n");
-            exit(0);
+            return "const, var, procedure must be followed by identifier.";
         case 5:
-            printf("Semicolon or comma missing.\n");
-            exit(0);
+            return "Semicolon or comma missing.";
         case 6:
-            printf("Incorrect symbol after procedure declaration.\n");
-            exit(0);
+            return "Incorrect symbol after procedure declaration.";
         case 7:
-            printf("Statement expected.\n");
-            exit(0);
+            return "Statement expected.";
         case 8:
-            printf("Incorrect symbol after statement part in block.\n");
-            exit(0);
+            return "Incorrect symbol after statement part in block.";
         case 9:
-            printf("Period expected.\n");
-            exit(0);
+            return "Period expected.";
         case 10:
-            printf("Semicolon between statements missing.\n");
-            exit(0);
+            return "Semicolon between statements missing.";
         case 11:
-            printf("Undeclared identifier.\n");
-            exit(0);
+            return "Undeclared identifier.";
         case 12:
-            printf("Assignment to constant or procedure is not allowed.\n");
-            exit(0);
+            return "Assignment to constant or procedure is not allowed.";
         case 13:
-            printf("Assignment operator expected.\n");
-            exit(0);
+            return "Assignment operator expected.";
         case 14:
-            printf("Call must be followed by an identifier.\n");
-            exit(0);
+            return "Call must be followed by an identifier.";
         case 15:
-            printf("Call of a constant or variable is meaningless.\n");
-            exit(0);
+            return "Call of a constant or variable is meaningless.";
         case 16:
-            printf("then expected.\n");
-            exit(0);
+            return "then expected.";
         case 17:
-            printf("Semicolon or } expected.\n");
-            exit(0);
+            return "Semicolon or } expected.";
         case 18:
-            printf("do expected.\n");
-            exit(0);
+            return "do expected.";
         case 19:
-            printf("Incorrect symbol following statement.\n");
-            exit(0);
+            return "Incorrect symbol following statement.";
         case 20:
-            printf("Relational operator expected.\n");
-            exit(0);
+            return "Relational operator expected.";
         case 21:
-            printf("Expression must not contain a procedure identifier.\n");
-            exit(0);
+            return "Expression must not contain a procedure identifier.";
         case 22:
-            printf("Right parenthesis missing.\n");
-            exit(0);
+            return "Right parenthesis missing.";
         case 23:
-            printf("The preceding factor cannot begin with this symbol.\n");
-            exit(0);
+            return "The preceding factor cannot begin with this symbol.";
         case 24:
-            printf("An expression cannot begin with this symbol.\n");
-            exit(0);
+            return "An expression cannot begin with this symbol.";
         case 25:
-            printf("This number is too large.\n");
-            exit(0);
+            return "This number is too large.";
         case 26:
-            printf("end expected.\n");
-            exit(0);
+            return "end expected.";
         case 27:
-            printf("Code length too long.\n");
-            exit(0);
+            return "Code length too long.";
         case 28:
-            printf("Stack Overflow! Stack can't be larger than the MAX_STACK_HEIGHT\n");
-            exit(0);
+            return "Stack Overflow! Stack can't be larger than the MAX_STACK_HEIGHT";
         default:
-            printf("Undefined error message.\n");
-            exit(0);
+            return "Undefined error message.";
     }
 }
 
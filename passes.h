@@ -0,0 +1,154 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "structs.h"
+#include "ast.h"
+#include "fold.h"
+#include "prune.h"
+#include "inline.h"
+#include "strength.h"
+#include "peephole.h"
+#include "tailcall.h"
+#include "superinstr.h"
+#include "ir.h"
+#include "propagate.h"
+#include "licm.h"
+#include "induction.h"
+#include "deadstore.h"
+#include "lower.h"
+
+// Pass manager. Passes run in table order: tree passes between parsing and code
+// generation, code passes over parseCode afterwards. From IR_LEVEL the tree is
+// built into SSA (ir.h) and the IR passes run on that before it is lowered to
+// PM/0. Each pass runs when the optimization level (-O0, -O1, -O2) is at least
+// its level, and returns how many changes it made. Nothing runs while statement
+// spans are recorded, since the incremental front end relies on each statement's
+// code staying where codegen put it.
+
+#define PASS_TREE 0
+#define PASS_IR 1
+#define PASS_CODE 2
+
+// Level from which code is generated through the SSA IR
+#define IR_LEVEL 2
+
+// A pass level no -O reaches, to switch a pass off
+#define PASS_OFF 99
+
+// PROTOTYPES
+void runPasses(int stage, Node* program);
+Pass* findPass(const char* name);
+void printPassTimes();
+double passClock();
+
+// GLOBALS
+THREAD_LOCAL int optimizeLevel = 0;
+THREAD_LOCAL double parseSeconds = 0;
+THREAD_LOCAL double buildSeconds = 0;
+THREAD_LOCAL double generateSeconds = 0;
+
+THREAD_LOCAL Pass passes[] =
+{
+    { "inline-procedures", PASS_TREE, 2, inlineProcedures, 0, 0 },
+    { "fold-constants", PASS_TREE, 1, foldConstants, 0, 0 },
+    { "prune-empty", PASS_TREE, 1, pruneEmpty, 0, 0 },
+    { "reduce-strength", PASS_TREE, 1, reduceStrength, 0, 0 },
+    { "propagate", PASS_IR, 2, propagateValues, 0, 0 },
+    { "hoist-invariants", PASS_IR, 2, hoistInvariants, 0, 0 },
+    { "reduce-inductions", PASS_IR, 2, reduceInductions, 0, 0 },
+    { "dead-stores", PASS_IR, 2, eliminateDeadStores, 0, 0 },
+    { "peephole", PASS_CODE, 1, peepholeOptimize, 0, 0 },
+    { "tail-calls", PASS_CODE, 1, eliminateTailCalls, 0, 0 },
+    { "superinstructions", PASS_CODE, 2, selectSuperinstructions, 0, 0 },
+};
+
+#define PASS_COUNT ((int) (sizeof(passes) / sizeof(Pass)))
+
+// Runs the passes of a stage enabled at the current optimization level, timing each
+void runPasses(int stage, Node* program)
+{
+    double start;
+    int i;
+
+    for (i = 0; i < PASS_COUNT; i++)
+    {
+        if (passes[i].stage != stage)
+            continue;
+
+        passes[i].changes = 0;
+        passes[i].seconds = 0;
+
+        if (passes[i].level > optimizeLevel || recordSpans)
+            continue;
+
+        start = passClock();
+        passes[i].changes = passes[i].run(program);
+        passes[i].seconds = passClock() - start;
+    }
+}
+
+// Returns the pass with a name, NULL if there is none
+Pass* findPass(const char* name)
+{
+    int i;
+
+    for (i = 0; i < PASS_COUNT; i++)
+    {
+        if (strcmp(passes[i].name, name) == 0)
+            return &passes[i];
+    }
+
+    return NULL;
+}
+
+// Prints the time spent parsing, in each pass that ran and generating code
+void printPassTimes()
+{
+    int i;
+
+    printf("%-20s%10s%12s\n", "phase", "changes", "ms");
+    printf("%-20s%10s%12.3f\n", "parse", "-", parseSeconds * 1000);
+
+    for (i = 0; i < PASS_COUNT; i++)
+    {
+        if (passes[i].stage == PASS_TREE && passes[i].level <= optimizeLevel)
+            printf("%-20s%10d%12.3f\n", passes[i].name, passes[i].changes, passes[i].seconds * 1000);
+    }
+
+    if (optimizeLevel >= IR_LEVEL)
+    {
+        printf("%-20s%10s%12.3f\n", "build-ssa", "-", buildSeconds * 1000);
+
+        for (i = 0; i < PASS_COUNT; i++)
+        {
+            if (passes[i].stage == PASS_IR && passes[i].level <= optimizeLevel)
+                printf("%-20s%10d%12.3f\n", passes[i].name, passes[i].changes, passes[i].seconds * 1000);
+        }
+    }
+
+    printf("%-20s%10s%12.3f\n", "codegen", "-", generateSeconds * 1000);
+
+    for (i = 0; i < PASS_COUNT; i++)
+    {
+        if (passes[i].stage == PASS_CODE && passes[i].level <= optimizeLevel)
+            printf("%-20s%10d%12.3f\n", passes[i].name, passes[i].changes, passes[i].seconds * 1000);
+    }
+}
+
+// Returns a monotonic wall clock reading in seconds
+double passClock()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdlib.h>
+
+#include "structs.h"
+#include "symtab.h"
+#include "pm0_constants.h"
+
+// Code pass over parseCode, run after code generation and before writeMCode().
+// Each round it
+//
+//   - threads jumps: a JMP or JPC to a JMP goes straight to its target
+//   - drops instructions no path from address 0 reaches (after a JMP or a RET)
+//   - drops a JMP to the very next instruction
+//   - drops windows from the table below, which leave the stack as they found it
+//
+// then closes the gaps, renumbering jump, call & procedure addresses. A window is
+// only removed when no jump lands inside it. The output uses the plain PM/0
+// instruction set. STO x; LOD x on its own would need a dup instruction, so the
+// reload is only removed when it is stored straight back (LOD x; STO x).
+
+#define PEEP_ANY -1
+#define PEEP_MAX_WINDOW 3
+#define PEEP_MAX_ROUNDS 8
+
+// A window of instructions (OP & M, PEEP_ANY matching any M) that does nothing;
+// sameOperand windows also need every instruction's L & M to be equal
+typedef struct
+{
+    char* name;
+    int length;
+    int sameOperand;
+    int op[PEEP_MAX_WINDOW];
+    int m[PEEP_MAX_WINDOW];
+
+} PeepholeRule;
+
+// PROTOTYPES
+int peepholeOptimize(Node* program);
+int threadJumps();
+int removeInstructions();
+void markReachable(char* reachable);
+int matchWindow(PeepholeRule* rule, int at, char* removed, char* target);
+void compactCode(char* removed);
+int isJump(Instruction* instruction);
+
+// GLOBALS
+PeepholeRule peepholeRules[] =
+{
+    { "add 0",          2, 0, { LIT, OPR }, { 0, ADD } },
+    { "subtract 0",     2, 0, { LIT, OPR }, { 0, SUB } },
+    { "multiply by 1",  2, 0, { LIT, OPR }, { 1, MUL } },
+    { "divide by 1",    2, 0, { LIT, OPR }, { 1, DIV } },
+    { "double negate",  2, 0, { OPR, OPR }, { NEG, NEG } },
+    { "store reload",   2, 1, { LOD, STO }, { PEEP_ANY, PEEP_ANY } },
+};
+
+#define PEEPHOLE_RULE_COUNT ((int) (sizeof(peepholeRules) / sizeof(PeepholeRule)))
+
+// Runs rounds until nothing changes, returns how many instructions were removed
+int peepholeOptimize(Node* program)
+{
+    int total = 0, round, threaded, removed;
+
+    (void) program;
+
+    for (round = 0; round < PEEP_MAX_ROUNDS; round++)
+    {
+        threaded = threadJumps();
+        removed = removeInstructions();
+        total += removed;
+
+        if (threaded == 0 && removed == 0)
+            break;
+    }
+
+    return total;
+}
+
+// Points jumps that land on a JMP at its final target, returns how many moved
+int threadJumps()
+{
+    int i, hops, target, moved = 0;
+
+    for (i = 0; i < codeIndex; i++)
+    {
+        if (parseCode[i].OP != JMP && parseCode[i].OP != JPC)
+            continue;
+
+        target = parseCode[i].M;
+
+        // Give up on cycles of jumps (an empty infinite loop)
+        for (hops = 0; hops < codeIndex && target >= 0 && target < codeIndex &&
+                       parseCode[target].OP == JMP && parseCode[target].M != target; hops++)
+            target = parseCode[target].M;
+
+        if (target != parseCode[i].M && hops < codeIndex)
+        {
+            parseCode[i].M = target;
+            moved++;
+        }
+    }
+
+    return moved;
+}
+
+// Marks unreachable code, jumps to the next instruction & table windows, then
+// removes them -- returns how many instructions went
+int removeInstructions()
+{
+    char* removed = calloc(codeIndex + 1, 1);
+    char* reachable = calloc(codeIndex + 1, 1);
+    char* target = calloc(codeIndex + 1, 1);
+    int i, j, rule, count = 0;
+
+    markReachable(reachable);
+
+    for (i = 0; i < codeIndex; i++)
+    {
+        if (isJump(&parseCode[i]) && parseCode[i].M >= 0 && parseCode[i].M < codeIndex)
+            target[parseCode[i].M] = 1;
+
+        if (!reachable[i] || (parseCode[i].OP == JMP && parseCode[i].M == i + 1))
+            removed[i] = 1;
+    }
+
+    // Table windows, left to right without overlapping
+    for (i = 0; i < codeIndex; i++)
+    {
+        for (rule = 0; rule < PEEPHOLE_RULE_COUNT; rule++)
+        {
+            if (!matchWindow(&peepholeRules[rule], i, removed, target))
+                continue;
+
+            for (j = 0; j < peepholeRules[rule].length; j++)
+                removed[i + j] = 1;
+
+            i += peepholeRules[rule].length - 1;
+            break;
+        }
+    }
+
+    for (i = 0; i < codeIndex; i++)
+        count += removed[i];
+
+    if (count)
+        compactCode(removed);
+
+    free(removed);
+    free(reachable);
+    free(target);
+
+    return count;
+}
+
+// Marks every instruction some path from address 0 can reach
+void markReachable(char* reachable)
+{
+    int* pending = malloc((codeIndex + 1) * sizeof(int));
+    int count = 0, i, next[2], j;
+
+    if (codeIndex > 0)
+    {
+        reachable[0] = 1;
+        pending[count++] = 0;
+    }
+
+    while (count > 0)
+    {
+        i = pending[--count];
+        next[0] = i + 1;
+        next[1] = -1;
+
+        if (parseCode[i].OP == JMP || parseCode[i].OP == TCA)
+            next[0] = parseCode[i].M;
+        else if (parseCode[i].OP == OPR && parseCode[i].M == RET)
+            next[0] = -1;
+        else if (parseCode[i].OP == JPC || parseCode[i].OP == CAL)
+            next[1] = parseCode[i].M;
+
+        for (j = 0; j < 2; j++)
+        {
+            if (next[j] >= 0 && next[j] < codeIndex && !reachable[next[j]])
+            {
+                reachable[next[j]] = 1;
+                pending[count++] = next[j];
+            }
+        }
+    }
+
+    free(pending);
+}
+
+// Returns whether a rule's window matches the (still present) code at an address
+// with no jump landing past its first instruction
+int matchWindow(PeepholeRule* rule, int at, char* removed, char* target)
+{
+    int j;
+
+    if (at + rule->length > codeIndex)
+        return 0;
+
+    for (j = 0; j < rule->length; j++)
+    {
+        if (removed[at + j] || (j > 0 && target[at + j]))
+            return 0;
+
+        if (parseCode[at + j].OP != rule->op[j])
+            return 0;
+
+        if (rule->m[j] != PEEP_ANY && parseCode[at + j].M != rule->m[j])
+            return 0;
+
+        if (rule->sameOperand && (parseCode[at + j].L != parseCode[at].L || parseCode[at + j].M != parseCode[at].M))
+            return 0;
+    }
+
+    return 1;
+}
+
+// Closes up the removed instructions. An address that pointed at a removed one
+// now points at the next instruction kept.
+void compactCode(char* removed)
+{
+    int* address = malloc((codeIndex + 1) * sizeof(int));
+    int i, kept = 0;
+
+    for (i = 0; i <= codeIndex; i++)
+    {
+        address[i] = kept;
+
+        if (i < codeIndex && !removed[i])
+            kept++;
+    }
+
+    for (i = 0; i < codeIndex; i++)
+    {
+        if (isJump(&parseCode[i]) && parseCode[i].M >= 0 && parseCode[i].M <= codeIndex)
+            parseCode[i].M = address[parseCode[i].M];
+    }
+
+    for (i = 0; i < symbols.count; i++)
+    {
+        if (symbols.symbols[i].id == PROC_SYM && symbols.symbols[i].stackPointer <= codeIndex)
+            symbols.symbols[i].stackPointer = address[symbols.symbols[i].stackPointer];
+    }
+
+    for (i = 0; i < codeIndex; i++)
+    {
+        if (!removed[i])
+            parseCode[address[i]] = parseCode[i];
+    }
+
+    codeIndex = kept;
+    free(address);
+}
+
+// Returns whether an instruction's M is a code address
+int isJump(Instruction* instruction)
+{
+    return instruction->OP == JMP || instruction->OP == JPC || instruction->OP == CAL || instruction->OP == TCA;
+}
+
+#endif
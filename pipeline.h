@@ -0,0 +1,239 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "structs.h"
+#include "intern.h"
+#include "tokens.h"
+#include "scan.h"
+#include "parse.h"
+
+#ifdef HAVE_PTHREADS
+#include <sched.h>
+#endif
+
+// Pipelined scan & parse. Rather than scanning the whole file before parsing starts,
+// a scanner thread pushes tokens into a single producer / single consumer ring and
+// the parser pulls them out whenever getToken() runs dry, so lexing and parsing
+// overlap. The ring takes no locks: only the scanner moves tail and only the parser
+// moves head, each publishing its index with a release store the other side reads
+// with an acquire load (and caching the other's index until it looks full / empty).
+// The scanner thread is the only one interning names until it has been joined;
+// it takes its cursor, the name table and the skip kernel from the ring, since
+// the parser thread's globals are its own.
+// Without threads the parser's refill lexes the next batch itself, generator style.
+// Either way the token buffer ends up as scan() would leave it; a scan error is
+// reported when the parser reaches it rather than before parsing.
+
+#define TOKEN_RING_SIZE 4096
+#define TOKEN_BATCH 256
+
+// PROTOTYPES
+void scanAndParse();
+void startPipeline();
+void finishPipeline();
+int pullTokens(TokenBuffer* buffer);
+void nextTokenRecord(Source* cursor, InternTable* names, TokenRecord* record);
+void endPipeline(TokenRecord* record);
+void* scanPipeline(void* ring);
+
+// GLOBALS
+THREAD_LOCAL TokenRing tokenRing;
+THREAD_LOCAL int pipelineDone = 0;
+#ifdef HAVE_PTHREADS
+THREAD_LOCAL pthread_t pipelineScanner;
+#endif
+
+// Scans & parses INPUT_FILE with the two overlapping, leaving the same token file,
+// lexeme dumps & code behind as scan() followed by parse()
+void scanAndParse()
+{
+    startPipeline();
+    parse();
+    finishPipeline();
+
+    writeScanOutputs();
+}
+
+// Loads INPUT_FILE and starts feeding its tokens to the parser
+void startPipeline()
+{
+    if (!loadSource(&tokenSource, INPUT_FILE))
+        printf("%s: %s\n", INPUT_FILE, loadFailure());
+
+    tokens.count = 0;
+    scanError = 0;
+    scanErrorOffset = 0;
+
+    if (skipKernel == SKIP_UNSET)
+        skipKernel = selectSkipKernel();
+
+    tokenRing.cursor = tokenSource;
+    tokenRing.names = &identifiers;
+    tokenRing.skipKernel = skipKernel;
+    pipelineDone = 0;
+    refillTokens = pullTokens;
+
+#ifdef HAVE_PTHREADS
+    tokenRing.slots = malloc(TOKEN_RING_SIZE * sizeof(TokenRecord));
+    tokenRing.mask = TOKEN_RING_SIZE - 1;
+    tokenRing.head = 0;
+    tokenRing.tail = 0;
+    tokenRing.cachedHead = 0;
+    tokenRing.cachedTail = 0;
+
+    pthread_create(&pipelineScanner, NULL, scanPipeline, &tokenRing);
+#endif
+}
+
+// Takes in whatever the parser left unread (tokens after the final period), then
+// waits for the scanner thread
+void finishPipeline()
+{
+    while (pullTokens(&tokens))
+        ;
+
+#ifdef HAVE_PTHREADS
+    pthread_join(pipelineScanner, NULL);
+    free(tokenRing.slots);
+    tokenRing.slots = NULL;
+#endif
+}
+
+// The parser's refill: appends the tokens scanned so far, waiting for at least one
+// -- returns 0 once every token has been handed over
+int pullTokens(TokenBuffer* buffer)
+{
+    int count = buffer->count;
+    TokenRecord* record;
+#ifdef HAVE_PTHREADS
+    unsigned int head = tokenRing.head;
+#else
+    TokenRecord next;
+    int i;
+#endif
+
+    if (pipelineDone)
+        return 0;
+
+#ifdef HAVE_PTHREADS
+    // Wait for the scanner to publish something
+    while (head == tokenRing.cachedTail)
+    {
+        tokenRing.cachedTail = __atomic_load_n(&tokenRing.tail, __ATOMIC_ACQUIRE);
+
+        if (head == tokenRing.cachedTail)
+            sched_yield();
+    }
+
+    // Take everything published, then hand the slots back in one store
+    for (; head != tokenRing.cachedTail && !pipelineDone; head++)
+    {
+        record = &tokenRing.slots[head & tokenRing.mask];
+
+        if (record->kind == 0)
+            endPipeline(record);
+        else
+            appendToken(buffer, record->kind, record->offset, record->length, record->value);
+    }
+
+    __atomic_store_n(&tokenRing.head, head, __ATOMIC_RELEASE);
+#else
+    // Lex the next batch right here
+    record = &next;
+
+    for (i = 0; i < TOKEN_BATCH && !pipelineDone; i++)
+    {
+        nextTokenRecord(&tokenRing.cursor, tokenRing.names, record);
+
+        if (record->kind == 0)
+            endPipeline(record);
+        else
+            appendToken(buffer, record->kind, record->offset, record->length, record->value);
+    }
+#endif
+
+    return buffer->count > count;
+}
+
+// Lexes the next token from cursor into record, interning identifiers in names. At
+// the end of the text (or an error) the record's kind is 0, with the error code as
+// its value.
+void nextTokenRecord(Source* cursor, InternTable* names, TokenRecord* record)
+{
+    Token token;
+
+    getNextToken(cursor, &token);
+
+    record->offset = token.value - cursor->text;
+    record->length = token.length;
+
+    if (token.endOfFile == EOF || token.error)
+    {
+        record->kind = 0;
+        record->value = token.error;
+    }
+    else
+    {
+        record->kind = token.id;
+        record->value = (token.id == IDENT_SYM) ? intern(names, token.value, token.length) : token.number;
+    }
+}
+
+// Stops refilling once the last record arrives, reporting a scan error if it holds one
+void endPipeline(TokenRecord* record)
+{
+    int line, column;
+
+    pipelineDone = 1;
+    refillTokens = NULL;
+
+    scanError = record->value;
+    scanErrorOffset = (scanError) ? (int) record->offset : 0;
+
+    if (scanError)
+    {
+        sourceLocation(&tokenSource, scanErrorOffset, &line, &column);
+        printError(scanError, line, column);
+    }
+}
+
+#ifdef HAVE_PTHREADS
+
+// Scanner thread -- pushes records into the ring up to and including the last one
+void* scanPipeline(void* ring)
+{
+    TokenRing* r = ring;
+    TokenRecord record;
+    unsigned int tail = 0;
+
+    skipKernel = r->skipKernel;
+
+    do
+    {
+        nextTokenRecord(&r->cursor, r->names, &record);
+
+        // Wait for the parser to free a slot
+        while (tail - r->cachedHead == TOKEN_RING_SIZE)
+        {
+            r->cachedHead = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+            if (tail - r->cachedHead == TOKEN_RING_SIZE)
+                sched_yield();
+        }
+
+        r->slots[tail & r->mask] = record;
+        tail++;
+
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+    } while (record.kind != 0);
+
+    return NULL;
+}
+
+#endif
+
+#endif
@@ -36,9 +36,4 @@
 #define READ_SYM 32
 #define ELSE_SYM 33
 
-#define NOT_SET 0
-#define ALPHA 1
-#define NUMBER 2
-#define SYMBOL 3
-
 #endif
\ No newline at end of file
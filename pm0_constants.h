@@ -13,6 +13,17 @@
 #define OUT 9
 #define IN 10
 
+// Superinstructions (fused windows picked by superinstr.h)
+#define LLO 11  // LOD a; LOD b; OPR op
+#define LCO 12  // LOD a; LIT c; OPR op
+#define LLB 13  // LOD a; LOD b; OPR op; JPC t
+#define LCB 14  // LOD a; LIT c; OPR op; JPC t
+#define ADI 15  // LOD x; LIT c; OPR ADD; STO x
+#define LST 16  // LIT c; STO x
+
+// Tail call (selected by tailcall.h)
+#define TCA 17  // CAL reusing the caller's frame: CAL L a; OPR RET
+
 // M Values (for OP = OPR)
 #define RET 0
 #define NEG 1
@@ -28,5 +39,8 @@
 #define LEQ 11
 #define GTR 12
 #define GEQ 13
+#define SHL 14  // shift left
+#define SHR 15  // arithmetic shift right, rounding toward zero like DIV
+#define AND 16  // bitwise and
 
 #endif
\ No newline at end of file
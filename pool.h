@@ -0,0 +1,178 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <pthread.h>
+#define HAVE_PTHREADS 1
+#endif
+
+#include "structs.h"
+
+// Work stealing thread pool for a fixed set of jobs numbered 0 .. count - 1.
+// Each worker owns a range of job numbers, packed (begin low, end high) into one
+// 64 bit word so it is only ever changed with a compare & swap: the owner takes
+// jobs one at a time off the front, and a worker that runs dry steals the back
+// half of another's range and makes it its own. Jobs start out split evenly, so
+// stealing only kicks in when some jobs take much longer than others; a worker
+// finishes once it finds nothing left to steal. Every job runs exactly once, on
+// whichever worker took it.
+
+#define MAX_POOL_THREADS 64
+
+#define POOL_RANGE(begin, end) (((unsigned long long) (unsigned int) (end) << 32) | (unsigned int) (begin))
+#define POOL_BEGIN(range) ((int) ((range) & 0xffffffffu))
+#define POOL_END(range) ((int) ((range) >> 32))
+
+// PROTOTYPES
+int runPool(int jobs, int threads, void (*run)(void* context, int job, int worker),
+            void (*finish)(void* context, int worker), void* context);
+void* poolThread(void* worker);
+int takeJob(PoolWorker* worker);
+int stealJobs(PoolWorker* thief);
+int poolThreadCount(int threads, int jobs);
+
+// Runs jobs on a number of workers (0: one per core), calling run for each job
+// and then finish (if given) on each worker as it runs out -- returns how many
+// steals it took
+int runPool(int jobs, int threads, void (*run)(void* context, int job, int worker),
+            void (*finish)(void* context, int worker), void* context)
+{
+    PoolWorker workers[MAX_POOL_THREADS];
+    WorkPool pool;
+    int i, steals = 0;
+#ifdef HAVE_PTHREADS
+    pthread_t handles[MAX_POOL_THREADS];
+#endif
+
+    threads = poolThreadCount(threads, jobs);
+
+    pool.workers = workers;
+    pool.count = threads;
+    pool.run = run;
+    pool.finish = finish;
+    pool.context = context;
+
+    // Even, contiguous shares to start with
+    for (i = 0; i < threads; i++)
+    {
+        memset(&workers[i], 0, sizeof(PoolWorker));
+        workers[i].range = POOL_RANGE((long long) jobs * i / threads, (long long) jobs * (i + 1) / threads);
+        workers[i].pool = &pool;
+        workers[i].index = i;
+    }
+
+#ifdef HAVE_PTHREADS
+    for (i = 0; i < threads; i++)
+        pthread_create(&handles[i], NULL, poolThread, &workers[i]);
+
+    for (i = 0; i < threads; i++)
+        pthread_join(handles[i], NULL);
+#else
+    poolThread(&workers[0]);
+#endif
+
+    for (i = 0; i < threads; i++)
+        steals += workers[i].steals;
+
+    return steals;
+}
+
+// Worker loop -- runs its own jobs, then stolen ones, until there are none left
+void* poolThread(void* worker)
+{
+    PoolWorker* self = worker;
+    WorkPool* pool = self->pool;
+    int job;
+
+    for (;;)
+    {
+        job = takeJob(self);
+
+        if (job < 0)
+        {
+            if (!stealJobs(self))
+                break;
+
+            continue;
+        }
+
+        pool->run(pool->context, job, self->index);
+    }
+
+    if (pool->finish != NULL)
+        pool->finish(pool->context, self->index);
+
+    return NULL;
+}
+
+// Takes the job at the front of a worker's range, returns -1 if it is empty
+int takeJob(PoolWorker* worker)
+{
+    unsigned long long range = __atomic_load_n(&worker->range, __ATOMIC_ACQUIRE);
+
+    while (POOL_BEGIN(range) < POOL_END(range))
+    {
+        if (__atomic_compare_exchange_n(&worker->range, &range, POOL_RANGE(POOL_BEGIN(range) + 1, POOL_END(range)),
+                                        0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return POOL_BEGIN(range);
+    }
+
+    return -1;
+}
+
+// Moves the back half of the first other worker's range found non empty into the
+// thief's own (empty) range, returns 0 if every range was empty
+int stealJobs(PoolWorker* thief)
+{
+    WorkPool* pool = thief->pool;
+    PoolWorker* victim;
+    unsigned long long range;
+    int i, begin, end, split;
+
+    for (i = 1; i < pool->count; i++)
+    {
+        victim = &pool->workers[(thief->index + i) % pool->count];
+        range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+
+        while ((begin = POOL_BEGIN(range)) < (end = POOL_END(range)))
+        {
+            // The bigger half when it is odd, so a single job can be stolen
+            split = end - (end - begin + 1) / 2;
+
+            if (__atomic_compare_exchange_n(&victim->range, &range, POOL_RANGE(begin, split),
+                                            0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                __atomic_store_n(&thief->range, POOL_RANGE(split, end), __ATOMIC_RELEASE);
+                thief->steals++;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Returns how many workers to run jobs on (never more than there are jobs)
+int poolThreadCount(int threads, int jobs)
+{
+#ifdef HAVE_PTHREADS
+    if (threads <= 0)
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (threads > MAX_POOL_THREADS)
+        threads = MAX_POOL_THREADS;
+
+    if (threads > jobs)
+        threads = jobs;
+#else
+    threads = 1;
+#endif
+
+    return (threads < 1) ? 1 : threads;
+}
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef PROPAGATE_H
+#define PROPAGATE_H
+
+#include <stdlib.h>
+
+#include "structs.h"
+#include "ir.h"
+#include "fold.h"
+#include "pm0_constants.h"
+
+// IR pass propagating constants through the whole of each function (sparse
+// conditional constant propagation, Wegman & Zadeck). Each value starts unknown
+// and is lowered to a constant, or to "varies", only as the blocks that compute it
+// are found reachable -- a branch on a known condition only reaches one side, and
+// a phi only meets the operands of edges that can be taken. Afterwards known values
+// become constants, known branches jumps, and blocks never reached are dropped.
+// Copies need no propagating: in SSA an assignment of a variable is its value.
+
+#define LATTICE_UNKNOWN 0
+#define LATTICE_CONSTANT 1
+#define LATTICE_VARIES 2
+
+// PROTOTYPES
+int propagateValues(Node* program);
+int propagateFunction(IRFunction* fn);
+int evaluateValue(IRFunction* fn, int value, char* lattice, int* constant, char* taken);
+int edgeTaken(IRFunction* fn, char* taken, int from, int to);
+int takeEdge(IRFunction* fn, char* taken, char* reachable, int from, int succ);
+void dropBlock(IRFunction* fn, int block);
+
+// Propagates through every function, returns how many values & branches became known
+int propagateValues(Node* program)
+{
+    int i, changes = 0;
+
+    (void) program;
+
+    for (i = 0; i < irFunctionCount; i++)
+    {
+        if (!irFunctions[i].failed)
+            changes += propagateFunction(&irFunctions[i]);
+    }
+
+    return changes;
+}
+
+// Solves a function's values to a fixed point, then rewrites what became known
+int propagateFunction(IRFunction* fn)
+{
+    char* lattice = calloc(fn->valueCount + 1, 1);
+    int* constant = calloc(fn->valueCount + 1, sizeof(int));
+    char* reachable = calloc(fn->blockCount + 1, 1);
+    char* taken = calloc(fn->blockCount * 2 + 1, 1);
+    IRBlock* block;
+    IRValue* value;
+    int i, j, state, changed, known, changes = 0;
+
+    reachable[0] = 1;
+
+    do
+    {
+        changed = 0;
+
+        for (i = 0; i < fn->blockCount; i++)
+        {
+            block = &fn->blocks[i];
+
+            if (!reachable[i])
+                continue;
+
+            for (j = 0; j < block->count; j++)
+            {
+                state = evaluateValue(fn, block->values[j], lattice, constant, taken);
+
+                if (state != lattice[block->values[j]])
+                {
+                    lattice[block->values[j]] = state;
+                    changed = 1;
+                }
+            }
+
+            if (block->exit == IR_JUMP)
+                changed |= takeEdge(fn, taken, reachable, i, 0);
+            else if (block->exit == IR_BRANCH && lattice[block->condition] == LATTICE_CONSTANT)
+                changed |= takeEdge(fn, taken, reachable, i, (constant[block->condition] != 0) ? 0 : 1);
+            else if (block->exit == IR_BRANCH && lattice[block->condition] == LATTICE_VARIES)
+            {
+                changed |= takeEdge(fn, taken, reachable, i, 0);
+                changed |= takeEdge(fn, taken, reachable, i, 1);
+            }
+        }
+
+    } while (changed);
+
+    // Known values become constants (what has effects keeps them)
+    for (i = 0; i < fn->valueCount; i++)
+    {
+        value = &fn->values[i];
+
+        if (value->dead || !reachable[value->block] || lattice[i] != LATTICE_CONSTANT)
+            continue;
+
+        if (value->kind == IR_UNARY || value->kind == IR_BINARY || value->kind == IR_PHI)
+        {
+            value->kind = IR_CONST;
+            value->value = constant[i];
+            value->operand[0] = value->operand[1] = NO_VALUE;
+            changes++;
+        }
+    }
+
+    // Known branches become jumps, dropping the edge not taken
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        block = &fn->blocks[i];
+
+        if (!reachable[i] || block->exit != IR_BRANCH || lattice[block->condition] != LATTICE_CONSTANT)
+            continue;
+
+        known = (constant[block->condition] != 0) ? 0 : 1;
+        removePredecessor(fn, block->succ[1 - known], i);
+
+        block->exit = IR_JUMP;
+        block->succ[0] = block->succ[known];
+        block->succCount = 1;
+        block->condition = NO_VALUE;
+        changes++;
+    }
+
+    for (i = 0; i < fn->blockCount; i++)
+    {
+        if (!reachable[i] && !fn->blocks[i].dead)
+        {
+            dropBlock(fn, i);
+            changes++;
+        }
+    }
+
+    // Phis left with one incoming edge
+    changes += removeTrivialPhis(fn);
+    compactBlocks(fn);
+
+    free(lattice);
+    free(constant);
+    free(reachable);
+    free(taken);
+
+    return changes;
+}
+
+// Returns the lattice state of a value from its operands' current states,
+// leaving a constant result in constant[value]
+int evaluateValue(IRFunction* fn, int value, char* lattice, int* constant, char* taken)
+{
+    IRValue* target = &fn->values[value];
+    IRBlock* block = &fn->blocks[target->block];
+    int i, operand, state = LATTICE_UNKNOWN, left, right, result;
+
+    switch (target->kind)
+    {
+        case IR_CONST:
+            constant[value] = target->value;
+            return LATTICE_CONSTANT;
+
+        case IR_PHI:
+            // Meet the operands of the edges taken so far
+            for (i = 0; i < block->predCount; i++)
+            {
+                operand = target->phiOperand[i];
+
+                if (!edgeTaken(fn, taken, block->preds[i], target->block) || lattice[operand] == LATTICE_UNKNOWN)
+                    continue;
+
+                if (lattice[operand] == LATTICE_VARIES ||
+                    (state == LATTICE_CONSTANT && constant[operand] != constant[value]))
+                    return LATTICE_VARIES;
+
+                state = LATTICE_CONSTANT;
+                constant[value] = constant[operand];
+            }
+            return state;
+
+        case IR_UNARY:
+        case IR_BINARY:
+            for (i = 0; i < 2 && target->operand[i] != NO_VALUE; i++)
+            {
+                if (lattice[target->operand[i]] == LATTICE_VARIES)
+                    return LATTICE_VARIES;
+
+                if (lattice[target->operand[i]] == LATTICE_UNKNOWN)
+                    return (lattice[value] == LATTICE_VARIES) ? LATTICE_VARIES : LATTICE_UNKNOWN;
+            }
+
+            left = constant[target->operand[0]];
+            right = (target->operand[1] != NO_VALUE) ? constant[target->operand[1]] : 0;
+
+            // A division by zero is left for the VM
+            if (!evaluateOperator(target->op, left, right, &result))
+                return LATTICE_VARIES;
+
+            if (lattice[value] == LATTICE_CONSTANT && constant[value] != result)
+                return LATTICE_VARIES;
+
+            constant[value] = result;
+            return (lattice[value] == LATTICE_VARIES) ? LATTICE_VARIES : LATTICE_CONSTANT;
+
+        // Input, memory and whatever a variable held on entry
+        default:
+            return LATTICE_VARIES;
+    }
+}
+
+// Returns whether the edge between two blocks has been found reachable
+int edgeTaken(IRFunction* fn, char* taken, int from, int to)
+{
+    int i;
+
+    for (i = 0; i < fn->blocks[from].succCount; i++)
+    {
+        if (fn->blocks[from].succ[i] == to && taken[from * 2 + i])
+            return 1;
+    }
+
+    return 0;
+}
+
+// Marks one of a block's exits taken, returns whether that is news
+int takeEdge(IRFunction* fn, char* taken, char* reachable, int from, int succ)
+{
+    if (taken[from * 2 + succ])
+        return 0;
+
+    taken[from * 2 + succ] = 1;
+    reachable[fn->blocks[from].succ[succ]] = 1;
+
+    return 1;
+}
+
+// Removes an unreachable block: its values and its edges into other blocks
+void dropBlock(IRFunction* fn, int block)
+{
+    IRBlock* target = &fn->blocks[block];
+    int i;
+
+    for (i = 0; i < target->count; i++)
+        fn->values[target->values[i]].dead = 1;
+
+    for (i = 0; i < target->succCount; i++)
+        removePredecessor(fn, target->succ[i], block);
+
+    target->count = 0;
+    target->succCount = 0;
+    target->predCount = 0;
+    target->exit = IR_RETURN;
+    target->condition = NO_VALUE;
+    target->dead = 1;
+}
+
+#endif
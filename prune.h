@@ -0,0 +1,83 @@
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include "structs.h"
+#include "ast.h"
+
+// Tree pass that drops statements with no effect: empty begin ... end blocks and
+// if statements whose then part is (or becomes) empty. PL/0 expressions have no
+// side effects, so skipping a condition nobody branches on changes nothing.
+// while loops are kept, an empty one may still never terminate.
+
+// PROTOTYPES
+int pruneEmpty(Node* program);
+int pruneBlock(Node* block);
+Node* pruneStatement(Node* statement, int* removed);
+
+// Prunes every block in the program, returns how many statements were removed
+int pruneEmpty(Node* program)
+{
+    return pruneBlock(program);
+}
+
+// Prunes a block and the blocks of its procedures
+int pruneBlock(Node* block)
+{
+    int removed = 0;
+    Node* procedure;
+
+    for (procedure = block->child[0]; procedure != NULL; procedure = procedure->next)
+        removed += pruneBlock(procedure);
+
+    block->child[1] = pruneStatement(block->child[1], &removed);
+
+    return removed;
+}
+
+// Removes a statement's empty parts, returns it (or NULL if nothing is left)
+Node* pruneStatement(Node* statement, int* removed)
+{
+    Node** next;
+
+    if (statement == NULL)
+        return NULL;
+
+    switch (statement->kind)
+    {
+        case NODE_BEGIN:
+            // Unlink statements that prune away to nothing
+            for (next = &statement->child[0]; *next != NULL; )
+            {
+                if (pruneStatement(*next, removed) == NULL)
+                    *next = (*next)->next;
+                else
+                    next = &(*next)->next;
+            }
+
+            if (statement->child[0] == NULL)
+            {
+                (*removed)++;
+                return NULL;
+            }
+            return statement;
+
+        case NODE_IF:
+            statement->child[1] = pruneStatement(statement->child[1], removed);
+
+            if (statement->child[1] == NULL)
+            {
+                (*removed)++;
+                return NULL;
+            }
+            return statement;
+
+        case NODE_WHILE:
+            statement->child[1] = pruneStatement(statement->child[1], removed);
+            return statement;
+
+        default:
+            return statement;
+    }
+}
+
+#endif
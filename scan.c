@@ -7,7 +7,8 @@
 
 int main(int argc, char *argv[])
 {
-    // Coded this way for external use
+    // Coded this way for external use (-l also writes the text lexeme table & list)
+    dumpLexemes = (argc > 1 && strcmp(argv[1], "-l") == 0);
     scan();
     
     return 1;
@@ -4,9 +4,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#define HAVE_MMAP 1
+#define HAVE_PTHREADS 1
+#endif
 
 #include "files.h"
 #include "structs.h"
+#include "intern.h"
+#include "tokens.h"
+#include "tokenfile.h"
 #include "pl0_constants.h"
 
 #define MAX_NUM_LENGTH 5
@@ -17,399 +32,563 @@
 #define ERROR_VAR_TOO_LONG 3
 #define ERROR_INVALID_SYMBOL 4
 
+#include "scan_tables.h"
+#include "scan_skip.h"
+
+// Scanning runs in parallel chunks for sources of at least this many bytes
+#define PARALLEL_SCAN_MIN_BYTES (1024 * 1024)
+#define MAX_SCAN_THREADS 64
+
+// Offsets into a source are ints, so it must be shorter than this
+#define MAX_SOURCE_LENGTH INT_MAX
+
 // PROTOTYPES
 extern void scan();
-void createCleanInput(FILE* input, FILE* cleanOutput);
-Token* getNextToken(FILE* cleanInput);
-int isValidSymbol(char c);
-int getID(Token* t);
-void startLexemeTable(FILE *ifp);
-void writeLexemeTable(FILE* ifp, Token* token);
-void writeLexemeList(FILE* ifp, Token* token);
-void printError(int errorNum);
+void writeScanOutputs();
+int loadSource(Source* source, char* fileName);
+const char* loadFailure();
+void closeSource(Source* source);
+int scanRange(Source* source, int begin, int end, TokenBuffer* buffer, InternTable* names, int* errorOffset);
+void getNextToken(Source* source, Token* token);
+int keywordID(const char* text, int length);
+int scanThreadCount(Source* source);
+int scanParallel(Source* source, int threads, TokenBuffer* buffer, int* errorOffset);
+int commentStateAfter(const unsigned char* text, int begin, int end, int inComment);
+void* scanChunkComments(void* chunk);
+void* scanChunk(void* chunk);
+void writeLexemeTable(FILE* ifp, Source* source, TokenBuffer* buffer);
+void writeLexemeList(FILE* ifp, Source* source, TokenBuffer* buffer);
+void printError(int errorNum, int line, int column);
+const char* scanErrorMessage(int errorNum);
 
+// GLOBALS
+THREAD_LOCAL int scanThreads = 0;
+THREAD_LOCAL int dumpLexemes = 0;
+THREAD_LOCAL int scanError = 0;
+THREAD_LOCAL int scanErrorOffset = 0;
+
+// Scans INPUT_FILE into the token buffer (tokens), then writes it out as a token
+// file (plus the text lexeme table & list when dumpLexemes is set)
 void scan()
 {
-    // Token
-    Token* token;
+    int error, errorOffset, threads, line, column;
     
-    // Files
-    FILE *input = fopen(INPUT_FILE, "r");
-    FILE *clean = fopen(CLEAN_FILE, "w+");
-    FILE *table = fopen(TABLE_FILE, "w");
-    FILE *list  = fopen(LIST_FILE, "w");
+    // Map (or read) the whole input file into memory, it stays loaded for diagnostics
+    if (!loadSource(&tokenSource, INPUT_FILE))
+        printf("%s: %s\n", INPUT_FILE, loadFailure());
+    tokens.count = 0;
     
-    // Parse flags
-    int error, endOfFile;
+    // Tokenize the source, comments are stripped as tokens are read
+    threads = scanThreadCount(&tokenSource);
     
-    // Create the clean input file & seek back to file start
-    createCleanInput(input, clean);
-    fseek(clean, 0, SEEK_SET);
+    if (threads > 1)
+        error = scanParallel(&tokenSource, threads, &tokens, &errorOffset);
+    else
+        error = scanRange(&tokenSource, 0, tokenSource.length, &tokens, &identifiers, &errorOffset);
     
-    // Create the header to the lexeme table file
-    startLexemeTable(table);
+    scanError = error;
+    scanErrorOffset = errorOffset;
     
-    // Parse clean input
-    do
+    // If error, output error to console (tokens before it are kept)
+    if (error)
     {
-        // Get next token
-        token = getNextToken(clean);
-           
-        // If valid token, write to lexeme table and list
-        if (token->endOfFile != EOF && !(token->error))
-        {
-            writeLexemeList(list, token);
-            writeLexemeTable(table, token);
-        }
-        // Else if error, output error to console
-        else if (token->error)
-        {
-            printError(token->error);
-        }
-        
-        // Clean up token memory
-        error = token->error;
-        endOfFile = token->endOfFile;
-        free(token->value);
-        free(token);
+        sourceLocation(&tokenSource, errorOffset, &line, &column);
+        printError(error, line, column);
+    }
+    
+    writeScanOutputs();
+}
+
+// Writes the token buffer out as a token file, plus the text lexeme table & list
+// when dumpLexemes is set
+void writeScanOutputs()
+{
+    FILE *table, *list;
     
-    } while (endOfFile != EOF && !error);
+    writeTokenFile(TOKEN_FILE, &tokens, &identifiers);
+    
+    // Debug dumps -- lexeme table and list
+    if (dumpLexemes)
+    {
+        table = fopen(TABLE_FILE, "w");
+        list  = fopen(LIST_FILE, "w");
         
-    // Close out file pointers
-    fclose(input);
-    fclose(clean);
-    fclose(table);
-    fclose(list);
+        writeLexemeTable(table, &tokenSource, &tokens);
+        writeLexemeList(list, &tokenSource, &tokens);
+        
+        fclose(table);
+        fclose(list);
+    }
 }
 
-// Reads in a PL/0 File and Removes Comments -- Outputs to CLEAN_FILE
-void createCleanInput(FILE* input, FILE* cleanOutput)
+// Loads a PL/0 file into memory (mapped when possible) -- returns 0 if unreadable
+// or too long to address (errno is EFBIG then)
+int loadSource(Source* source, char* fileName)
 {
-    int prevChar = -99;
-    int currChar = -99;
-    int comment = 0;
-    int offset = 0;
+    FILE* input;
+    long size;
+    
+    source->text = NULL;
+    source->length = 0;
+    source->position = 0;
+    source->mapped = 0;
     
-    if (input != NULL)
+#ifdef HAVE_MMAP
     {
-        // Read char by char until end of file
-        while ((currChar = fgetc(input)) != EOF)
+        struct stat info;
+        int fd = open(fileName, O_RDONLY);
+        
+        if (fd < 0)
+            return 0;
+        
+        // Map regular, non-empty files read only (empty files need no text)
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode))
         {
-            // If read '/*', start comment (ignore)
-            if (prevChar == (int) '/' && currChar == (int) '*')
+            if (info.st_size >= MAX_SOURCE_LENGTH)
             {
-                comment = 1;
+                close(fd);
+                errno = EFBIG;
+                return 0;
             }
-            // If commenting and read '*/' - end comment
-            else if (comment && prevChar == (int) '*' && currChar == (int) '/')
+            
+            if (info.st_size > 0)
             {
-                // Offset needed to ignore closure
-                comment = 0;
-                offset = 2;                
+                void* map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                
+                if (map != MAP_FAILED)
+                {
+                    source->text = map;
+                    source->length = (int) info.st_size;
+                    source->mapped = 1;
+                }
             }
             
-            // If not commenting and have read at least two chars -- write to file
-            if (!comment && prevChar != -99)
+            if (source->mapped || info.st_size == 0)
             {
-                (!offset) ? fprintf(cleanOutput, "%c", (char) prevChar) : offset--;
+                close(fd);
+                return 1;
             }
-            
-            prevChar = currChar;
         }
         
-        // If not commenting at this point, add the last character
-        if (!comment)
-            fprintf(cleanOutput, "%c", (char) prevChar);
+        close(fd);
+    }
+#endif
+    
+    // Fall back to slurping the file in one read
+    input = fopen(fileName, "rb");
+    if (input == NULL)
+        return 0;
+    
+    fseek(input, 0, SEEK_END);
+    size = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    
+    if (size >= MAX_SOURCE_LENGTH)
+    {
+        fclose(input);
+        errno = EFBIG;
+        return 0;
     }
+    
+    if (size > 0)
+    {
+        source->text = malloc(size);
+        source->length = (int) fread(source->text, 1, size, input);
+    }
+    
+    fclose(input);
+    return 1;
+}
+
+// Says why loadSource() failed
+const char* loadFailure()
+{
+    return (errno == EFBIG) ? "Source is too large (2 GB or more)" : "Could not read file";
 }
 
-// Returns the next token or error code if next token is invalid
-Token* getNextToken(FILE* cleanInput)
+// Releases the memory held by a loaded source
+void closeSource(Source* source)
 {
-    Token* token = calloc(1, sizeof(Token));
-    char buffer[MAX_TOKEN_LENGTH + 1];
-    char c;
-    int index = 0;
-    int end_token = 0;
+#ifdef HAVE_MMAP
+    if (source->mapped)
+        munmap(source->text, source->length);
+    else
+#endif
+        free(source->text);
+    
+    source->text = NULL;
+    source->length = 0;
+    source->position = 0;
+    source->mapped = 0;
+}
+
+// Appends the tokens in source text [begin, end) to buffer, stopping at the first
+// error -- returns its error code (0 if none). Identifiers are interned when names
+// is given, otherwise their value is left as -1 for the caller to fill in.
+int scanRange(Source* source, int begin, int end, TokenBuffer* buffer, InternTable* names, int* errorOffset)
+{
+    Source range = *source;
+    Token token;
+    int value;
+    
+    range.position = begin;
+    range.length = end;
+    
+    do
+    {
+        // Get next token
+        getNextToken(&range, &token);
+           
+        // If valid token, add to the token buffer
+        if (token.endOfFile != EOF && !(token.error))
+        {
+            value = token.number;
+            
+            if (token.id == IDENT_SYM)
+                value = (names) ? intern(names, token.value, token.length) : -1;
+            
+            appendToken(buffer, token.id, token.value - source->text, token.length, value);
+        }
+        // Else if error, note where it is
+        else if (token.error)
+        {
+            *errorOffset = token.value - source->text;
+        }
+    
+    } while (token.endOfFile != EOF && !token.error);
+    
+    return token.error;
+}
+
+// Reads the next token (or error code if next token is invalid) into token
+void getNextToken(Source* source, Token* token)
+{
+    const unsigned char* text = (const unsigned char*) source->text;
+    int position = source->position;
+    int start = position;
+    int state = S_START;
+    int next, length;
+    
+    if (skipKernel == SKIP_UNSET)
+        skipKernel = selectSkipKernel();
+    
+    // Run the DFA for the longest match -- whitespace & comments loop back to S_START
+    while (position < source->length)
+    {
+        next = scanTransition[state][charClass[text[position]]];
+        
+        if (next == S_DEAD)
+            break;
+        
+        position++;
+        state = next;
         
-    while(!end_token && (fscanf(cleanInput, "%c", &c) != EOF))
-    {           
-        // If not set yet, determine type (from first non-whitespace char)
-        if (token->type == NOT_SET && !isspace(c))
+        // Jump whole comment bodies & whitespace runs with the skip kernels
+        if (state == S_COMMENT && skipKernel != SKIP_NONE)
         {
-            buffer[index++] = c;
+            next = skipComment(text, position, source->length);
             
-            if (isalpha(c))
+            if (next < 0)
             {
-                token->type = ALPHA;
-            }
-            else if (isdigit(c))
-            {
-                token->type = NUMBER;
-            }
-            else if (isValidSymbol(c))
-            {
-                token->type = SYMBOL;
-            }
-            else
-            {
-                // Invalid non-whitespace read (invalid symbol)
-                end_token = 1;
-                token->error = ERROR_INVALID_SYMBOL;
-                strcpy(buffer, "Error 4");
+                position = source->length;
+                break;
             }
+            
+            position = next;
+            state = S_START;
         }
-        // Else continue reading token (actions determined by type)
-        else
+        
+        if (state == S_START)
         {
-            // TYPE: ALPHA
-            if (token->type == ALPHA)
-            {
-                // If digit or alpha add to buffer and keep reading token
-                if ((isalpha(c) || isdigit(c)) && index < MAX_TOKEN_LENGTH)
-                {
-                    buffer[index++] = c;
-                }
-                else if ((isalpha(c) || isdigit(c)) && index >= MAX_TOKEN_LENGTH)
-                {
-                    token->error = ERROR_VAR_TOO_LONG;
-                    strcpy(buffer, "Error 3");
-                }
-                // Else (symbol or white space) end token
-                else
-                {
-                    end_token = 1;
-                    fseek(cleanInput, -1, SEEK_CUR);
-                }  
-            }
-            // TYPE: NUMBER
-            else if (token->type == NUMBER)
-            {
-                // If digit, add to buffer and keep reading token
-                if (isdigit(c) && index < MAX_NUM_LENGTH)
-                {
-                    buffer[index++] = c;
-                }
-                else if (isdigit(c) && index >= MAX_NUM_LENGTH)
-                {
-                    token->error = ERROR_NUM_TOO_LONG;
-                    strcpy(buffer, "Error 2");
-                }
-                // If alpha, invalid ident error
-                else if (isalpha(c))
-                {
-                    end_token = 1;
-                    token->error = ERROR_INVALID_VAR_NAME;
-                    strcpy(buffer, "Error 1");
-                }
-                // Else white space or symbol, end number
-                else
-                {
-                    end_token = 1;
-                    fseek(cleanInput, -1, SEEK_CUR);
-                }
-            }
-            // TYPE: SYMBOL
-            else if (token->type == SYMBOL)
-            {
-                // If '<>', '<=', '>=' or ':=' -> add to buffer and end token
-                if ((buffer[0] == '<' && c == '>') ||
-                    (buffer[0] == '<' && c == '=') ||
-                    (buffer[0] == '>' && c == '=') ||
-                    (buffer[0] == ':' && c == '='))
-                {
-                    end_token = 1;
-                    buffer[index++] = c;
-                }
-                // If next char is valid - end token
-                else if (isalpha(c) || isdigit(c) || isspace(c) || isValidSymbol(c))
-                {
-                    end_token = 1;
-                    fseek(cleanInput, -1, SEEK_CUR);
-                }
-                // If invalid, read an invalid symbol - return error
-                else
-                {
-                    end_token = 1;
-                    token->error = ERROR_INVALID_SYMBOL;
-                    strcpy(buffer, "Error 4");
-                }
-            }
-        }    
-
-        // If not error, terminate the buffer string (gets overwritten if more added)
-        if (!token->error)
-            buffer[index] = '\0';        
+            if (skipKernel != SKIP_NONE)
+                position = skipSpace(text, position, source->length);
+            
+            start = position;
+        }
     }
     
-    // End of File Test
-    if (index == 0)
+    source->position = position;
+    length = position - start;
+    
+    // The lexeme is left in place in the source text
+    token->value = source->text + start;
+    token->length = length;
+    token->number = 0;
+    token->id = scanAccept[state];
+    token->error = 0;
+    token->endOfFile = 0;
+    
+    // End of File (nothing but whitespace / comments left)
+    if (token->id == 0)
     {
-        strcpy(buffer, "EOF");
         token->endOfFile = EOF;
     }
+    // Negative accept values are scanner errors
+    else if (token->id < 0)
+    {
+        token->error = -token->id;
+    }
+    else if (token->id == IDENT_SYM)
+    {
+        if (length > MAX_TOKEN_LENGTH)
+            token->error = ERROR_VAR_TOO_LONG;
+        else
+            token->id = keywordID(token->value, length);
+    }
+    else if (token->id == NUM_SYM)
+    {
+        if (length > MAX_NUM_LENGTH)
+            token->error = ERROR_NUM_TOO_LONG;
+        
+        // Numbers are converted once, here
+        for (; start < position && !token->error; start++)
+            token->number = token->number * 10 + (text[start] - '0');
+    }
+}
+
+// Returns the keyword ID for an identifier (IDENT_SYM if it is not a keyword)
+int keywordID(const char* text, int length)
+{
+    int slot;
     
-    // Copy buffer to string and return
-    token->value = malloc(sizeof(char) * (strlen(buffer) + 1));
-    strcpy(token->value,buffer);
+    if (length < MIN_KEYWORD_LENGTH || length > MAX_KEYWORD_LENGTH)
+        return IDENT_SYM;
     
-    // Determine id for token
-    if (!(token->error) && token->endOfFile != EOF)
-        token->id = getID(token);
+    slot = (length + keywordAssoc[(unsigned char) text[1]] +
+            keywordAssoc[(unsigned char) text[length - 1]]) % KEYWORD_SLOTS;
     
-    return token;
+    if (keywordTable[slot].length == length && memcmp(keywordTable[slot].name, text, length) == 0)
+        return keywordTable[slot].id;
+    
+    return IDENT_SYM;
 }
 
-// Returns 1 if c is a valid PL/0 symbol
-int isValidSymbol(char c)
+// Returns how many threads to scan a source with (1 means scan sequentially)
+int scanThreadCount(Source* source)
 {
-    if (c == '+' ||
-        c == '-' ||
-        c == '*' ||
-        c == '/' ||
-        c == '=' ||
-        c == '<' ||
-        c == '>' ||
-        c == '(' ||
-        c == ')' ||
-        c == ',' ||
-        c == ';' ||
-        c == '.' ||
-        c == ':')
-        
-        return 1;
-        
-    else
-        return 0;
+    int threads = scanThreads;
+    
+#ifdef HAVE_PTHREADS
+    // By default only large sources are split, over every core
+    if (threads <= 0)
+        threads = (source->length >= PARALLEL_SCAN_MIN_BYTES) ? (int) sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    
+    if (threads > MAX_SCAN_THREADS)
+        threads = MAX_SCAN_THREADS;
+    
+    // Keep chunks from getting too small to be worth a thread
+    if (threads > source->length / 4096)
+        threads = source->length / 4096;
+#else
+    threads = 1;
+#endif
+    
+    return (threads < 1) ? 1 : threads;
 }
 
-// Returns the ID for a given token (based on keywords and symbol table)
-int getID(Token* t)
+// Returns whether text [begin, end) ends inside a comment, given whether it starts in one
+int commentStateAfter(const unsigned char* text, int begin, int end, int inComment)
 {
-    // Type:  ALPHA
-    if (t->type == ALPHA)
+    const unsigned char* slash;
+    
+    while (begin < end)
     {
-        // Test for keywords
-        if (strcmp(t->value, "odd") == 0)
-            return ODD_SYM;
-        if (strcmp(t->value, "begin") == 0)
-            return BEGIN_SYM;
-        if (strcmp(t->value, "end") == 0)
-            return END_SYM;
-        if (strcmp(t->value, "if") == 0)
-            return IF_SYM;
-        if (strcmp(t->value, "then") == 0)
-            return THEN_SYM;
-        if (strcmp(t->value, "while") == 0)
-            return WHILE_SYM;
-        if (strcmp(t->value, "do") == 0)
-            return DO_SYM;
-        if (strcmp(t->value, "call") == 0)
-            return CALL_SYM;
-        if (strcmp(t->value, "const") == 0)
-            return CONST_SYM;
-        if (strcmp(t->value, "var") == 0)
-            return VAR_SYM;
-        if (strcmp(t->value, "procedure") == 0)
-            return PROC_SYM;
-        if (strcmp(t->value, "write") == 0)
-            return WRITE_SYM;
-        if (strcmp(t->value, "read") == 0)
-            return READ_SYM;
-        if (strcmp(t->value, "else") == 0)
-            return ELSE_SYM;
-        
-        // Else, not a keyword, so ident
+        if (inComment)
+        {
+            begin = skipComment(text, begin, end);
+            
+            if (begin < 0)
+                return 1;
+            
+            inComment = 0;
+        }
         else
-            return IDENT_SYM;
+        {
+            // Outside a comment, every '/*' opens one (PL/0 has no string literals)
+            slash = (const unsigned char*) memchr(text + begin, '/', end - begin);
+            
+            if (slash == NULL)
+                return 0;
+            
+            begin = slash - text + 1;
+            
+            if (begin < end && text[begin] == '*')
+            {
+                begin++;
+                inComment = 1;
+            }
+        }
     }
     
-    // Type:  NUMBER
-    else if (t->type == NUMBER)
+    return inComment;
+}
+
+#ifdef HAVE_PTHREADS
+
+// Works out a chunk's ending comment state for both starting states on a worker thread
+void* scanChunkComments(void* chunk)
+{
+    ScanChunk* c = chunk;
+    const unsigned char* text = (const unsigned char*) c->source->text;
+    
+    skipKernel = c->skipKernel;
+    
+    c->endsInComment[0] = commentStateAfter(text, c->begin, c->end, 0);
+    c->endsInComment[1] = commentStateAfter(text, c->begin, c->end, 1);
+    
+    return NULL;
+}
+
+// Scans one chunk on a worker thread, with the skip kernel of the thread that split it
+void* scanChunk(void* chunk)
+{
+    ScanChunk* c = chunk;
+    int begin = c->begin;
+    
+    skipKernel = c->skipKernel;
+    
+    // Finish off a comment carried over from the previous chunk first
+    if (c->inComment)
     {
-        return NUM_SYM;
+        begin = skipComment((const unsigned char*) c->source->text, begin, c->end);
+        
+        if (begin < 0)
+            return NULL;
     }
-    // Type: SYMBOL (Invalid symbols should be caught in read)
-    else if (t->type == SYMBOL)
+    
+    c->error = scanRange(c->source, begin, c->end, &c->tokens, NULL, &c->errorOffset);
+    
+    return NULL;
+}
+
+#endif
+
+// Scans a source split into chunks on worker threads, then joins their tokens into
+// buffer in order. Chunks are cut at whitespace, so no token (and neither half of
+// a '/*' or '*/') spans two chunks; only whether a chunk starts inside a comment
+// depends on the chunks before it. Each chunk first works out whether it ends
+// inside a comment for both possible starting states, in parallel; a quick pass
+// over the chunks then settles where each one really starts before lexing.
+// Returns the first error code in source order (0 if none), like scanRange().
+int scanParallel(Source* source, int threads, TokenBuffer* buffer, int* errorOffset)
+{
+#ifdef HAVE_PTHREADS
+    const unsigned char* text = (const unsigned char*) source->text;
+    ScanChunk chunks[MAX_SCAN_THREADS];
+    pthread_t workers[MAX_SCAN_THREADS];
+    int i, j, cut, error = 0;
+    
+    if (skipKernel == SKIP_UNSET)
+        skipKernel = selectSkipKernel();
+    
+    // Cut the source into roughly equal chunks, moving each cut forward to whitespace
+    for (i = 0, cut = 0; i < threads; i++)
     {
-        if (strcmp(t->value, "+") == 0)
-            return PLUS_SYM;
-        if (strcmp(t->value, "-") == 0)
-            return MINUS_SYM;
-        if (strcmp(t->value, "*") == 0)
-            return MULT_SYM;
-        if (strcmp(t->value, "/") == 0)
-            return SLASH_SYM;
-        if (strcmp(t->value, "=") == 0)
-            return EQL_SYM;
-        if (strcmp(t->value, "<>") == 0)
-            return NEQ_SYM;
-        if (strcmp(t->value, "<") == 0)
-            return LESS_SYM;
-        if (strcmp(t->value, "<=") == 0)
-            return LEQ_SYM;
-        if (strcmp(t->value, ">") == 0)
-            return GTR_SYM;
-        if (strcmp(t->value, ">=") == 0)
-            return GEQ_SYM;
-        if (strcmp(t->value, "(") == 0)
-            return LPAREN_SYM;
-        if (strcmp(t->value, ")") == 0)
-            return RPAREN_SYM;
-        if (strcmp(t->value, ",") == 0)
-            return COMMA_SYM;
-        if (strcmp(t->value, ";") == 0)
-            return SEMICOLON_SYM;
-        if (strcmp(t->value, ".") == 0)
-            return PERIOD_SYM;
-        if (strcmp(t->value, ":=") == 0)
-            return BECOMES_SYM;
+        memset(&chunks[i], 0, sizeof(ScanChunk));
+        chunks[i].source = source;
+        chunks[i].skipKernel = skipKernel;
+        chunks[i].begin = cut;
+        
+        cut = (int) ((long long) source->length * (i + 1) / threads);
+        
+        if (cut < chunks[i].begin)
+            cut = chunks[i].begin;
+        
+        while (cut < source->length && charClass[text[cut]] != C_SPACE)
+            cut++;
+        
+        chunks[i].end = (i == threads - 1) ? source->length : cut;
     }
-    // If all else fails
-    return -99;
+    
+    // Comment state at the end of each chunk, for starting outside & inside a comment
+    for (i = 0; i < threads; i++)
+        pthread_create(&workers[i], NULL, scanChunkComments, &chunks[i]);
+    
+    for (i = 0; i < threads; i++)
+        pthread_join(workers[i], NULL);
+    
+    for (i = 1; i < threads; i++)
+        chunks[i].inComment = chunks[i - 1].endsInComment[chunks[i - 1].inComment];
+    
+    // Lex every chunk
+    for (i = 0; i < threads; i++)
+        pthread_create(&workers[i], NULL, scanChunk, &chunks[i]);
+    
+    for (i = 0; i < threads; i++)
+        pthread_join(workers[i], NULL);
+    
+    // Join the chunks' tokens up to the first error, interning identifiers in order
+    for (i = 0; i < threads; i++)
+    {
+        for (j = 0; j < chunks[i].tokens.count && !error; j++)
+        {
+            appendToken(buffer, chunks[i].tokens.kind[j], chunks[i].tokens.offset[j], chunks[i].tokens.length[j],
+                        (chunks[i].tokens.kind[j] == IDENT_SYM) ?
+                            intern(&identifiers, source->text + chunks[i].tokens.offset[j], chunks[i].tokens.length[j]) :
+                            chunks[i].tokens.value[j]);
+        }
+        
+        if (!error && chunks[i].error)
+        {
+            error = chunks[i].error;
+            *errorOffset = chunks[i].errorOffset;
+        }
+        
+        freeTokenBuffer(&chunks[i].tokens);
+    }
+    
+    return error;
+#else
+    return scanRange(source, 0, source->length, buffer, &identifiers, errorOffset);
+#endif
 }
 
-// Starts the lexeme table table
-void startLexemeTable(FILE *ifp)
+// Writes the lexeme table file (every token with its type)
+void writeLexemeTable(FILE* ifp, Source* source, TokenBuffer* buffer)
 {
+    int i;
+    
     fprintf(ifp, "%-20s%s\n", "lexeme", "token type");
+    
+    for (i = 0; i < buffer->count; i++)
+        fprintf(ifp, "%-20.*s%d\n", buffer->length[i], source->text + buffer->offset[i], buffer->kind[i]);
 }
 
-// Writes a valid token to the lexeme table file
-void writeLexemeTable(FILE* ifp, Token* token)
+// Writes the lexeme list file (token types, with the text of identifiers & numbers)
+void writeLexemeList(FILE* ifp, Source* source, TokenBuffer* buffer)
 {
-    fprintf(ifp, "%-20s%d\n", token->value, token->id);
+    int i;
+    
+    for (i = 0; i < buffer->count; i++)
+    {
+        fprintf(ifp, "%d ", buffer->kind[i]);
+        
+        if (buffer->kind[i] == IDENT_SYM || buffer->kind[i] == NUM_SYM)
+            fprintf(ifp, "%.*s ", buffer->length[i], source->text + buffer->offset[i]);
+    }
 }
 
-// Writes a valid token to the lexeme list file
-void writeLexemeList(FILE* ifp, Token* token)
+// Prints out an error based on an error number, with where in the source it was found
+void printError(int errorNum, int line, int column)
 {
-    fprintf(ifp, "%d ", token->id);
-    
-    if (token->id == 2 || token->id == 3)
-        fprintf(ifp, "%s ", token->value);    
+    printf("ERROR:  %s (line %d, column %d)\n", scanErrorMessage(errorNum), line, column);
 }
 
-// Prints out an error based on an error number
-void printError(int errorNum)
+// Returns the message for a scanner error number
+const char* scanErrorMessage(int errorNum)
 {
     switch(errorNum)
     {
         case (ERROR_INVALID_VAR_NAME):
-            printf("ERROR:  Variable does not start with a letter\n");
-            break;
+            return "Variable does not start with a letter";
         case (ERROR_NUM_TOO_LONG):
-            printf("ERROR:  Number too long\n");
-            break;
+            return "Number too long";
         case (ERROR_VAR_TOO_LONG):
-            printf("ERROR:  Variable too long\n");
-            break;
+            return "Variable too long";
         case (ERROR_INVALID_SYMBOL):
-            printf("ERROR:  Invalid symbol encountered\n");
-            break;
+            return "Invalid symbol encountered";
         default:
-            printf("ERROR:  Invalid error code entered\n");
-            break;
+            return "Invalid error code entered";
     }
 }
 
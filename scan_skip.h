@@ -0,0 +1,232 @@
+#ifndef SCAN_SKIP_H
+#define SCAN_SKIP_H
+
+// Bulk skipping of whitespace runs and comment bodies for the scanner.
+// The DFA in scan_tables.h handles these one byte per transition; the kernels
+// below jump over them 16 (SSE2) or 32 (AVX2) bytes at a time, with a scalar
+// version for other targets. The kernel is picked once per thread, on first use.
+
+#include "structs.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define HAVE_SSE2_SKIP 1
+#if defined(__x86_64__)
+#define HAVE_AVX2_SKIP 1
+#endif
+#endif
+
+// Skip kernels
+#define SKIP_UNSET -1
+#define SKIP_NONE 0
+#define SKIP_SCALAR 1
+#define SKIP_SSE2 2
+#define SKIP_AVX2 3
+
+// PROTOTYPES
+int selectSkipKernel();
+char* skipKernelName(int kernel);
+int skipSpace(const unsigned char* text, int position, int length);
+int skipComment(const unsigned char* text, int position, int length);
+int skipSpaceScalar(const unsigned char* text, int position, int length);
+int skipCommentScalar(const unsigned char* text, int position, int length);
+
+// GLOBALS
+THREAD_LOCAL int skipKernel = SKIP_UNSET;
+
+// Picks the widest kernel the running CPU supports
+int selectSkipKernel()
+{
+#ifdef HAVE_AVX2_SKIP
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SKIP_AVX2;
+#endif
+#ifdef HAVE_SSE2_SKIP
+    return SKIP_SSE2;
+#else
+    return SKIP_SCALAR;
+#endif
+}
+
+// Returns a printable name for a kernel
+char* skipKernelName(int kernel)
+{
+    switch(kernel)
+    {
+        case SKIP_NONE:
+            return "dfa only";
+        case SKIP_SCALAR:
+            return "scalar";
+        case SKIP_SSE2:
+            return "sse2";
+        case SKIP_AVX2:
+            return "avx2";
+        default:
+            return "unset";
+    }
+}
+
+// Returns the position of the first non-whitespace char at or after position
+int skipSpaceScalar(const unsigned char* text, int position, int length)
+{
+    while (position < length && charClass[text[position]] == C_SPACE)
+        position++;
+
+    return position;
+}
+
+// Returns the position just past the '*/' closing a comment, searching from
+// position (just inside the '/*'), or -1 if the comment is never closed
+int skipCommentScalar(const unsigned char* text, int position, int length)
+{
+    for (; position + 1 < length; position++)
+    {
+        if (text[position] == '*' && text[position + 1] == '/')
+            return position + 2;
+    }
+
+    return -1;
+}
+
+#ifdef HAVE_SSE2_SKIP
+
+// Bitmask of the whitespace bytes (' ' and '\t'..'\r') in a 16 byte block
+static inline int spaceMask16(__m128i block)
+{
+    __m128i control = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+    __m128i isControl = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8('\r' - '\t')), control);
+    __m128i isBlank = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+
+    return _mm_movemask_epi8(_mm_or_si128(isControl, isBlank));
+}
+
+int skipSpaceSSE2(const unsigned char* text, int position, int length)
+{
+    int mask;
+
+    while (position + 16 <= length)
+    {
+        mask = ~spaceMask16(_mm_loadu_si128((const __m128i*) (text + position))) & 0xFFFF;
+
+        if (mask)
+            return position + __builtin_ctz(mask);
+
+        position += 16;
+    }
+
+    return skipSpaceScalar(text, position, length);
+}
+
+int skipCommentSSE2(const unsigned char* text, int position, int length)
+{
+    __m128i star = _mm_set1_epi8('*');
+    __m128i slash = _mm_set1_epi8('/');
+    int mask;
+
+    // Compare each block against '*' and the block one byte on against '/'
+    while (position + 17 <= length)
+    {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (text + position)), star)) &
+               _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (text + position + 1)), slash));
+
+        if (mask)
+            return position + __builtin_ctz(mask) + 2;
+
+        position += 16;
+    }
+
+    return skipCommentScalar(text, position, length);
+}
+
+#endif
+
+#ifdef HAVE_AVX2_SKIP
+
+__attribute__((target("avx2")))
+int skipSpaceAVX2(const unsigned char* text, int position, int length)
+{
+    __m256i tab = _mm256_set1_epi8('\t');
+    __m256i span = _mm256_set1_epi8('\r' - '\t');
+    __m256i blank = _mm256_set1_epi8(' ');
+    __m256i block, control;
+    unsigned int mask;
+
+    while (position + 32 <= length)
+    {
+        block = _mm256_loadu_si256((const __m256i*) (text + position));
+        control = _mm256_sub_epi8(block, tab);
+        mask = ~(unsigned int) _mm256_movemask_epi8(_mm256_or_si256(
+                   _mm256_cmpeq_epi8(_mm256_min_epu8(control, span), control),
+                   _mm256_cmpeq_epi8(block, blank)));
+
+        if (mask)
+            return position + __builtin_ctz(mask);
+
+        position += 32;
+    }
+
+    return skipSpaceSSE2(text, position, length);
+}
+
+__attribute__((target("avx2")))
+int skipCommentAVX2(const unsigned char* text, int position, int length)
+{
+    __m256i star = _mm256_set1_epi8('*');
+    __m256i slash = _mm256_set1_epi8('/');
+    unsigned int mask;
+
+    while (position + 33 <= length)
+    {
+        mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (text + position)), star)) &
+               (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (text + position + 1)), slash));
+
+        if (mask)
+            return position + __builtin_ctz(mask) + 2;
+
+        position += 32;
+    }
+
+    return skipCommentSSE2(text, position, length);
+}
+
+#endif
+
+// Skips whitespace with the selected kernel
+int skipSpace(const unsigned char* text, int position, int length)
+{
+    switch(skipKernel)
+    {
+#ifdef HAVE_AVX2_SKIP
+        case SKIP_AVX2:
+            return skipSpaceAVX2(text, position, length);
+#endif
+#ifdef HAVE_SSE2_SKIP
+        case SKIP_SSE2:
+            return skipSpaceSSE2(text, position, length);
+#endif
+        default:
+            return skipSpaceScalar(text, position, length);
+    }
+}
+
+// Skips a comment body with the selected kernel
+int skipComment(const unsigned char* text, int position, int length)
+{
+    switch(skipKernel)
+    {
+#ifdef HAVE_AVX2_SKIP
+        case SKIP_AVX2:
+            return skipCommentAVX2(text, position, length);
+#endif
+#ifdef HAVE_SSE2_SKIP
+        case SKIP_SSE2:
+            return skipCommentSSE2(text, position, length);
+#endif
+        default:
+            return skipCommentScalar(text, position, length);
+    }
+}
+
+#endif
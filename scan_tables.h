@@ -0,0 +1,175 @@
+#ifndef SCAN_TABLES_H
+#define SCAN_TABLES_H
+
+#include "pl0_constants.h"
+
+// Tables driving the scanner DFA (included by scan.h after its error codes).
+// Everything here is a static initializer, so classifying a character, taking
+// a transition or recognizing a keyword is a plain array lookup.
+
+// Character classes
+#define C_OTHER 0
+#define C_SPACE 1
+#define C_LETTER 2
+#define C_DIGIT 3
+#define C_PLUS 4
+#define C_MINUS 5
+#define C_STAR 6
+#define C_SLASH 7
+#define C_LPAREN 8
+#define C_RPAREN 9
+#define C_EQUAL 10
+#define C_COMMA 11
+#define C_SEMICOLON 12
+#define C_PERIOD 13
+#define C_LESS 14
+#define C_GREATER 15
+#define C_COLON 16
+#define NUM_CHAR_CLASSES 17
+
+// DFA states (S_DEAD means no transition -- the token ends before this char)
+#define S_DEAD 0
+#define S_START 1
+#define S_IDENT 2
+#define S_NUMBER 3
+#define S_PLUS 4
+#define S_MINUS 5
+#define S_MULT 6
+#define S_SLASH 7
+#define S_LPAREN 8
+#define S_RPAREN 9
+#define S_EQL 10
+#define S_COMMA 11
+#define S_SEMICOLON 12
+#define S_PERIOD 13
+#define S_LESS 14
+#define S_LEQ 15
+#define S_NEQ 16
+#define S_GREATER 17
+#define S_GEQ 18
+#define S_COLON 19
+#define S_BECOMES 20
+#define S_COMMENT 21
+#define S_COMMENT_STAR 22
+#define S_BAD_NAME 23
+#define S_BAD_SYMBOL 24
+#define NUM_SCAN_STATES 25
+
+// Maps every byte to its character class (anything unlisted is C_OTHER)
+static const unsigned char charClass[256] =
+{
+    [' '] = C_SPACE, ['\t'] = C_SPACE, ['\n'] = C_SPACE,
+    ['\v'] = C_SPACE, ['\f'] = C_SPACE, ['\r'] = C_SPACE,
+
+    ['0'] = C_DIGIT, ['1'] = C_DIGIT, ['2'] = C_DIGIT, ['3'] = C_DIGIT, ['4'] = C_DIGIT,
+    ['5'] = C_DIGIT, ['6'] = C_DIGIT, ['7'] = C_DIGIT, ['8'] = C_DIGIT, ['9'] = C_DIGIT,
+
+    ['a'] = C_LETTER, ['b'] = C_LETTER, ['c'] = C_LETTER, ['d'] = C_LETTER, ['e'] = C_LETTER,
+    ['f'] = C_LETTER, ['g'] = C_LETTER, ['h'] = C_LETTER, ['i'] = C_LETTER, ['j'] = C_LETTER,
+    ['k'] = C_LETTER, ['l'] = C_LETTER, ['m'] = C_LETTER, ['n'] = C_LETTER, ['o'] = C_LETTER,
+    ['p'] = C_LETTER, ['q'] = C_LETTER, ['r'] = C_LETTER, ['s'] = C_LETTER, ['t'] = C_LETTER,
+    ['u'] = C_LETTER, ['v'] = C_LETTER, ['w'] = C_LETTER, ['x'] = C_LETTER, ['y'] = C_LETTER,
+    ['z'] = C_LETTER,
+    ['A'] = C_LETTER, ['B'] = C_LETTER, ['C'] = C_LETTER, ['D'] = C_LETTER, ['E'] = C_LETTER,
+    ['F'] = C_LETTER, ['G'] = C_LETTER, ['H'] = C_LETTER, ['I'] = C_LETTER, ['J'] = C_LETTER,
+    ['K'] = C_LETTER, ['L'] = C_LETTER, ['M'] = C_LETTER, ['N'] = C_LETTER, ['O'] = C_LETTER,
+    ['P'] = C_LETTER, ['Q'] = C_LETTER, ['R'] = C_LETTER, ['S'] = C_LETTER, ['T'] = C_LETTER,
+    ['U'] = C_LETTER, ['V'] = C_LETTER, ['W'] = C_LETTER, ['X'] = C_LETTER, ['Y'] = C_LETTER,
+    ['Z'] = C_LETTER,
+
+    ['+'] = C_PLUS, ['-'] = C_MINUS, ['*'] = C_STAR, ['/'] = C_SLASH,
+    ['('] = C_LPAREN, [')'] = C_RPAREN, ['='] = C_EQUAL, [','] = C_COMMA,
+    [';'] = C_SEMICOLON, ['.'] = C_PERIOD, ['<'] = C_LESS, ['>'] = C_GREATER,
+    [':'] = C_COLON
+};
+
+// Transition table -- scanTransition[state][class] (unlisted entries are S_DEAD)
+static const unsigned char scanTransition[NUM_SCAN_STATES][NUM_CHAR_CLASSES] =
+{
+    [S_START] =
+    {
+        [C_OTHER] = S_BAD_SYMBOL, [C_SPACE] = S_START, [C_LETTER] = S_IDENT,
+        [C_DIGIT] = S_NUMBER, [C_PLUS] = S_PLUS, [C_MINUS] = S_MINUS,
+        [C_STAR] = S_MULT, [C_SLASH] = S_SLASH, [C_LPAREN] = S_LPAREN,
+        [C_RPAREN] = S_RPAREN, [C_EQUAL] = S_EQL, [C_COMMA] = S_COMMA,
+        [C_SEMICOLON] = S_SEMICOLON, [C_PERIOD] = S_PERIOD, [C_LESS] = S_LESS,
+        [C_GREATER] = S_GREATER, [C_COLON] = S_COLON
+    },
+    [S_IDENT] = { [C_LETTER] = S_IDENT, [C_DIGIT] = S_IDENT },
+    [S_NUMBER] = { [C_DIGIT] = S_NUMBER, [C_LETTER] = S_BAD_NAME },
+    [S_SLASH] = { [C_STAR] = S_COMMENT },
+    [S_LESS] = { [C_EQUAL] = S_LEQ, [C_GREATER] = S_NEQ },
+    [S_GREATER] = { [C_EQUAL] = S_GEQ },
+    [S_COLON] = { [C_EQUAL] = S_BECOMES },
+    [S_COMMENT] =
+    {
+        [C_OTHER] = S_COMMENT, [C_SPACE] = S_COMMENT, [C_LETTER] = S_COMMENT,
+        [C_DIGIT] = S_COMMENT, [C_PLUS] = S_COMMENT, [C_MINUS] = S_COMMENT,
+        [C_STAR] = S_COMMENT_STAR, [C_SLASH] = S_COMMENT, [C_LPAREN] = S_COMMENT,
+        [C_RPAREN] = S_COMMENT, [C_EQUAL] = S_COMMENT, [C_COMMA] = S_COMMENT,
+        [C_SEMICOLON] = S_COMMENT, [C_PERIOD] = S_COMMENT, [C_LESS] = S_COMMENT,
+        [C_GREATER] = S_COMMENT, [C_COLON] = S_COMMENT
+    },
+    [S_COMMENT_STAR] =
+    {
+        [C_OTHER] = S_COMMENT, [C_SPACE] = S_COMMENT, [C_LETTER] = S_COMMENT,
+        [C_DIGIT] = S_COMMENT, [C_PLUS] = S_COMMENT, [C_MINUS] = S_COMMENT,
+        [C_STAR] = S_COMMENT_STAR, [C_SLASH] = S_START, [C_LPAREN] = S_COMMENT,
+        [C_RPAREN] = S_COMMENT, [C_EQUAL] = S_COMMENT, [C_COMMA] = S_COMMENT,
+        [C_SEMICOLON] = S_COMMENT, [C_PERIOD] = S_COMMENT, [C_LESS] = S_COMMENT,
+        [C_GREATER] = S_COMMENT, [C_COLON] = S_COMMENT
+    }
+};
+
+// What a token ending in each state is -- a token ID, a negated scanner error
+// code, or 0 for no token (end of file reached between tokens / inside a comment)
+static const signed char scanAccept[NUM_SCAN_STATES] =
+{
+    [S_IDENT] = IDENT_SYM, [S_NUMBER] = NUM_SYM, [S_PLUS] = PLUS_SYM,
+    [S_MINUS] = MINUS_SYM, [S_MULT] = MULT_SYM, [S_SLASH] = SLASH_SYM,
+    [S_LPAREN] = LPAREN_SYM, [S_RPAREN] = RPAREN_SYM, [S_EQL] = EQL_SYM,
+    [S_COMMA] = COMMA_SYM, [S_SEMICOLON] = SEMICOLON_SYM, [S_PERIOD] = PERIOD_SYM,
+    [S_LESS] = LESS_SYM, [S_LEQ] = LEQ_SYM, [S_NEQ] = NEQ_SYM,
+    [S_GREATER] = GTR_SYM, [S_GEQ] = GEQ_SYM, [S_BECOMES] = BECOMES_SYM,
+    [S_COLON] = -ERROR_INVALID_SYMBOL, [S_BAD_NAME] = -ERROR_INVALID_VAR_NAME,
+    [S_BAD_SYMBOL] = -ERROR_INVALID_SYMBOL
+};
+
+// Keywords are found with a perfect hash on (length, 2nd char, last char):
+//   slot = (length + keywordAssoc[2nd] + keywordAssoc[last]) % 16
+// Each slot holds at most one keyword, so a hit needs a single length + memcmp check.
+#define KEYWORD_SLOTS 16
+#define MIN_KEYWORD_LENGTH 2
+#define MAX_KEYWORD_LENGTH 9
+
+static const unsigned char keywordAssoc[256] =
+{
+    ['a'] = 11, ['d'] = 14, ['e'] = 3, ['f'] = 15, ['h'] = 12,
+    ['l'] = 2, ['n'] = 2, ['o'] = 10, ['r'] = 0, ['t'] = 14
+};
+
+static const struct
+{
+    const char* name;
+    int length;
+    int id;
+
+} keywordTable[KEYWORD_SLOTS] =
+{
+    [0]  = { "if", 2, IF_SYM },
+    [1]  = { "call", 4, CALL_SYM },
+    [2]  = { "then", 4, THEN_SYM },
+    [3]  = { "end", 3, END_SYM },
+    [4]  = { "while", 5, WHILE_SYM },
+    [5]  = { "read", 4, READ_SYM },
+    [6]  = { "do", 2, DO_SYM },
+    [8]  = { "write", 5, WRITE_SYM },
+    [9]  = { "else", 4, ELSE_SYM },
+    [10] = { "begin", 5, BEGIN_SYM },
+    [12] = { "procedure", 9, PROC_SYM },
+    [13] = { "const", 5, CONST_SYM },
+    [14] = { "var", 3, VAR_SYM },
+    [15] = { "odd", 3, ODD_SYM }
+};
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/stat.h>
+#define HAVE_RUSAGE 1
+#endif
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define HAVE_MALLINFO2 1
+#endif
+
+#include "files.h"
+#include "structs.h"
+#include "compiler.h"
+#include "passes.h"
+
+// Run statistics for compile.exe --stats=json. The driver brackets each phase
+// (scan, parse, vm, ...) with beginPhase() / endPhase(), which do nothing until
+// startStats() is called and from then on take its wall &
+// CPU time, the heap in use after it and the process's peak resident size so
+// far; at exit the phases are written to STATS_FILE as JSON together with the
+// pass times, the token / symbol / instruction counts, and how many bytes the
+// run wrote to each of the files in files.h. Exit is hooked so a compile that
+// stops on an error still reports (its last phase marked incomplete). The heap
+// figures come from malloc's own accounting where the C library offers it
+// (glibc), and are -1 elsewhere.
+
+#define MAX_STATS_PHASES 8
+#define STATS_FILE_COUNT 6
+
+// PROTOTYPES
+void startStats(int level);
+void beginPhase(const char* name);
+void endPhase();
+void writeStats();
+void sampleFile(FileStats* file);
+double statsCPUClock();
+long long heapInUse();
+long long peakResident();
+
+// GLOBALS
+THREAD_LOCAL PhaseStats phaseStats[MAX_STATS_PHASES];
+THREAD_LOCAL int phaseCount = 0;
+THREAD_LOCAL int phaseOpen = 0;
+THREAD_LOCAL int statsEnabled = 0;
+THREAD_LOCAL int statsLevel = 0;
+
+THREAD_LOCAL FileStats fileStats[STATS_FILE_COUNT] =
+{
+    { .name = TABLE_FILE }, { .name = LIST_FILE }, { .name = TOKEN_FILE }, { .name = CODE_FILE },
+    { .name = OBJECT_FILE }, { .name = STACKTRACE_FILE },
+};
+
+// Starts recording a run at an optimization level, writing STATS_FILE at exit
+void startStats(int level)
+{
+    int i;
+
+    statsEnabled = 1;
+    statsLevel = level;
+    phaseCount = 0;
+    phaseOpen = 0;
+
+    // What the files were before, so the ones this run (re)writes can be told apart
+    for (i = 0; i < STATS_FILE_COUNT; i++)
+    {
+        sampleFile(&fileStats[i]);
+        fileStats[i].beforeSize = fileStats[i].size;
+        fileStats[i].beforeModified = fileStats[i].modified;
+        fileStats[i].beforeExisted = fileStats[i].exists;
+    }
+
+    atexit(writeStats);
+}
+
+// Starts timing a phase (ending the one before, if still open)
+void beginPhase(const char* name)
+{
+    PhaseStats* phase;
+
+    if (phaseOpen)
+        endPhase();
+
+    if (!statsEnabled || phaseCount == MAX_STATS_PHASES)
+        return;
+
+    phase = &phaseStats[phaseCount++];
+    memset(phase, 0, sizeof(PhaseStats));
+    phase->name = name;
+    phase->heapBefore = heapInUse();
+    phase->cpuSeconds = statsCPUClock();
+    phase->wallSeconds = passClock();
+    phaseOpen = 1;
+}
+
+// Ends the phase being timed
+void endPhase()
+{
+    PhaseStats* phase;
+
+    if (!phaseOpen)
+        return;
+
+    phase = &phaseStats[phaseCount - 1];
+
+    phase->wallSeconds = passClock() - phase->wallSeconds;
+    phase->cpuSeconds = statsCPUClock() - phase->cpuSeconds;
+    phase->heapAfter = heapInUse();
+    phase->peakResident = peakResident();
+    phase->completed = 1;
+    phaseOpen = 0;
+}
+
+// Writes the run's statistics to STATS_FILE (registered to run at exit)
+void writeStats()
+{
+    FILE* out;
+    PhaseStats* phase;
+    FileStats source = { .name = INPUT_FILE };
+    int i;
+
+    // A phase still open stopped early (on a compile error)
+    if (phaseOpen)
+    {
+        endPhase();
+        phaseStats[phaseCount - 1].completed = 0;
+    }
+
+    out = fopen(STATS_FILE, "w");
+    if (out == NULL)
+        return;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"compilerVersion\": %d,\n", COMPILER_VERSION);
+    fprintf(out, "  \"optimizeLevel\": %d,\n", statsLevel);
+    sampleFile(&source);
+    fprintf(out, "  \"source\": { \"file\": \"%s\", \"bytes\": %lld },\n", source.name, source.size);
+
+    fprintf(out, "  \"phases\": [\n");
+
+    for (i = 0; i < phaseCount; i++)
+    {
+        phase = &phaseStats[i];
+
+        fprintf(out, "    { \"name\": \"%s\", \"completed\": %s, \"wallMs\": %.3f, \"cpuMs\": %.3f, "
+                     "\"heapBytes\": %lld, \"heapChangeBytes\": %lld, \"peakResidentBytes\": %lld }%s\n",
+                phase->name, (phase->completed) ? "true" : "false", phase->wallSeconds * 1000,
+                phase->cpuSeconds * 1000, phase->heapAfter,
+                (phase->heapAfter < 0) ? -1 : phase->heapAfter - phase->heapBefore, phase->peakResident,
+                (i + 1 < phaseCount) ? "," : "");
+    }
+
+    fprintf(out, "  ],\n");
+
+    // The front end's own breakdown, as -t prints it
+    fprintf(out, "  \"passes\": [\n");
+    fprintf(out, "    { \"name\": \"parse\", \"changes\": null, \"ms\": %.3f }", parseSeconds * 1000);
+
+    if (statsLevel >= IR_LEVEL)
+        fprintf(out, ",\n    { \"name\": \"build-ssa\", \"changes\": null, \"ms\": %.3f }", buildSeconds * 1000);
+
+    fprintf(out, ",\n    { \"name\": \"codegen\", \"changes\": null, \"ms\": %.3f }", generateSeconds * 1000);
+
+    for (i = 0; i < PASS_COUNT; i++)
+    {
+        if (passes[i].level <= statsLevel)
+            fprintf(out, ",\n    { \"name\": \"%s\", \"changes\": %d, \"ms\": %.3f }", passes[i].name,
+                    passes[i].changes, passes[i].seconds * 1000);
+    }
+
+    fprintf(out, "\n  ],\n");
+
+    fprintf(out, "  \"counts\": { \"tokens\": %d, \"identifiers\": %d, \"symbols\": %d, "
+                 "\"instructions\": %d, \"dispatches\": %lld },\n",
+            tokens.count, identifiers.count, symbols.count, (codeIndex) ? codeIndex : linesOfCode, dispatchCount);
+
+    fprintf(out, "  \"peakResidentBytes\": %lld,\n", peakResident());
+
+    // Bytes in each file this run wrote (0 for those it left alone)
+    fprintf(out, "  \"bytesWritten\": {");
+
+    for (i = 0; i < STATS_FILE_COUNT; i++)
+    {
+        sampleFile(&fileStats[i]);
+
+        if (!fileStats[i].exists || (fileStats[i].beforeExisted && fileStats[i].modified == fileStats[i].beforeModified &&
+                                     fileStats[i].size == fileStats[i].beforeSize))
+            fileStats[i].size = 0;
+
+        fprintf(out, "%s \"%s\": %lld", (i) ? "," : "", fileStats[i].name, fileStats[i].size);
+    }
+
+    fprintf(out, " }\n");
+    fprintf(out, "}\n");
+
+    fclose(out);
+}
+
+// Fills in whether a file exists, its size and when it was last modified
+void sampleFile(FileStats* file)
+{
+    file->exists = 0;
+    file->size = 0;
+    file->modified = 0;
+
+#ifdef HAVE_RUSAGE
+    {
+        struct stat info;
+
+        if (stat(file->name, &info) != 0)
+            return;
+
+        file->exists = 1;
+        file->size = info.st_size;
+#ifdef __APPLE__
+        file->modified = info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+        file->modified = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+    }
+#else
+    {
+        FILE* in = fopen(file->name, "rb");
+
+        if (in == NULL)
+            return;
+
+        fseek(in, 0, SEEK_END);
+        file->exists = 1;
+        file->size = ftell(in);
+        fclose(in);
+    }
+#endif
+}
+
+// Returns the CPU time the process has used (all threads), in seconds
+double statsCPUClock()
+{
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// Returns the bytes of heap allocated & not yet freed, -1 if unknown
+long long heapInUse()
+{
+#ifdef HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    return (long long) (info.uordblks + info.hblkhd);
+#else
+    return -1;
+#endif
+}
+
+// Returns the most memory the process has had resident at once, -1 if unknown
+long long peakResident()
+{
+#ifdef HAVE_RUSAGE
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+
+#ifdef __APPLE__
+    return (long long) usage.ru_maxrss;
+#else
+    return (long long) usage.ru_maxrss * 1024;
+#endif
+#else
+    return -1;
+#endif
+}
+
+#endif
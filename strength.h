@@ -0,0 +1,130 @@
+#ifndef STRENGTH_H
+#define STRENGTH_H
+
+#include "structs.h"
+#include "ast.h"
+#include "pm0_constants.h"
+
+// Tree pass that trades operators for cheaper ones the VM computes the same way:
+// a multiplication by a power of two becomes a left shift (both wrap alike), a
+// division by one a right shift (SHR rounds negatives toward zero, as DIV does)
+// and odd a mask of the lowest bit (1 for any odd number, negatives included).
+// Runs after folding, so the constant operands it looks for are already numbers.
+
+// PROTOTYPES
+int reduceStrength(Node* program);
+int reduceBlock(Node* block);
+void reduceStatement(Node* statement, int* reduced);
+void reduceExpression(Node* expression, int* reduced);
+int powerOfTwo(Node* node);
+
+// Reduces every block in the program, returns how many operators were replaced
+int reduceStrength(Node* program)
+{
+    return reduceBlock(program);
+}
+
+// Reduces a block and the blocks of its procedures
+int reduceBlock(Node* block)
+{
+    int reduced = 0;
+    Node* procedure;
+
+    for (procedure = block->child[0]; procedure != NULL; procedure = procedure->next)
+        reduced += reduceBlock(procedure);
+
+    reduceStatement(block->child[1], &reduced);
+
+    return reduced;
+}
+
+// Reduces the expressions in a statement
+void reduceStatement(Node* statement, int* reduced)
+{
+    Node* next;
+
+    if (statement == NULL)
+        return;
+
+    switch (statement->kind)
+    {
+        case NODE_ASSIGN:
+        case NODE_WRITE:
+            reduceExpression(statement->child[0], reduced);
+            break;
+
+        case NODE_BEGIN:
+            for (next = statement->child[0]; next != NULL; next = next->next)
+                reduceStatement(next, reduced);
+            break;
+
+        case NODE_IF:
+        case NODE_WHILE:
+            reduceExpression(statement->child[0], reduced);
+            reduceStatement(statement->child[1], reduced);
+            break;
+    }
+}
+
+// Rewrites an expression's operators in place, bottom up
+void reduceExpression(Node* expression, int* reduced)
+{
+    Node* swap;
+    int shift;
+
+    if (expression->kind != NODE_UNARY && expression->kind != NODE_BINARY)
+        return;
+
+    reduceExpression(expression->child[0], reduced);
+
+    if (expression->kind == NODE_BINARY)
+        reduceExpression(expression->child[1], reduced);
+
+    switch (expression->op)
+    {
+        case ODD:
+            expression->kind = NODE_BINARY;
+            expression->op = AND;
+            expression->child[1] = newNode(NODE_NUMBER);
+            expression->child[1]->value = 1;
+            (*reduced)++;
+            break;
+
+        case MUL:
+            // Multiplication commutes, keep the power on the right
+            if (powerOfTwo(expression->child[1]) < 0 && powerOfTwo(expression->child[0]) >= 0)
+            {
+                swap = expression->child[0];
+                expression->child[0] = expression->child[1];
+                expression->child[1] = swap;
+            }
+
+            // Falls through
+        case DIV:
+            shift = powerOfTwo(expression->child[1]);
+
+            if (shift < 0)
+                break;
+
+            expression->op = (expression->op == MUL) ? SHL : SHR;
+            expression->child[1]->value = shift;
+            (*reduced)++;
+            break;
+    }
+}
+
+// Returns k when a node is the number 2^k (k at least 1), otherwise -1
+int powerOfTwo(Node* node)
+{
+    int shift = 0;
+
+    if (node->kind != NODE_NUMBER || node->value < 2 || (node->value & (node->value - 1)) != 0)
+        return -1;
+
+    while ((1 << shift) != node->value)
+        shift++;
+
+    return shift;
+}
+
+#endif
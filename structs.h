@@ -1,6 +1,16 @@
 #ifndef STRUCTS_H
 #define STRUCTS_H
 
+// Storage class of the compiler's working state (its globals): each thread gets
+// a copy of its own, so compiles on different threads never touch each other's
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
 typedef struct
 {
 	int OP;
@@ -12,8 +22,9 @@ typedef struct
 typedef struct
 {
     char* value;
+    int length;
+    int number;
     int id;
-    int type;
     int error;
     int endOfFile;
     
@@ -21,11 +32,392 @@ typedef struct
 
 typedef struct
 {
-    char *name;
+    char* text;
+    int length;
+    int position;
+    int mapped;
+    
+} Source;
+
+typedef struct
+{
+    unsigned char* kind;
+    unsigned int* offset;
+    unsigned int* length;
+    int* value;
+    int count;
+    int capacity;
+    
+} TokenBuffer;
+
+typedef struct
+{
+    char magic[4];
+    unsigned int version;
+    unsigned int tokenCount;
+    unsigned int stringCount;
+    unsigned int stringBytes;
+    
+} TokenFileHeader;
+
+typedef struct
+{
+    char magic[4];
+    unsigned int version;
+    unsigned int instructionCount;
+    unsigned int entryPoint;
+    unsigned int maxStack;
+    
+} ObjectFileHeader;
+
+typedef struct
+{
+    const char* name;
+    int completed;
+    double wallSeconds;
+    double cpuSeconds;
+    long long heapBefore;
+    long long heapAfter;
+    long long peakResident;
+    
+} PhaseStats;
+
+typedef struct
+{
+    const char* name;
+    int exists;
+    long long size;
+    long long modified;
+    int beforeExisted;
+    long long beforeSize;
+    long long beforeModified;
+    
+} FileStats;
+
+typedef struct
+{
+    char* data;
+    long size;
+    int mapped;
+    ObjectFileHeader* header;
+    Instruction* code;
+    
+} ObjectFile;
+
+typedef struct
+{
+    Instruction* code;
+    int length;
+    int* height;
+    int* owner;
+    int* depth;
+    int* work;
+    int top;
+    int capacity;
+    
+} StackWalk;
+
+typedef struct
+{
+    unsigned char kind;
+    unsigned char padding[3];
+    unsigned int offset;
+    unsigned int length;
+    int value;
+    
+} TokenRecord;
+
+typedef struct
+{
+    Source* source;
+    int begin;
+    int end;
+    int inComment;
+    int endsInComment[2];
+    TokenBuffer tokens;
+    int error;
+    int errorOffset;
+    int skipKernel;
+    
+} ScanChunk;
+
+typedef struct ArenaBlock
+{
+    struct ArenaBlock* next;
+    int used;
+    int size;
+    char data[];
+    
+} ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock* head;
+    
+} Arena;
+
+typedef struct
+{
+    Arena arena;
+    char** names;
+    int* lengths;
+    unsigned int* hashes;
+    int* slots;
+    int count;
+    int slotCount;
+    
+} InternTable;
+
+typedef struct
+{
+    TokenRecord* slots;
+    unsigned int mask;
+    unsigned int head;
+    unsigned int cachedTail;
+    char consumerPadding[52];
+    unsigned int tail;
+    unsigned int cachedHead;
+    char producerPadding[56];
+    Source cursor;
+    InternTable* names;
+    int skipKernel;
+    
+} TokenRing;
+
+typedef struct
+{
+    int tokenStart;
+    int tokenEnd;
+    int codeStart;
+    int codeEnd;
+    int scope;
+    int symbolEnd;
+    
+} StatementSpan;
+
+typedef struct
+{
+    int status;
+    int relexedTokens;
+    int reparsedTokens;
+    
+} EditResult;
+
+typedef struct
+{
+    int name;
     int id;
     int level;
     int stackPointer;
+    int value;
+    int scope;
+    int next;
+    
+} Symbol;
+
+typedef struct
+{
+    int parent;
+    int level;
+    int firstSymbol;
+    
+} Scope;
+
+typedef struct
+{
+    Symbol* symbols;
+    int count;
+    int capacity;
+    int* buckets;
+    int bucketCount;
+    Scope* scopes;
+    int scopeCount;
+    int scopeCapacity;
+    int current;
+    
+} SymbolTable;
+
+typedef struct Node
+{
+    int kind;
+    int op;
+    int value;
+    int symbol;
+    int level;
+    int span;
+    struct Node* child[3];
+    struct Node* next;
+    
+} Node;
+
+typedef struct
+{
+    char* name;
+    int stage;
+    int level;
+    int (*run)(Node* program);
+    int changes;
+    double seconds;
+    
+} Pass;
+
+typedef struct
+{
+    int kind;
+    int op;
+    int value;
+    int symbol;
+    int level;
+    int block;
+    int operand[2];
+    int* phiOperand;
+    int variable;
+    int replacement;
+    int dead;
+    int slot;
+    
+} IRValue;
+
+typedef struct
+{
+    int* values;
+    int count;
+    int capacity;
+    int* preds;
+    int predCount;
+    int predCapacity;
+    int exit;
+    int condition;
+    int succ[2];
+    int succCount;
+    int sealed;
+    int dead;
+    
+} IRBlock;
+
+typedef struct
+{
+    int preheader;
+    int header;
+    int last;
+    
+} IRLoop;
+
+typedef struct
+{
+    Node* node;
+    int failed;
+    IRValue* values;
+    int valueCount;
+    int valueCapacity;
+    IRBlock* blocks;
+    int blockCount;
+    int blockCapacity;
+    IRLoop* loops;
+    int loopCount;
+    int loopCapacity;
+    int* variableSymbol;
+    int variableCount;
+    int* entryValue;
+    int* currentDef;
+    int current;
+    int frameSize;
+    
+} IRFunction;
+
+typedef struct
+{
+    int phase;
+    int code;
+    int offset;
+    int line;
+    int column;
+    const char* message;
+    
+} Diagnostic;
+
+typedef struct
+{
+    int optimizeLevel;
+    Instruction* code;
+    int codeLength;
+    Diagnostic* diagnostics;
+    int diagnosticCount;
+    int diagnosticCapacity;
+    
+} Compiler;
+
+typedef struct
+{
+    unsigned long long range;
+    struct WorkPool* pool;
+    int index;
+    int steals;
+    char padding[40];
+    
+} PoolWorker;
+
+typedef struct WorkPool
+{
+    PoolWorker* workers;
+    int count;
+    void (*run)(void* context, int job, int worker);
+    void (*finish)(void* context, int worker);
+    void* context;
+    
+} WorkPool;
+
+typedef struct
+{
+    char* path;
+    char* output;
+    int sourceBytes;
+    Instruction* code;
+    int codeLength;
+    int failed;
+    Diagnostic diagnostic;
+    
+} BatchJob;
+
+typedef struct
+{
+    char magic[4];
+    unsigned int version;
+    unsigned int compilerVersion;
+    int optimizeLevel;
+    unsigned long long key;
+    int sourceLength;
+    int codeLength;
+    int diagnosticCount;
+    
+} CacheFileHeader;
+
+typedef struct
+{
+    char* name;
+    long long size;
+    long long lastUsed;
+    
+} CacheEntry;
+
+typedef struct
+{
+    char* directory;
+    long long capacity;
+    long long size;
+    int trimming;
+    int hits;
+    int misses;
+    unsigned int files;
+    
+} CompileCache;
+
+typedef struct
+{
+    BatchJob* jobs;
+    int optimizeLevel;
+    CompileCache* cache;
     
-} Symbol; 
+} BatchContext;
     
 #endif
\ No newline at end of file
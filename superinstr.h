@@ -0,0 +1,130 @@
+#ifndef SUPERINSTR_H
+#define SUPERINSTR_H
+
+#include "structs.h"
+#include "pm0_constants.h"
+
+// Code pass that picks superinstructions: windows from the table below become
+// one fused opcode the VM runs in a single dispatch. Only the first instruction
+// of a window is rewritten (its OP becomes the fused one, L & M stay); the rest
+// stay where they are as its operands, and the VM steps over them. Nothing moves,
+// so jump & procedure addresses stay valid, and a jump that lands inside a window
+// still finds the original instructions there. Runs last, the other passes only
+// know the plain PM/0 instruction set.
+
+#define SUPER_ANY -1
+#define SUPER_BINARY -2
+#define SUPER_MAX_WINDOW 4
+
+// A window of instructions (OP & M, SUPER_ANY matching any M and SUPER_BINARY
+// any two operand OPR) and the opcode it fuses into; storeBack windows also need
+// their last instruction to store to the variable the first one loaded
+typedef struct
+{
+    char* name;
+    int fused;
+    int length;
+    int storeBack;
+    int op[SUPER_MAX_WINDOW];
+    int m[SUPER_MAX_WINDOW];
+
+} SuperinstructionRule;
+
+// PROTOTYPES
+int selectSuperinstructions(Node* program);
+int matchSuperinstruction(SuperinstructionRule* rule, int at);
+int isBinaryOperator(int m);
+
+// GLOBALS
+SuperinstructionRule superinstructionRules[] =
+{
+    { "load load branch",     LLB, 4, 0, { LOD, LOD, OPR, JPC }, { SUPER_ANY, SUPER_ANY, SUPER_BINARY, SUPER_ANY } },
+    { "load literal branch",  LCB, 4, 0, { LOD, LIT, OPR, JPC }, { SUPER_ANY, SUPER_ANY, SUPER_BINARY, SUPER_ANY } },
+    { "increment variable",   ADI, 4, 1, { LOD, LIT, OPR, STO }, { SUPER_ANY, SUPER_ANY, ADD, SUPER_ANY } },
+    { "load load operate",    LLO, 3, 0, { LOD, LOD, OPR },      { SUPER_ANY, SUPER_ANY, SUPER_BINARY } },
+    { "load literal operate", LCO, 3, 0, { LOD, LIT, OPR },      { SUPER_ANY, SUPER_ANY, SUPER_BINARY } },
+    { "store literal",        LST, 2, 0, { LIT, STO },           { SUPER_ANY, SUPER_ANY } },
+};
+
+#define SUPERINSTRUCTION_RULE_COUNT ((int) (sizeof(superinstructionRules) / sizeof(SuperinstructionRule)))
+
+// Fuses windows left to right without overlapping, the first (longest) rule that
+// matches wins -- returns how many were fused
+int selectSuperinstructions(Node* program)
+{
+    int i, rule, fused = 0;
+
+    (void) program;
+
+    for (i = 0; i < codeIndex; i++)
+    {
+        for (rule = 0; rule < SUPERINSTRUCTION_RULE_COUNT; rule++)
+        {
+            if (!matchSuperinstruction(&superinstructionRules[rule], i))
+                continue;
+
+            parseCode[i].OP = superinstructionRules[rule].fused;
+            i += superinstructionRules[rule].length - 1;
+            fused++;
+            break;
+        }
+    }
+
+    return fused;
+}
+
+// Returns whether a rule's window matches the code at an address
+int matchSuperinstruction(SuperinstructionRule* rule, int at)
+{
+    Instruction* last;
+    int j;
+
+    if (at + rule->length > codeIndex)
+        return 0;
+
+    for (j = 0; j < rule->length; j++)
+    {
+        if (parseCode[at + j].OP != rule->op[j])
+            return 0;
+
+        if (rule->m[j] == SUPER_BINARY && !isBinaryOperator(parseCode[at + j].M))
+            return 0;
+
+        if (rule->m[j] >= 0 && parseCode[at + j].M != rule->m[j])
+            return 0;
+    }
+
+    last = &parseCode[at + rule->length - 1];
+
+    if (rule->storeBack && (last->L != parseCode[at].L || last->M != parseCode[at].M))
+        return 0;
+
+    return 1;
+}
+
+// Returns whether an OPR M value pops two operands & pushes one
+int isBinaryOperator(int m)
+{
+    switch (m)
+    {
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+        case MOD:
+        case EQL:
+        case NEQ:
+        case LSS:
+        case LEQ:
+        case GTR:
+        case GEQ:
+        case SHL:
+        case SHR:
+        case AND:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs.h"
+
+// Lexically scoped symbol table. Symbols are appended to one array and chained
+// into hash buckets keyed on their interned name, newest first, so a lookup walks
+// a single short chain and the first match is the innermost declaration. Every
+// block() opens a scope; closing it unlinks the scope's symbols from their chains
+// (they are always at the front), uncovering whatever they shadowed. Closed
+// scopes' symbols stay in the array so a statement can later be re-parsed with the
+// scope it was first parsed in (restoreScope).
+
+#define SYMTAB_INITIAL_BUCKETS 256
+#define NO_SCOPE -1
+#define NO_SYMBOL -1
+
+// PROTOTYPES
+void resetSymbolTable(SymbolTable* table);
+void freeSymbolTable(SymbolTable* table);
+void openScope(SymbolTable* table);
+void closeScope(SymbolTable* table);
+void restoreScope(SymbolTable* table, int scope, int symbolEnd);
+int enterSymbol(SymbolTable* table, int name, int id, int level, int stackPointer);
+int copySymbol(SymbolTable* table, int symbol, int level, int stackPointer);
+int findSymbol(SymbolTable* table, int name);
+void linkSymbol(SymbolTable* table, int symbol);
+void growBuckets(SymbolTable* table);
+int scopeLevel(SymbolTable* table);
+
+// GLOBALS
+THREAD_LOCAL SymbolTable symbols;
+
+// Empties the table (keeping its memory)
+void resetSymbolTable(SymbolTable* table)
+{
+    table->count = 0;
+    table->scopeCount = 0;
+    table->current = NO_SCOPE;
+
+    if (table->bucketCount == 0)
+        growBuckets(table);
+    else
+        memset(table->buckets, -1, table->bucketCount * sizeof(int));
+}
+
+// Releases the table's memory, leaving it empty
+void freeSymbolTable(SymbolTable* table)
+{
+    free(table->symbols);
+    free(table->buckets);
+    free(table->scopes);
+    memset(table, 0, sizeof(SymbolTable));
+}
+
+// Starts a scope nested in the current one, one lexical level deeper
+void openScope(SymbolTable* table)
+{
+    Scope* scope;
+
+    if (table->scopeCount == table->scopeCapacity)
+    {
+        table->scopeCapacity = (table->scopeCapacity) ? table->scopeCapacity * 2 : 16;
+        table->scopes = realloc(table->scopes, table->scopeCapacity * sizeof(Scope));
+    }
+
+    scope = &table->scopes[table->scopeCount];
+    scope->parent = table->current;
+    scope->level = (table->current == NO_SCOPE) ? 0 : table->scopes[table->current].level + 1;
+    scope->firstSymbol = table->count;
+
+    table->current = table->scopeCount++;
+}
+
+// Ends the current scope, unlinking its symbols newest first
+void closeScope(SymbolTable* table)
+{
+    Scope* scope = &table->scopes[table->current];
+    Symbol* symbol;
+    int i;
+
+    for (i = table->count - 1; i >= scope->firstSymbol; i--)
+    {
+        symbol = &table->symbols[i];
+
+        if (symbol->scope == table->current)
+            table->buckets[symbol->name & (table->bucketCount - 1)] = symbol->next;
+    }
+
+    table->current = scope->parent;
+}
+
+// Makes scope current again with just the symbols it could see at symbolEnd
+// (what had been declared by the time the statement was first parsed)
+void restoreScope(SymbolTable* table, int scope, int symbolEnd)
+{
+    char* visible = calloc(table->scopeCount + 1, 1);
+    int i;
+
+    for (i = scope; i != NO_SCOPE; i = table->scopes[i].parent)
+        visible[i] = 1;
+
+    memset(table->buckets, -1, table->bucketCount * sizeof(int));
+
+    // Oldest first, so shadowing declarations end up in front
+    for (i = 0; i < symbolEnd && i < table->count; i++)
+    {
+        if (visible[table->symbols[i].scope])
+            linkSymbol(table, i);
+    }
+
+    table->current = scope;
+    free(visible);
+}
+
+// Declares a name in the current scope, returns its symbol index
+int enterSymbol(SymbolTable* table, int name, int id, int level, int stackPointer)
+{
+    Symbol* symbol;
+
+    if (table->count == table->capacity)
+    {
+        table->capacity = (table->capacity) ? table->capacity * 2 : 64;
+        table->symbols = realloc(table->symbols, table->capacity * sizeof(Symbol));
+    }
+
+    // Keep chains short, about one symbol per bucket
+    if (table->count >= table->bucketCount)
+        growBuckets(table);
+
+    symbol = &table->symbols[table->count];
+    symbol->name = name;
+    symbol->id = id;
+    symbol->level = level;
+    symbol->stackPointer = stackPointer;
+    symbol->value = 0;
+    symbol->scope = table->current;
+
+    linkSymbol(table, table->count);
+
+    return table->count++;
+}
+
+// Adds a copy of a symbol at another level & slot (for a variable the optimizer
+// moves into another frame), not linked into any chain -- returns its index
+int copySymbol(SymbolTable* table, int symbol, int level, int stackPointer)
+{
+    if (table->count == table->capacity)
+    {
+        table->capacity = (table->capacity) ? table->capacity * 2 : 64;
+        table->symbols = realloc(table->symbols, table->capacity * sizeof(Symbol));
+    }
+
+    table->symbols[table->count] = table->symbols[symbol];
+    table->symbols[table->count].level = level;
+    table->symbols[table->count].stackPointer = stackPointer;
+    table->symbols[table->count].next = NO_SYMBOL;
+
+    return table->count++;
+}
+
+// Returns the innermost visible symbol for a name (NO_SYMBOL if undeclared)
+int findSymbol(SymbolTable* table, int name)
+{
+    int i;
+
+    for (i = table->buckets[name & (table->bucketCount - 1)]; i != NO_SYMBOL; i = table->symbols[i].next)
+    {
+        if (table->symbols[i].name == name)
+            return i;
+    }
+
+    return NO_SYMBOL;
+}
+
+// Pushes a symbol onto the front of its bucket's chain. Interned names are
+// handed out densely from 0, so the low bits of the name already spread them
+// evenly over the buckets.
+void linkSymbol(SymbolTable* table, int symbol)
+{
+    int* bucket = &table->buckets[table->symbols[symbol].name & (table->bucketCount - 1)];
+
+    table->symbols[symbol].next = *bucket;
+    *bucket = symbol;
+}
+
+// Doubles the buckets, relinking the visible symbols oldest first
+void growBuckets(SymbolTable* table)
+{
+    int bucketCount = (table->bucketCount) ? table->bucketCount * 2 : SYMTAB_INITIAL_BUCKETS;
+    char* visible = calloc(table->count + 1, 1);
+    int i, j;
+
+    for (i = 0; i < table->bucketCount; i++)
+    {
+        for (j = table->buckets[i]; j != NO_SYMBOL; j = table->symbols[j].next)
+            visible[j] = 1;
+    }
+
+    table->buckets = realloc(table->buckets, bucketCount * sizeof(int));
+    table->bucketCount = bucketCount;
+    memset(table->buckets, -1, bucketCount * sizeof(int));
+
+    for (i = 0; i < table->count; i++)
+    {
+        if (visible[i])
+            linkSymbol(table, i);
+    }
+
+    free(visible);
+}
+
+// Returns the lexical level of the current scope
+int scopeLevel(SymbolTable* table)
+{
+    return (table->current == NO_SCOPE) ? 0 : table->scopes[table->current].level;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef TAILCALL_H
+#define TAILCALL_H
+
+#include "structs.h"
+#include "ast.h"
+#include "pm0_constants.h"
+
+// Code pass turning calls in tail position into TCA, which hands the caller's
+// frame to the callee instead of pushing a new one on top of it: a procedure
+// calling itself (or another) as the last thing it does then runs in constant
+// stack space, and the callee's RET goes straight back to where the caller
+// would have returned to. A call is in tail position when the next instruction
+// that runs after it, through any jumps, is a RET. The callee's static link
+// must not be the frame being reused, so only calls at least one level out
+// (L > 0: a procedure calling itself or a sibling, not one of its own) qualify.
+
+#define TAIL_MAX_HOPS 16
+
+// PROTOTYPES
+int eliminateTailCalls(Node* program);
+int reachesReturn(int address);
+
+// Rewrites every call in tail position, returns how many there were
+int eliminateTailCalls(Node* program)
+{
+    int i, rewritten = 0;
+
+    (void) program;
+
+    for (i = 0; i < codeIndex; i++)
+    {
+        if (parseCode[i].OP != CAL || parseCode[i].L == 0 || !reachesReturn(i + 1))
+            continue;
+
+        parseCode[i].OP = TCA;
+        rewritten++;
+    }
+
+    return rewritten;
+}
+
+// Returns whether the code at an address returns right away, following jumps
+int reachesReturn(int address)
+{
+    int hops;
+
+    for (hops = 0; hops < TAIL_MAX_HOPS && address >= 0 && address < codeIndex; hops++)
+    {
+        if (parseCode[address].OP == OPR && parseCode[address].M == RET)
+            return 1;
+
+        if (parseCode[address].OP != JMP)
+            return 0;
+
+        address = parseCode[address].M;
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,530 @@
+#ifndef THREADED_H
+#define THREADED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "structs.h"
+#include "pm0_constants.h"
+
+// Untraced interpreter core, run by runProgram() in place of runCode()'s fetch /
+// execute loop. Each instruction is decoded once, before the run, into the number
+// of its handler -- an OPR by its M value as well, so operators need no second
+// switch. With GCC's labels as values the numbers are then turned into handler
+// addresses and every handler ends by jumping straight to the next instruction's
+// (direct threading); elsewhere, or with VM_SWITCH_DISPATCH defined, the same
+// handlers are the cases of one switch. PC, BP, SP and the stack are locals for
+// the whole run and are written back to the VM's globals (with dispatchCount) at
+// the end. The program runs exactly as under runCode(), one dispatch per
+// instruction; superinstructions still apply their operator through operate().
+// Jump, call and branch targets are decoded too: one past the code (or a
+// superinstruction missing its operands) decodes to a HALT slot at the end, as
+// does a return to an address outside the code, so no run can leave the table.
+// A push past the end of the stack, or a division by zero (or of INT_MIN by -1),
+// stops the run at the instruction with an error instead of taking the process
+// down with it.
+
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED 1
+#endif
+
+// Handler numbers
+#define VM_NOP 0
+#define VM_LIT 1
+#define VM_LOD 2
+#define VM_STO 3
+#define VM_CAL 4
+#define VM_INC 5
+#define VM_JMP 6
+#define VM_JPC 7
+#define VM_OUT 8
+#define VM_IN 9
+#define VM_RET 10
+#define VM_NEG 11
+#define VM_ODD 12
+#define VM_ADD 13
+#define VM_SUB 14
+#define VM_MUL 15
+#define VM_DIV 16
+#define VM_MOD 17
+#define VM_EQL 18
+#define VM_NEQ 19
+#define VM_LSS 20
+#define VM_LEQ 21
+#define VM_GTR 22
+#define VM_GEQ 23
+#define VM_SHL 24
+#define VM_SHR 25
+#define VM_AND 26
+#define VM_LLO 27
+#define VM_LCO 28
+#define VM_LLB 29
+#define VM_LCB 30
+#define VM_ADI 31
+#define VM_LST 32
+#define VM_TCA 33
+#define VM_HALT 34
+#define VM_HANDLER_COUNT 35
+
+// Run errors (runThreaded()'s result)
+#define VM_RUN_OK 0
+#define VM_STACK_OVERFLOW 1
+#define VM_DIVIDE_BY_ZERO 2
+#define VM_DIVIDE_OVERFLOW 3
+
+// A handler's entry, and the jump to the next instruction's
+#ifdef VM_THREADED
+#define VM_HANDLER(handler) handler##_HANDLER:
+#define VM_NEXT() do { ir = &program[pc]; dispatches++; goto *threaded[pc]; } while (0)
+#else
+#define VM_HANDLER(handler) case handler:
+#define VM_NEXT() goto dispatch
+#endif
+
+// Stops the run unless the stack has room for count more cells
+#define VM_NEED(count) if (sp + (count) >= stackCells) { error = VM_STACK_OVERFLOW; goto done; }
+
+// Stops the run before a division (or modulo) that would trap
+#define VM_CHECK_DIVISION(op, left, right) \
+    if (((right) == 0 || ((right) == -1 && (left) == INT_MIN)) && ((op) == DIV || (op) == MOD)) \
+    { error = ((right) == 0) ? VM_DIVIDE_BY_ZERO : VM_DIVIDE_OVERFLOW; goto done; }
+
+// PROTOTYPES
+int runThreaded(int entry, int stackSize);
+const char* runErrorMessage(int error);
+int decodeHandler(Instruction* program, int length, int address);
+int decodeTarget(Instruction* program, int length, int address);
+int chainBase(int* cells, int bp, int level);
+
+// Runs the loaded code untraced from an entry address to the end state on a stack
+// of stackSize cells (MAXSTACK for OBJECT_UNBOUNDED_STACK) -- returns VM_RUN_OK,
+// or the error that stopped it at PC
+int runThreaded(int entry, int stackSize)
+{
+    Instruction* program = code;
+    Instruction* ir = program;
+    unsigned char* handlers = malloc(linesOfCode + 1);
+    int* targets = malloc((linesOfCode + 1) * sizeof(int));
+    int stackCells = (stackSize == OBJECT_UNBOUNDED_STACK) ? MAXSTACK : stackSize;
+    int* cells = initStack(stackCells);
+    int i, length = linesOfCode, pc = entry, bp = 0, sp = -1, left, right, error = VM_RUN_OK;
+    long long dispatches = 0;
+    FILE* input = (vmInput != NULL) ? vmInput : stdin;
+    FILE* output = (vmOutput != NULL) ? vmOutput : stdout;
+#ifdef VM_THREADED
+    static void* const labels[VM_HANDLER_COUNT] =
+    {
+        [VM_NOP] = &&VM_NOP_HANDLER, [VM_LIT] = &&VM_LIT_HANDLER, [VM_LOD] = &&VM_LOD_HANDLER,
+        [VM_STO] = &&VM_STO_HANDLER, [VM_CAL] = &&VM_CAL_HANDLER, [VM_INC] = &&VM_INC_HANDLER,
+        [VM_JMP] = &&VM_JMP_HANDLER, [VM_JPC] = &&VM_JPC_HANDLER, [VM_OUT] = &&VM_OUT_HANDLER,
+        [VM_IN] = &&VM_IN_HANDLER, [VM_RET] = &&VM_RET_HANDLER, [VM_NEG] = &&VM_NEG_HANDLER,
+        [VM_ODD] = &&VM_ODD_HANDLER, [VM_ADD] = &&VM_ADD_HANDLER, [VM_SUB] = &&VM_SUB_HANDLER,
+        [VM_MUL] = &&VM_MUL_HANDLER, [VM_DIV] = &&VM_DIV_HANDLER, [VM_MOD] = &&VM_MOD_HANDLER,
+        [VM_EQL] = &&VM_EQL_HANDLER, [VM_NEQ] = &&VM_NEQ_HANDLER, [VM_LSS] = &&VM_LSS_HANDLER,
+        [VM_LEQ] = &&VM_LEQ_HANDLER, [VM_GTR] = &&VM_GTR_HANDLER, [VM_GEQ] = &&VM_GEQ_HANDLER,
+        [VM_SHL] = &&VM_SHL_HANDLER, [VM_SHR] = &&VM_SHR_HANDLER, [VM_AND] = &&VM_AND_HANDLER,
+        [VM_LLO] = &&VM_LLO_HANDLER, [VM_LCO] = &&VM_LCO_HANDLER, [VM_LLB] = &&VM_LLB_HANDLER,
+        [VM_LCB] = &&VM_LCB_HANDLER, [VM_ADI] = &&VM_ADI_HANDLER, [VM_LST] = &&VM_LST_HANDLER,
+        [VM_TCA] = &&VM_TCA_HANDLER, [VM_HALT] = &&VM_HALT_HANDLER,
+    };
+    void** threaded = malloc((linesOfCode + 1) * sizeof(void*));
+#endif
+
+    // Running off the end (or jumping past it) stops the run rather than
+    // reading past the code
+    for (i = 0; i < length; i++)
+    {
+        handlers[i] = decodeHandler(program, length, i);
+        targets[i] = decodeTarget(program, length, i);
+    }
+
+    handlers[length] = VM_HALT;
+
+    if (pc < 0 || pc > length)
+        pc = length;
+
+#ifdef VM_THREADED
+    for (i = 0; i <= length; i++)
+        threaded[i] = labels[handlers[i]];
+
+    VM_NEXT();
+#else
+dispatch:
+    ir = &program[pc];
+    dispatches++;
+
+    switch (handlers[pc])
+#endif
+    {
+        // Invalid instructions (and OPRs) do nothing
+        VM_HANDLER(VM_NOP)
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_LIT)
+            VM_NEED(1);
+            cells[++sp] = ir->M;
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_LOD)
+            VM_NEED(1);
+            sp++;
+            cells[sp] = cells[chainBase(cells, bp, ir->L) + ir->M];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_STO)
+            cells[chainBase(cells, bp, ir->L) + ir->M] = cells[sp];
+            sp--;
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_CAL)
+            VM_NEED(3);
+            cells[sp + 1] = chainBase(cells, bp, ir->L);
+            cells[sp + 2] = bp;
+            cells[sp + 3] = pc + 1;
+            bp = sp + 1;
+            pc = targets[pc];
+            VM_NEXT();
+
+        VM_HANDLER(VM_TCA)
+            cells[bp] = chainBase(cells, bp, ir->L);
+            sp = bp - 1;
+            pc = targets[pc];
+            VM_NEXT();
+
+        VM_HANDLER(VM_INC)
+            VM_NEED(ir->M);
+
+            if (sp + ir->M < -1)
+            {
+                error = VM_STACK_OVERFLOW;
+                goto done;
+            }
+
+            sp += ir->M;
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_JMP)
+            pc = targets[pc];
+            VM_NEXT();
+
+        VM_HANDLER(VM_JPC)
+            pc = (cells[sp] == 0) ? targets[pc] : pc + 1;
+            sp--;
+            VM_NEXT();
+
+        VM_HANDLER(VM_OUT)
+            fprintf(output, "%d\n", cells[sp]);
+            sp--;
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_IN)
+            VM_NEED(1);
+            sp++;
+            fprintf(output, "Input integer value: ");
+            fscanf(input, "%d", &cells[sp]);
+            pc++;
+            VM_NEXT();
+
+        // Returning from the program's own frame (OPR 0 0) is the end state
+        VM_HANDLER(VM_RET)
+            sp = bp - 1;
+            pc = cells[sp + 3];
+            bp = cells[sp + 2];
+
+            if ((unsigned int) pc > (unsigned int) length)
+                pc = length;
+
+            if (sp == -1 && ir->L == 0)
+                goto done;
+
+            VM_NEXT();
+
+        VM_HANDLER(VM_NEG)
+            cells[sp] *= -1;
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_ODD)
+            cells[sp] = (cells[sp] % 2 == 0) ? 0 : 1;
+            pc++;
+            VM_NEXT();
+
+        // Binary operators, as operate() applies them
+        VM_HANDLER(VM_ADD)
+            sp--;
+            cells[sp] = cells[sp] + cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_SUB)
+            sp--;
+            cells[sp] = cells[sp] - cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_MUL)
+            sp--;
+            cells[sp] = cells[sp] * cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_DIV)
+            VM_CHECK_DIVISION(DIV, cells[sp - 1], cells[sp]);
+            sp--;
+            cells[sp] = cells[sp] / cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_MOD)
+            VM_CHECK_DIVISION(MOD, cells[sp - 1], cells[sp]);
+            sp--;
+            cells[sp] = cells[sp] % cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_EQL)
+            sp--;
+            cells[sp] = cells[sp] == cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_NEQ)
+            sp--;
+            cells[sp] = cells[sp] != cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_LSS)
+            sp--;
+            cells[sp] = cells[sp] < cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_LEQ)
+            sp--;
+            cells[sp] = cells[sp] <= cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_GTR)
+            sp--;
+            cells[sp] = cells[sp] > cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_GEQ)
+            sp--;
+            cells[sp] = cells[sp] >= cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_SHL)
+            sp--;
+            cells[sp] = (int) ((unsigned int) cells[sp] << cells[sp + 1]);
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_SHR)
+            sp--;
+            cells[sp] = (cells[sp] + ((cells[sp] >> 31) & (int) ((1u << cells[sp + 1]) - 1))) >> cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        VM_HANDLER(VM_AND)
+            sp--;
+            cells[sp] = cells[sp] & cells[sp + 1];
+            pc++;
+            VM_NEXT();
+
+        // Superinstructions read their operands from the instructions they fused
+
+        // LOD a; LOD b; OPR op
+        VM_HANDLER(VM_LLO)
+            VM_NEED(1);
+            left = cells[chainBase(cells, bp, ir->L) + ir->M];
+            right = cells[chainBase(cells, bp, program[pc + 1].L) + program[pc + 1].M];
+            VM_CHECK_DIVISION(program[pc + 2].M, left, right);
+            cells[++sp] = operate(program[pc + 2].M, left, right);
+            pc += 3;
+            VM_NEXT();
+
+        // LOD a; LIT c; OPR op
+        VM_HANDLER(VM_LCO)
+            VM_NEED(1);
+            left = cells[chainBase(cells, bp, ir->L) + ir->M];
+            right = program[pc + 1].M;
+            VM_CHECK_DIVISION(program[pc + 2].M, left, right);
+            cells[++sp] = operate(program[pc + 2].M, left, right);
+            pc += 3;
+            VM_NEXT();
+
+        // LOD a; LOD b; OPR op; JPC t
+        VM_HANDLER(VM_LLB)
+            left = cells[chainBase(cells, bp, ir->L) + ir->M];
+            right = cells[chainBase(cells, bp, program[pc + 1].L) + program[pc + 1].M];
+            VM_CHECK_DIVISION(program[pc + 2].M, left, right);
+
+            if (operate(program[pc + 2].M, left, right) == 0)
+                pc = targets[pc];
+            else
+                pc += 4;
+            VM_NEXT();
+
+        // LOD a; LIT c; OPR op; JPC t
+        VM_HANDLER(VM_LCB)
+            left = cells[chainBase(cells, bp, ir->L) + ir->M];
+            right = program[pc + 1].M;
+            VM_CHECK_DIVISION(program[pc + 2].M, left, right);
+
+            if (operate(program[pc + 2].M, left, right) == 0)
+                pc = targets[pc];
+            else
+                pc += 4;
+            VM_NEXT();
+
+        // LOD x; LIT c; OPR ADD; STO x
+        VM_HANDLER(VM_ADI)
+            cells[chainBase(cells, bp, ir->L) + ir->M] += program[pc + 1].M;
+            pc += 4;
+            VM_NEXT();
+
+        // LIT c; STO x
+        VM_HANDLER(VM_LST)
+            cells[chainBase(cells, bp, program[pc + 1].L) + program[pc + 1].M] = ir->M;
+            pc += 2;
+            VM_NEXT();
+
+        VM_HANDLER(VM_HALT)
+            dispatches--;
+            ir = NULL;
+            goto done;
+    }
+
+done:
+    PC = pc;
+    BP = bp;
+    SP = sp;
+    dispatchCount = dispatches;
+
+    if (ir != NULL)
+        IR = *ir;
+
+    free(cells);
+    free(handlers);
+    free(targets);
+#ifdef VM_THREADED
+    free(threaded);
+#endif
+
+    return error;
+}
+
+// Returns the message for a run error
+const char* runErrorMessage(int error)
+{
+    switch (error)
+    {
+        case VM_STACK_OVERFLOW:
+            return "Stack overflow.";
+        case VM_DIVIDE_BY_ZERO:
+            return "Division by zero.";
+        case VM_DIVIDE_OVERFLOW:
+            return "Division overflow.";
+        default:
+            return "";
+    }
+}
+
+// Returns the handler that runs the instruction at an address of a program
+// length instructions long
+int decodeHandler(Instruction* program, int length, int address)
+{
+    Instruction* instruction = &program[address];
+    static const unsigned char operators[] =
+    {
+        [RET] = VM_RET, [NEG] = VM_NEG, [ADD] = VM_ADD, [SUB] = VM_SUB, [MUL] = VM_MUL, [DIV] = VM_DIV,
+        [ODD] = VM_ODD, [MOD] = VM_MOD, [EQL] = VM_EQL, [NEQ] = VM_NEQ, [LSS] = VM_LSS, [LEQ] = VM_LEQ,
+        [GTR] = VM_GTR, [GEQ] = VM_GEQ, [SHL] = VM_SHL, [SHR] = VM_SHR, [AND] = VM_AND,
+    };
+
+    switch (instruction->OP)
+    {
+        case (LIT): return VM_LIT;
+        case (LOD): return VM_LOD;
+        case (STO): return VM_STO;
+        case (CAL): return VM_CAL;
+        case (INC): return VM_INC;
+        case (JMP): return VM_JMP;
+        case (JPC): return VM_JPC;
+        case (OUT): return VM_OUT;
+        case (IN): return VM_IN;
+        case (TCA): return VM_TCA;
+
+        // A superinstruction cut off by the end of the code can't run
+        case (LLO): return (address + 2 < length) ? VM_LLO : VM_HALT;
+        case (LCO): return (address + 2 < length) ? VM_LCO : VM_HALT;
+        case (LLB): return (address + 3 < length) ? VM_LLB : VM_HALT;
+        case (LCB): return (address + 3 < length) ? VM_LCB : VM_HALT;
+        case (ADI): return (address + 3 < length) ? VM_ADI : VM_HALT;
+        case (LST): return (address + 1 < length) ? VM_LST : VM_HALT;
+
+        case (OPR):
+            if (instruction->M >= 0 && instruction->M < (int) sizeof(operators))
+                return operators[instruction->M];
+            return VM_NOP;
+
+        default:
+            return VM_NOP;
+    }
+}
+
+// Returns where the instruction at an address jumps, calls or branches to -- the
+// HALT slot (length) if that is outside the code
+int decodeTarget(Instruction* program, int length, int address)
+{
+    int target;
+
+    switch (program[address].OP)
+    {
+        case (JMP):
+        case (JPC):
+        case (CAL):
+        case (TCA):
+            target = program[address].M;
+            break;
+
+        case (LLB):
+        case (LCB):
+            if (address + 3 >= length)
+                return length;
+
+            target = program[address + 3].M;
+            break;
+
+        default:
+            return length;
+    }
+
+    return (target >= 0 && target < length) ? target : length;
+}
+
+// Returns the base of the frame a number of static links down from bp
+int chainBase(int* cells, int bp, int level)
+{
+    while (level > 0)
+    {
+        bp = cells[bp];
+        level--;
+    }
+
+    return bp;
+}
+
+#endif
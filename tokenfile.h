@@ -0,0 +1,144 @@
+#ifndef TOKENFILE_H
+#define TOKENFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "structs.h"
+#include "intern.h"
+#include "tokens.h"
+#include "pl0_constants.h"
+
+// Binary token stream, the scanner's hand-off to a separate parser process.
+// Layout (host byte order):
+//
+//   TokenFileHeader     magic "PL0T", version, token count, string count,
+//                       string table size in bytes
+//   string table        identifier names, each terminated by '\0'; string n is
+//                       the n-th name in the table
+//   TokenRecord[count]  fixed width records: kind, source offset, length, value
+//                       (string number for identifiers, numeric value for numbers)
+//
+// Reading is a few fread()s plus interning each distinct name once; the records
+// are copied straight into a TokenBuffer.
+
+#define TOKEN_FILE_MAGIC "PL0T"
+#define TOKEN_FILE_VERSION 1
+
+// PROTOTYPES
+int writeTokenFile(char* fileName, TokenBuffer* buffer, InternTable* names);
+int readTokenFile(char* fileName, TokenBuffer* buffer);
+
+// Writes buffer to a token file -- returns 0 if the file can't be written
+int writeTokenFile(char* fileName, TokenBuffer* buffer, InternTable* names)
+{
+    TokenFileHeader header;
+    TokenRecord* records;
+    FILE* ofp = fopen(fileName, "wb");
+    int i;
+
+    if (ofp == NULL)
+        return 0;
+
+    // The intern table is the string table, so a name's ID is its string number
+    memcpy(header.magic, TOKEN_FILE_MAGIC, 4);
+    header.version = TOKEN_FILE_VERSION;
+    header.tokenCount = buffer->count;
+    header.stringCount = names->count;
+    header.stringBytes = 0;
+
+    for (i = 0; i < names->count; i++)
+        header.stringBytes += names->lengths[i] + 1;
+
+    fwrite(&header, sizeof(TokenFileHeader), 1, ofp);
+
+    for (i = 0; i < names->count; i++)
+        fwrite(names->names[i], 1, names->lengths[i] + 1, ofp);
+
+    records = calloc((buffer->count) ? buffer->count : 1, sizeof(TokenRecord));
+
+    for (i = 0; i < buffer->count; i++)
+    {
+        records[i].kind = buffer->kind[i];
+        records[i].offset = buffer->offset[i];
+        records[i].length = buffer->length[i];
+        records[i].value = buffer->value[i];
+    }
+
+    fwrite(records, sizeof(TokenRecord), buffer->count, ofp);
+
+    free(records);
+    fclose(ofp);
+
+    return 1;
+}
+
+// Fills buffer from a token file, interning its names into identifiers
+// Returns 0 (leaving buffer empty) if the file is missing, truncated or not a token file
+int readTokenFile(char* fileName, TokenBuffer* buffer)
+{
+    TokenFileHeader header;
+    TokenRecord* records = NULL;
+    char* strings = NULL;
+    int* nameIDs = NULL;
+    FILE* ifp = fopen(fileName, "rb");
+    int i, position, ok = 0;
+
+    buffer->count = 0;
+
+    if (ifp == NULL)
+        return 0;
+
+    if (fread(&header, sizeof(TokenFileHeader), 1, ifp) == 1 &&
+        memcmp(header.magic, TOKEN_FILE_MAGIC, 4) == 0 && header.version == TOKEN_FILE_VERSION)
+    {
+        strings = malloc(header.stringBytes + 1);
+        nameIDs = calloc(header.stringCount + 1, sizeof(int));
+        records = malloc((header.tokenCount + 1) * sizeof(TokenRecord));
+
+        ok = fread(strings, 1, header.stringBytes, ifp) == header.stringBytes &&
+             fread(records, sizeof(TokenRecord), header.tokenCount, ifp) == header.tokenCount;
+
+        strings[header.stringBytes] = '\0';
+
+        // Every identifier must name a string in the table
+        for (i = 0; ok && i < (int) header.tokenCount; i++)
+        {
+            if (records[i].kind == IDENT_SYM && (records[i].value < 0 || records[i].value >= (int) header.stringCount))
+                ok = 0;
+        }
+    }
+
+    fclose(ifp);
+
+    if (ok)
+    {
+        // Map string numbers to this process's intern IDs
+        for (i = 0, position = 0; i < (int) header.stringCount && position < (int) header.stringBytes; i++)
+        {
+            nameIDs[i] = intern(&identifiers, strings + position, strlen(strings + position));
+            position += strlen(strings + position) + 1;
+        }
+
+        growTokenBuffer(buffer, header.tokenCount + 1);
+
+        for (i = 0; i < (int) header.tokenCount; i++)
+        {
+            buffer->kind[i] = records[i].kind;
+            buffer->offset[i] = records[i].offset;
+            buffer->length[i] = records[i].length;
+            buffer->value[i] = (records[i].kind == IDENT_SYM) ? nameIDs[records[i].value] : records[i].value;
+        }
+
+        buffer->count = header.tokenCount;
+    }
+
+    free(strings);
+    free(nameIDs);
+    free(records);
+
+    return ok;
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef TOKENS_H
+#define TOKENS_H
+
+#include <stdlib.h>
+
+#include "structs.h"
+
+// Token buffer handed from the scanner to the parser. Tokens are stored as
+// parallel arrays (kind byte, source offset, length, value) so a token costs
+// 13 bytes and the parser walks it front to back. The value is the interned
+// name for identifiers and the numeric value for numbers. Offsets point into
+// tokenSource, which stays loaded for diagnostics.
+
+#define TOKENS_INITIAL_CAPACITY 1024
+
+// PROTOTYPES
+void appendToken(TokenBuffer* buffer, int kind, int offset, int length, int value);
+void growTokenBuffer(TokenBuffer* buffer, int capacity);
+void freeTokenBuffer(TokenBuffer* buffer);
+void sourceLocation(Source* source, int offset, int* line, int* column);
+
+// GLOBALS
+THREAD_LOCAL TokenBuffer tokens;
+THREAD_LOCAL Source tokenSource;
+
+// Set while the scanner is still producing tokens (pipelined compile). The parser
+// calls it when it runs out, it appends at least one token or returns 0 at the end.
+THREAD_LOCAL int (*refillTokens)(TokenBuffer* buffer) = NULL;
+
+// Adds a token to the end of the buffer
+void appendToken(TokenBuffer* buffer, int kind, int offset, int length, int value)
+{
+    int i = buffer->count;
+
+    if (i == buffer->capacity)
+        growTokenBuffer(buffer, (buffer->capacity) ? buffer->capacity * 2 : TOKENS_INITIAL_CAPACITY);
+
+    buffer->kind[i] = (unsigned char) kind;
+    buffer->offset[i] = (unsigned int) offset;
+    buffer->length[i] = (unsigned int) length;
+    buffer->value[i] = value;
+    buffer->count++;
+}
+
+// Resizes every column of the buffer to hold capacity tokens
+void growTokenBuffer(TokenBuffer* buffer, int capacity)
+{
+    buffer->kind = realloc(buffer->kind, capacity * sizeof(unsigned char));
+    buffer->offset = realloc(buffer->offset, capacity * sizeof(unsigned int));
+    buffer->length = realloc(buffer->length, capacity * sizeof(unsigned int));
+    buffer->value = realloc(buffer->value, capacity * sizeof(int));
+    buffer->capacity = capacity;
+}
+
+// Releases the buffer's columns
+void freeTokenBuffer(TokenBuffer* buffer)
+{
+    free(buffer->kind);
+    free(buffer->offset);
+    free(buffer->length);
+    free(buffer->value);
+    buffer->kind = NULL;
+    buffer->offset = NULL;
+    buffer->length = NULL;
+    buffer->value = NULL;
+    buffer->count = 0;
+    buffer->capacity = 0;
+}
+
+// Converts a source offset into a 1 based line & column
+void sourceLocation(Source* source, int offset, int* line, int* column)
+{
+    int i;
+
+    *line = 1;
+    *column = 1;
+
+    for (i = 0; i < offset && i < source->length; i++)
+    {
+        if (source->text[i] == '\n')
+        {
+            (*line)++;
+            *column = 1;
+        }
+        else
+            (*column)++;
+    }
+}
+
+#endif
@@ -5,7 +5,7 @@
 
 #include "vm.h"
 
-int main(int argc, char *argv[])
+int main()
 {
     // Coded this way for external user
     vm();
@@ -7,56 +7,99 @@
 
 #include "files.h"
 #include "structs.h"
+#include "objectfile.h"
 #include "pm0_constants.h"
 
+// Stack cells for a program whose object file gives no bound (a recursive one)
 #define MAXSTACK 2000
-#define MAXCODE 500
 
 // PROTOTYPES
 extern void vm();
+void runCode(FILE* traceFile, int entry, int stackSize);
 int* initStack(int maxSize);
-Instruction* initCode(int maxCodeSize);
-Instruction* readCode(int maxCodeSize);
 int endOfProgram();
 void fetch();
 void execute();
 void executeOPR();
 int base();
-char* opToString(int OP);
+int frame(int level);
+int operate(int op, int left, int right);
 char* stackToString();
 char* intToString(int num);
 void startStackTrace(FILE* outputFilePtr);
 
 // GLOBALS
-int* stack;
-int PC;
-int BP;
-int SP;
-Instruction IR;
-Instruction* code;
-int linesOfCode;
+THREAD_LOCAL int* stack;
+THREAD_LOCAL int PC;
+THREAD_LOCAL int BP;
+THREAD_LOCAL int SP;
+THREAD_LOCAL Instruction IR;
+THREAD_LOCAL long long dispatchCount;
+THREAD_LOCAL Instruction* code;
+THREAD_LOCAL int linesOfCode;
+
+// Where OUT writes and IN reads (stdout & stdin when NULL)
+THREAD_LOCAL FILE* vmInput = NULL;
+THREAD_LOCAL FILE* vmOutput = NULL;
+
+// The untraced core, relies on the globals above
+#include "threaded.h"
 
 // Invokes virtual machine
 void vm()
 {
 	// Initialize variables
-	FILE* ofp = fopen(STACKTRACE_FILE, "w");
-	stack = initStack(MAXSTACK);
-	code = readCode(MAXCODE);
-	
-	PC = 0;
-	BP = 0;
-	SP = -1;
+	ObjectFile object;
+	FILE* ofp;
+
+	// Run straight out of the mapped object file
+	if (!mapObjectFile(OBJECT_FILE, &object))
+	{
+		printf("Could not read object file %s\n", OBJECT_FILE);
+		return;
+	}
+
+	ofp = fopen(STACKTRACE_FILE, "w");
+	code = object.code;
+	linesOfCode = object.header->instructionCount;
 
-	int line;
-	char* stackString;
-	
 	// Start display to screen
 	printf("Output:\n");
-	
+
 	// Mirror Code & Start Stack Trace to Debug File
 	startStackTrace(ofp);
-	
+
+	runCode(ofp, object.header->entryPoint, object.header->maxStack);
+
+	code = NULL;
+	closeObjectFile(&object);
+
+	if (ofp != NULL)
+		fclose(ofp);
+}
+
+// Runs the loaded code from an entry address to the end state on a stack of
+// stackSize cells (MAXSTACK for OBJECT_UNBOUNDED_STACK), tracing each dispatch
+// to traceFile (NULL runs untraced)
+void runCode(FILE* traceFile, int entry, int stackSize)
+{
+	int line;
+	char* stackString;
+
+	stack = initStack((stackSize == OBJECT_UNBOUNDED_STACK) ? MAXSTACK : stackSize);
+
+	if (vmInput == NULL)
+		vmInput = stdin;
+
+	if (vmOutput == NULL)
+		vmOutput = stdout;
+
+	PC = entry;
+	BP = 0;
+	SP = -1;
+	IR.OP = IR.L = IR.M = 0;
+	dispatchCount = 0;
+
 	// Loop the code until end state
 	while(!endOfProgram())
 	{
@@ -64,18 +107,20 @@ void vm()
 		line = PC;
 		fetch();
 		execute();
-		
-		fprintf(ofp, "%3d%7s%4d%6d", line, opToString(IR.OP), IR.L, IR.M);
-		fprintf(ofp, "%6d%6d%6d   ", PC, BP, SP);
-		
+		dispatchCount++;
+
+		if (traceFile == NULL)
+			continue;
+
+		fprintf(traceFile, "%3d%7s%4d%6d", line, opToString(IR.OP), IR.L, IR.M);
+		fprintf(traceFile, "%6d%6d%6d   ", PC, BP, SP);
+
 		stackString = stackToString();
-		fprintf(ofp, "%s\n", stackString);
+		fprintf(traceFile, "%s\n", stackString);
 		free(stackString);
 	}
-	
-	free(code);
+
 	free(stack);
-	fclose(ofp);
 }
 
 // Initialize stack
@@ -84,53 +129,6 @@ int* initStack(int maxSize)
 	return calloc(maxSize, sizeof(int));
 }
 
-// Initialize code 
-Instruction* initCode(int maxCodeSize)
-{
-	return calloc(maxCodeSize, sizeof(Instruction));
-}
-
-// Read Code
-Instruction* readCode(int maxCodeSize)
-{
-	// Variables
-	int OP, L, M;
-	int i, line = 0;
-	Instruction* buffer = initCode(maxCodeSize);
-	Instruction* code;
-	
-	// Open file
-	FILE* fp = fopen(CODE_FILE, "r");
-	
-	// If valid file
-	if (fp != NULL)
-	{
-		// While not end of file, keep scanning Instruction triplets
-		while((fscanf(fp, "%d %d %d", &OP, &L, &M)) != EOF)
-		{
-			buffer[line].OP = OP;
-			buffer[line].L = L;
-			buffer[line].M = M;
-			line++;
-		}
-	}
-
-	fclose(fp);
-	
-	// Allocate the correct size code array and dump the buffer
-	code = calloc(line, sizeof(Instruction));
-	
-	for (i=0; i < line; i++)
-	{
-		code[i] = buffer[i];
-	}
-	
-	linesOfCode = line;
-	free(buffer);
-	
-	return code;
-}
-
 // Returns 1 if program has reached end state (OPR 0 0, with SP = -1)
 int endOfProgram()
 {
@@ -150,8 +148,6 @@ void fetch()
 // Executes the Instruction in the Instruction register
 void execute()
 {
-	int input;
-	
 	switch(IR.OP)
 	{
 		// Push literal on stack
@@ -186,6 +182,14 @@ void execute()
 			PC = IR.M;
 			break;
 		
+		// Tail call: the callee takes over the frame (and so the return) of
+		// the caller, whose static link it replaces
+		case (TCA):
+			stack[BP] = base();
+			SP = BP - 1;
+			PC = IR.M;
+			break;
+		
 		// Increment the stack
 		case (INC):
 			SP += IR.M;
@@ -205,17 +209,62 @@ void execute()
 		
 		// Output to screen
 		case (OUT):
-			printf("%d\n", stack[SP]);
+			fprintf(vmOutput, "%d\n", stack[SP]);
 			SP -= 1;
 			break;
 		
 		// Input from user
 		case (IN):
 			SP += 1;
-			printf("Input integer value: ");
-			scanf("%d", &stack[SP]);
+			fprintf(vmOutput, "Input integer value: ");
+			fscanf(vmInput, "%d", &stack[SP]);
 			break;
 		
+		// Superinstructions: the first instruction of a fused window carries
+		// the opcode, the rest stay in place as operands and are stepped over
+
+		// LOD a; LOD b; OPR op
+		case (LLO):
+			SP += 1;
+			stack[SP] = operate(code[PC + 1].M, stack[base() + IR.M], stack[frame(code[PC].L) + code[PC].M]);
+			PC += 2;
+			break;
+
+		// LOD a; LIT c; OPR op
+		case (LCO):
+			SP += 1;
+			stack[SP] = operate(code[PC + 1].M, stack[base() + IR.M], code[PC].M);
+			PC += 2;
+			break;
+
+		// LOD a; LOD b; OPR op; JPC t
+		case (LLB):
+			if (operate(code[PC + 1].M, stack[base() + IR.M], stack[frame(code[PC].L) + code[PC].M]) == 0)
+				PC = code[PC + 2].M;
+			else
+				PC += 3;
+			break;
+
+		// LOD a; LIT c; OPR op; JPC t
+		case (LCB):
+			if (operate(code[PC + 1].M, stack[base() + IR.M], code[PC].M) == 0)
+				PC = code[PC + 2].M;
+			else
+				PC += 3;
+			break;
+
+		// LOD x; LIT c; OPR ADD; STO x
+		case (ADI):
+			stack[base() + IR.M] += code[PC].M;
+			PC += 3;
+			break;
+
+		// LIT c; STO x
+		case (LST):
+			stack[frame(code[PC].L) + code[PC].M] = IR.M;
+			PC += 1;
+			break;
+
 		// Invalid Instruction
 		default:
 			break;
@@ -239,125 +288,112 @@ void executeOPR()
 			stack[SP] *= -1;
 			break;
 		
-		// Add
+		// Odd
+		case(ODD):
+			stack[SP] = (stack[SP] %2 == 0) ? 0 : 1;
+			break;
+		
+		// Binary operators
 		case(ADD):
+		case(SUB):
+		case(MUL):
+		case(DIV):
+		case(MOD):
+		case(EQL):
+		case(NEQ):
+		case(LSS):
+		case(LEQ):
+		case(GTR):
+		case(GEQ):
+		case(SHL):
+		case(SHR):
+		case(AND):
 			SP -= 1;
-			stack[SP] = stack[SP] + stack[SP + 1];
+			stack[SP] = operate(IR.M, stack[SP], stack[SP + 1]);
 			break;
-			
+		
+		// Invalid M
+		default:
+			break;
+	}
+}
+
+// Returns base L levels down stack
+int base()
+{
+	return frame(IR.L);
+}
+
+// Returns the base of the frame a number of static links down from BP
+int frame(int level)
+{
+	return chainBase(stack, BP, level);
+}
+
+// Applies a binary OPR operator (M value) to its two operands
+int operate(int op, int left, int right)
+{
+	switch(op)
+	{
+		// Add
+		case(ADD):
+			return left + right;
+		
 		// Subtract
 		case(SUB):
-			SP -= 1;
-			stack[SP] = stack[SP] - stack[SP + 1];
-			break;
-			
+			return left - right;
+		
 		// Multiply
 		case(MUL):
-			SP -= 1;
-			stack[SP] = stack[SP] * stack[SP + 1];
-			break;
-			
+			return left * right;
+		
 		// Divide
 		case(DIV):
-			SP -= 1;
-			stack[SP] = stack[SP] / stack[SP + 1];
-			break;
-		
-		// Odd
-		case(ODD):
-			stack[SP] = (stack[SP] %2 == 0) ? 0 : 1;
-			break;
+			return left / right;
 		
 		// Modulus
 		case(MOD):
-			SP -= 1;
-			stack[SP] = stack[SP] % stack[SP + 1];
-			break;
-			
+			return left % right;
+		
 		// Equal
 		case(EQL):
-			SP -= 1;
-			stack[SP] = (stack[SP] == stack[SP+1]) ? 1 : 0;
-			break;
-			
+			return (left == right) ? 1 : 0;
+		
 		// Not Equal
 		case(NEQ):
-			SP -= 1;
-			stack[SP] = (stack[SP] != stack[SP+1]) ? 1 : 0;
-			break;
+			return (left != right) ? 1 : 0;
 		
 		// Less than
 		case(LSS):
-			SP -= 1;
-			stack[SP] = (stack[SP] < stack[SP+1]) ? 1 : 0;
-			break;
-			
+			return (left < right) ? 1 : 0;
+		
 		// Less than or equal
 		case(LEQ):
-			SP -= 1;
-			stack[SP] = (stack[SP] <= stack[SP+1]) ? 1 : 0;
-			break;
+			return (left <= right) ? 1 : 0;
 		
 		// Greater than
 		case(GTR):
-			SP -= 1;
-			stack[SP] = (stack[SP] > stack[SP+1]) ? 1 : 0;		
-			break;
+			return (left > right) ? 1 : 0;
 		
 		// Greater than or equal
 		case(GEQ):
-			SP -= 1;
-			stack[SP] = (stack[SP] >= stack[SP+1]) ? 1 : 0;
-			break;
+			return (left >= right) ? 1 : 0;
+		
+		// Shift left, wrapping like MUL
+		case(SHL):
+			return (int) ((unsigned int) left << right);
+		
+		// Shift right, biased so negatives round toward zero like DIV
+		case(SHR):
+			return (left + ((left >> 31) & (int) ((1u << right) - 1))) >> right;
+		
+		// Bitwise and
+		case(AND):
+			return left & right;
 		
 		// Invalid M
 		default:
-			break;
-	}
-}
-
-// Returns base L levels down stack
-int base()
-{
-	int baseLevel = BP;
-	int level = IR.L;
-	
-	while (level > 0)
-	{
-		baseLevel = stack[baseLevel];
-		level--;
-	}
-	
-	return baseLevel;
-}
-
-// Returns string based on OP's int value
-char* opToString(int OP)
-{
-	switch(OP)
-	{
-		case 1:
-			return "lit";
-		case 2:
-			return "opr";
-		case 3:
-			return "lod";
-		case 4:
-			return "sto";
-		case 5:
-			return "cal";
-		case 6:
-			return "inc";
-		case 7:
-			return "jmp";
-		case 8:
-			return "jpc";
-		case 9:
-			return "out";
-		case 10:
-			return " in";
-		default:
-			return "   ";
+			return 0;
 	}
 }
 